@@ -0,0 +1,213 @@
+//! @file BlendKernels.cpp
+#include "BlendKernels.hpp"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SVG_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace svg
+{
+    namespace
+    {
+        static_assert(sizeof(Color) == 3, "pixels must be packed RGB bytes");
+
+        void blend_span_scalar(Color *p, size_t count, const Color &c, rgb_value alpha)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                p[i] = blend(p[i], c, alpha);
+            }
+        }
+
+        void blend_pixels_scalar(Color *p, const Color *below, size_t count, rgb_value alpha)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                p[i] = blend(below[i], p[i], alpha);
+            }
+        }
+
+#ifdef SVG_X86_KERNELS
+        // Pixels are handled as a byte stream (r g b r g b ...), widened to
+        // 16 bits: t * alpha + b * (255 - alpha) + 128 peaks at 65153, and
+        // dividing by 255 with (v + (v >> 8)) >> 8 stays below 65536 too.
+        // The constant color repeats every 3 bytes, so its 48-byte pattern
+        // (3 vectors of 16 bytes) is precomputed once per span.
+
+        //! Fill the 16-bit pattern of c * alpha + 128 for 48 bytes.
+        void color_pattern(const Color &c, rgb_value alpha, uint16_t pattern[48])
+        {
+            for (int i = 0; i < 48; i += 3)
+            {
+                pattern[i] = (uint16_t)(c.red * alpha + 128);
+                pattern[i + 1] = (uint16_t)(c.green * alpha + 128);
+                pattern[i + 2] = (uint16_t)(c.blue * alpha + 128);
+            }
+        }
+
+        __attribute__((target("sse2"))) inline __m128i div255_sse2(__m128i v)
+        {
+            return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+        }
+
+        __attribute__((target("sse2"))) void blend_span_sse2(Color *p, size_t count, const Color &c, rgb_value alpha)
+        {
+            uint16_t pattern[48];
+            color_pattern(c, alpha, pattern);
+            __m128i top[6];
+            for (int k = 0; k < 6; k++)
+            {
+                top[k] = _mm_loadu_si128((const __m128i *)(pattern + 8 * k));
+            }
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i inv = _mm_set1_epi16(255 - alpha);
+            unsigned char *bytes = (unsigned char *)p;
+            size_t i = 0;
+            // 16 pixels, 48 bytes, per iteration
+            for (; i + 16 <= count; i += 16)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    __m128i *q = (__m128i *)(bytes + 3 * i + 16 * k);
+                    __m128i b = _mm_loadu_si128(q);
+                    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), inv), top[2 * k]);
+                    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), inv), top[2 * k + 1]);
+                    _mm_storeu_si128(q, _mm_packus_epi16(div255_sse2(lo), div255_sse2(hi)));
+                }
+            }
+            blend_span_scalar(p + i, count - i, c, alpha);
+        }
+
+        __attribute__((target("sse2"))) void blend_pixels_sse2(Color *p, const Color *below, size_t count, rgb_value alpha)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i a = _mm_set1_epi16(alpha);
+            const __m128i inv = _mm_set1_epi16(255 - alpha);
+            const __m128i half = _mm_set1_epi16(128);
+            unsigned char *bytes = (unsigned char *)p;
+            const unsigned char *under = (const unsigned char *)below;
+            size_t i = 0;
+            // 16 pixels, 48 bytes, per iteration
+            for (; i + 16 <= count; i += 16)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    __m128i *q = (__m128i *)(bytes + 3 * i + 16 * k);
+                    __m128i t = _mm_loadu_si128(q);
+                    __m128i b = _mm_loadu_si128((const __m128i *)(under + 3 * i + 16 * k));
+                    __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(t, zero), a),
+                                                             _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), inv)),
+                                               half);
+                    __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(t, zero), a),
+                                                             _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), inv)),
+                                               half);
+                    _mm_storeu_si128(q, _mm_packus_epi16(div255_sse2(lo), div255_sse2(hi)));
+                }
+            }
+            blend_pixels_scalar(p + i, below + i, count - i, alpha);
+        }
+
+        __attribute__((target("avx2"))) inline __m128i pack_avx2(__m256i v)
+        {
+            v = _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+            return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        }
+
+        __attribute__((target("avx2"))) void blend_span_avx2(Color *p, size_t count, const Color &c, rgb_value alpha)
+        {
+            uint16_t pattern[48];
+            color_pattern(c, alpha, pattern);
+            __m256i top[3];
+            for (int k = 0; k < 3; k++)
+            {
+                top[k] = _mm256_loadu_si256((const __m256i *)(pattern + 16 * k));
+            }
+            const __m256i inv = _mm256_set1_epi16(255 - alpha);
+            unsigned char *bytes = (unsigned char *)p;
+            size_t i = 0;
+            // 32 pixels, 96 bytes, per iteration: the pattern twice
+            for (; i + 32 <= count; i += 32)
+            {
+                for (int k = 0; k < 6; k++)
+                {
+                    __m128i *q = (__m128i *)(bytes + 3 * i + 16 * k);
+                    __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(q));
+                    _mm_storeu_si128(q, pack_avx2(_mm256_add_epi16(_mm256_mullo_epi16(b, inv), top[k % 3])));
+                }
+            }
+            blend_span_sse2(p + i, count - i, c, alpha);
+        }
+
+        __attribute__((target("avx2"))) void blend_pixels_avx2(Color *p, const Color *below, size_t count, rgb_value alpha)
+        {
+            const __m256i a = _mm256_set1_epi16(alpha);
+            const __m256i inv = _mm256_set1_epi16(255 - alpha);
+            const __m256i half = _mm256_set1_epi16(128);
+            unsigned char *bytes = (unsigned char *)p;
+            const unsigned char *under = (const unsigned char *)below;
+            size_t i = 0;
+            // 16 pixels, 48 bytes, per iteration
+            for (; i + 16 <= count; i += 16)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    __m128i *q = (__m128i *)(bytes + 3 * i + 16 * k);
+                    __m256i t = _mm256_cvtepu8_epi16(_mm_loadu_si128(q));
+                    __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(under + 3 * i + 16 * k)));
+                    __m256i v = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(t, a), _mm256_mullo_epi16(b, inv)), half);
+                    _mm_storeu_si128(q, pack_avx2(v));
+                }
+            }
+            blend_pixels_scalar(p + i, below + i, count - i, alpha);
+        }
+#endif
+
+        //! Kernel set, picked once from the CPU features.
+        struct Kernels
+        {
+            const char *name;
+            void (*span)(Color *, size_t, const Color &, rgb_value);
+            void (*pixels)(Color *, const Color *, size_t, rgb_value);
+        };
+
+        Kernels pick_kernels()
+        {
+#ifdef SVG_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return Kernels{"avx2", blend_span_avx2, blend_pixels_avx2};
+            }
+            if (__builtin_cpu_supports("sse2"))
+            {
+                return Kernels{"sse2", blend_span_sse2, blend_pixels_sse2};
+            }
+#endif
+            return Kernels{"scalar", blend_span_scalar, blend_pixels_scalar};
+        }
+
+        const Kernels &kernels()
+        {
+            static const Kernels k = pick_kernels();
+            return k;
+        }
+    }
+
+    void blend_span(Color *pixels, size_t count, const Color &c, rgb_value alpha)
+    {
+        kernels().span(pixels, count, c, alpha);
+    }
+
+    void blend_pixels(Color *pixels, const Color *below, size_t count, rgb_value alpha)
+    {
+        kernels().pixels(pixels, below, count, alpha);
+    }
+
+    const char *blend_kernels_name()
+    {
+        return kernels().name;
+    }
+}
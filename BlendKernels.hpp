@@ -0,0 +1,56 @@
+//! @file BlendKernels.hpp
+#ifndef __svg_BlendKernels_hpp__
+#define __svg_BlendKernels_hpp__
+
+#include "Color.hpp"
+
+#include <cstddef>
+
+namespace svg
+{
+    //! Alpha of fully opaque shapes.
+    const rgb_value OPAQUE_ALPHA = 255;
+
+    //! Composite one channel value over another.
+    //! @param below Value underneath.
+    //! @param top Value on top.
+    //! @param alpha Opacity of top, 0 to 255.
+    //! @return Blended value.
+    inline rgb_value blend_channel(unsigned below, unsigned top, rgb_value alpha)
+    {
+        // (v + 128 + ((v + 128) >> 8)) >> 8 is v / 255 rounded, for v up to 255 * 255
+        unsigned v = top * alpha + below * (255 - alpha) + 128;
+        return (rgb_value)((v + (v >> 8)) >> 8);
+    }
+
+    //! Composite one color over another.
+    //! Every kernel rounds exactly like this, so all produce the same pixels.
+    //! @param below Color underneath.
+    //! @param c Color on top.
+    //! @param alpha Opacity of c, 0 to 255.
+    //! @return Blended color.
+    inline Color blend(const Color &below, const Color &c, rgb_value alpha)
+    {
+        return Color{blend_channel(below.red, c.red, alpha),
+                     blend_channel(below.green, c.green, alpha),
+                     blend_channel(below.blue, c.blue, alpha)};
+    }
+
+    //! Composite a constant color over a run of pixels.
+    //! @param pixels First pixel.
+    //! @param count Number of pixels.
+    //! @param c Color.
+    //! @param alpha Opacity of c, 0 to 255.
+    void blend_span(Color *pixels, size_t count, const Color &c, rgb_value alpha);
+    //! Composite a run of pixels over the pixels that were there before.
+    //! Used to apply the opacity of a group once it is drawn.
+    //! @param pixels First pixel, drawn over; receives the result.
+    //! @param below Pixels before drawing.
+    //! @param count Number of pixels.
+    //! @param alpha Opacity of the drawing, 0 to 255.
+    void blend_pixels(Color *pixels, const Color *below, size_t count, rgb_value alpha);
+    //! Get the name of the kernel set chosen for this CPU.
+    //! @return "avx2", "sse2" or "scalar".
+    const char *blend_kernels_name();
+}
+#endif
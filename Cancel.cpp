@@ -0,0 +1,95 @@
+//! @file Cancel.cpp
+#include "Cancel.hpp"
+
+#include <sstream>
+
+namespace svg
+{
+    namespace
+    {
+        //! Token of the calling thread.
+        thread_local const CancelToken *current_token = nullptr;
+        //! Calls of check_cancel left before the clock is read.
+        thread_local unsigned clock_countdown = 1;
+    }
+
+    CancelToken::CancelToken(double budget_ms)
+        : start_(std::chrono::steady_clock::now()), budget_ms_(budget_ms), cancelled_(false)
+    {
+        deadline_ = start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                 std::chrono::duration<double, std::milli>(budget_ms));
+    }
+
+    void CancelToken::cancel()
+    {
+        cancelled_ = true;
+    }
+
+    bool CancelToken::cancelled() const
+    {
+        return cancelled_;
+    }
+
+    bool CancelToken::stopped() const
+    {
+        return cancelled_ || (budget_ms_ > 0 && std::chrono::steady_clock::now() >= deadline_);
+    }
+
+    void CancelToken::check() const
+    {
+        if (!stopped())
+        {
+            return;
+        }
+        std::ostringstream what;
+        if (cancelled_)
+        {
+            what << "cancelled after " << elapsed() << " ms!";
+        }
+        else
+        {
+            what << "out of time after " << elapsed() << " ms (budget " << budget_ms_ << " ms)!";
+        }
+        throw Cancelled(what.str());
+    }
+
+    bool CancelToken::deadline(std::chrono::steady_clock::time_point &deadline) const
+    {
+        deadline = deadline_;
+        return budget_ms_ > 0;
+    }
+
+    double CancelToken::elapsed() const
+    {
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start_;
+        return ms.count();
+    }
+
+    CancelScope::CancelScope(const CancelToken *token) : previous_(current_token)
+    {
+        current_token = token;
+    }
+
+    CancelScope::~CancelScope()
+    {
+        current_token = previous_;
+    }
+
+    const CancelToken *current_cancel_token()
+    {
+        return current_token;
+    }
+
+    void check_cancel()
+    {
+        if (current_token == nullptr)
+        {
+            return;
+        }
+        if (current_token->cancelled() || --clock_countdown == 0)
+        {
+            clock_countdown = CLOCK_CHECKS;
+            current_token->check();
+        }
+    }
+}
@@ -0,0 +1,96 @@
+//! @file Cancel.hpp
+#ifndef __svg_Cancel_hpp__
+#define __svg_Cancel_hpp__
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+namespace svg
+{
+    //! Thrown by check_cancel when the job of the thread is cancelled or
+    //! out of time. The message tells which, and how long the job had run.
+    class Cancelled : public std::runtime_error
+    {
+    public:
+        //! Constructor.
+        //! @param what Message.
+        Cancelled(const std::string &what) : std::runtime_error(what) {}
+    };
+
+    //! Cancellation token of a job, with an optional time budget.
+    //! cancel() may be called from any thread; the job notices at its next
+    //! check_cancel, which parsing and drawing call for every element and
+    //! the rasterizers for every scanline.
+    class CancelToken
+    {
+    public:
+        //! Constructor, starts the clock.
+        //! @param budget_ms Time budget from now, in milliseconds (0 = none).
+        CancelToken(double budget_ms = 0);
+        //! Cancel the job.
+        void cancel();
+        //! Check if the job is cancelled, without reading the clock.
+        //! @return True if cancel was called.
+        bool cancelled() const;
+        //! Check if the job is cancelled or out of time.
+        //! @return True if it must stop.
+        bool stopped() const;
+        //! Throw Cancelled if the job is cancelled or out of time.
+        void check() const;
+        //! Get the end of the time budget.
+        //! @param deadline Receives the end of the budget.
+        //! @return False if there is no budget.
+        bool deadline(std::chrono::steady_clock::time_point &deadline) const;
+        //! Get the time since the token was made.
+        //! @return Time in milliseconds.
+        double elapsed() const;
+
+    private:
+        CancelToken(const CancelToken &);
+        CancelToken &operator=(const CancelToken &);
+
+        //! Construction time.
+        std::chrono::steady_clock::time_point start_;
+        //! Time budget, 0 for none.
+        double budget_ms_;
+        //! End of the time budget.
+        std::chrono::steady_clock::time_point deadline_;
+        //! Set by cancel.
+        std::atomic<bool> cancelled_;
+    };
+
+    //! Makes a token the one checked by check_cancel on the calling thread,
+    //! for the lifetime of the scope. ThreadPool tasks inherit the token of
+    //! the thread that started them.
+    class CancelScope
+    {
+    public:
+        //! Constructor.
+        //! @param token Token, nullptr for none.
+        CancelScope(const CancelToken *token);
+        //! Destructor, restores the previous token.
+        ~CancelScope();
+
+    private:
+        CancelScope(const CancelScope &);
+        CancelScope &operator=(const CancelScope &);
+
+        //! Token of the enclosing scope.
+        const CancelToken *previous_;
+    };
+
+    //! Get the token of the calling thread.
+    //! @return Token, nullptr if none.
+    const CancelToken *current_cancel_token();
+
+    //! Throw Cancelled if the job of the calling thread is cancelled or out
+    //! of time. Without a token this is a thread-local load and a test; the
+    //! clock, which costs about as much as a scanline, is read on every
+    //! CLOCK_CHECKS-th call of the thread only.
+    void check_cancel();
+    //! Calls of check_cancel per reading of the clock.
+    const unsigned CLOCK_CHECKS = 16;
+}
+#endif
@@ -0,0 +1,108 @@
+//! @file Canvas.hpp
+#ifndef __svg_Canvas_hpp__
+#define __svg_Canvas_hpp__
+
+#include "Color.hpp"
+#include "FillRule.hpp"
+#include "ImageFormat.hpp"
+#include "PackedPoints.hpp"
+#include "Point.hpp"
+#include "Stroke.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Drawing target of SVG elements.
+    //! Each implementation rasterizes the primitives with the templates
+    //! of Raster.hpp, so all canvases produce the same pixels.
+    class Canvas
+    {
+    public:
+        virtual ~Canvas() {}
+        //! Get canvas width.
+        //! @return The canvas width.
+        virtual int width() const = 0;
+        //! Get canvas height.
+        //! @return The canvas height.
+        virtual int height() const = 0;
+        //! Save to output file.
+        //! @param file_name Output file name.
+        //! @param format File format.
+        virtual void save(const std::string &file_name, ImageFormat format) const = 0;
+        //! Save to output file, in the format of its extension.
+        //! @param file_name Output file name.
+        void save(const std::string &file_name) const
+        {
+            save(file_name, ImageFormat::AUTO);
+        }
+        //! Set the opacity of the shapes drawn next.
+        //! Translucent shapes are composited over the pixels underneath,
+        //! each pixel once per shape; opaque ones simply overwrite them.
+        //! @param alpha Opacity, from 0 (invisible) to 255 (opaque, the default).
+        virtual void set_alpha(rgb_value alpha) = 0;
+        //! Start a layer, such as a translucent group: what is drawn until
+        //! the matching end_layer is composited as a whole.
+        //! Layers may be nested.
+        //! @param top_left Top-left corner of the area drawn in the layer.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        virtual void begin_layer(const Point &top_left, const Point &bottom_right) = 0;
+        //! Composite the last layer started over what was underneath.
+        //! @param alpha Opacity of the layer.
+        virtual void end_layer(rgb_value alpha) = 0;
+        //! Draw a line defined by 2 points.
+        //! @param a First point.
+        //! @param b Second point.
+        //! @param c Color to use for the line.
+        virtual void draw_line(const Point &a, const Point &b, const Color &c) = 0;
+        //! Draw a polyline as a wide stroke, with joins and caps.
+        //! @param points First point.
+        //! @param count Number of points.
+        //! @param style Stroke geometry.
+        //! @param c Color to use for the stroke.
+        virtual void draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c) = 0;
+        //! Draw a polyline as a wide stroke, decoding its points on the fly.
+        //! @param points Compressed points.
+        //! @param style Stroke geometry.
+        //! @param c Color to use for the stroke.
+        virtual void draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c) = 0;
+        //! Draw a polygon.
+        //! @param points First point of the polygon.
+        //! @param count Number of points.
+        //! @param fill Color to use for the polygon fill.
+        virtual void draw_polygon(const Point *points, size_t count, const Color &fill) = 0;
+        //! Draw a polygon.
+        //! @param points Vector of points defining the polygon.
+        //! @param fill Color to use for the polygon fill.
+        void draw_polygon(const std::vector<Point> &points, const Color &fill)
+        {
+            draw_polygon(points.data(), points.size(), fill);
+        }
+        //! Draw a polygon, decoding its points on the fly.
+        //! @param points Compressed points of the polygon.
+        //! @param fill Color to use for the polygon fill.
+        virtual void draw_polygon(const PackedPoints &points, const Color &fill) = 0;
+        //! Draw a path of several closed contours, filled as one shape.
+        //! @param points Points of all contours, one after the other.
+        //! @param ends End of each contour in points (one past its last point).
+        //! @param contours Number of contours.
+        //! @param rule Fill rule, telling where contours that overlap are inside.
+        //! @param fill Color to use for the path fill.
+        virtual void draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                               const Color &fill) = 0;
+        //! Draw an ellipse.
+        //! @param center Coordinates for the ellipse center.
+        //! @param radius Radius in X and Y axis, before rotation.
+        //! @param degrees Rotation about the center, as in Point::rotate.
+        //! @param fill Color to use for the ellipse fill.
+        virtual void draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill) = 0;
+        //! Fill an axis-aligned rectangle.
+        //! @param top_left Top-left corner.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        //! @param fill Fill color.
+        virtual void fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill) = 0;
+    };
+}
+#endif
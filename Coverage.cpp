@@ -0,0 +1,427 @@
+//! @file Coverage.cpp
+#include "Coverage.hpp"
+#include "PointKernels.hpp"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SVG_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace svg
+{
+    namespace
+    {
+        //! Largest distance between an ellipse and its polygon, in pixels.
+        const double ELLIPSE_TOLERANCE = 0.05;
+
+        //! Fold a winding area by a fill rule and scale it to 0..255.
+        inline uint8_t fold(float sum, bool nonzero)
+        {
+            float f = std::fabs(sum);
+            if (nonzero)
+            {
+                f = std::min(f, 1.0f);
+            }
+            else
+            {
+                float whole = (float)(int32_t)(f * 0.5f);
+                f = f - (whole + whole);
+                f = std::min(f, 2.0f - f);
+            }
+            return (uint8_t)(int32_t)(f * 255.0f + 0.5f);
+        }
+
+        void resolve_scalar(float *acc, uint8_t *coverage, size_t count, bool nonzero)
+        {
+            // Blocks of 4 are summed in the order of the vector kernels
+            float carry = 0;
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                float a = acc[i], b = acc[i + 1], c = acc[i + 2], d = acc[i + 3];
+                float p[4] = {a, b + a, (c + b) + a, (d + c) + (b + a)};
+                for (int k = 0; k < 4; k++)
+                {
+                    acc[i + k] = 0;
+                    coverage[i + k] = fold(p[k] + carry, nonzero);
+                }
+                carry = p[3] + carry;
+            }
+            for (; i < count; i++)
+            {
+                carry += acc[i];
+                acc[i] = 0;
+                coverage[i] = fold(carry, nonzero);
+            }
+        }
+
+#ifdef SVG_X86_KERNELS
+        __attribute__((target("sse2"))) void resolve_sse2(float *acc, uint8_t *coverage, size_t count, bool nonzero)
+        {
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 sign = _mm_set1_ps(-0.0f);
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 two = _mm_set1_ps(2.0f);
+            const __m128 scale = _mm_set1_ps(255.0f);
+            const __m128 zero = _mm_setzero_ps();
+            __m128 carry = _mm_setzero_ps();
+            size_t i = 0;
+            // 4 pixels per iteration: prefix sum in two shifted adds, then
+            // the carry of the previous pixels
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 x = _mm_loadu_ps(acc + i);
+                _mm_storeu_ps(acc + i, zero);
+                x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+                x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+                x = _mm_add_ps(x, carry);
+                carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+                __m128 f = _mm_andnot_ps(sign, x);
+                if (nonzero)
+                {
+                    f = _mm_min_ps(f, one);
+                }
+                else
+                {
+                    __m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(f, half)));
+                    f = _mm_sub_ps(f, _mm_add_ps(whole, whole));
+                    f = _mm_min_ps(f, _mm_sub_ps(two, f));
+                }
+                __m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, scale), half));
+                v = _mm_packs_epi32(v, v);
+                v = _mm_packus_epi16(v, v);
+                int32_t bytes = _mm_cvtsi128_si32(v);
+                std::copy((const uint8_t *)&bytes, (const uint8_t *)&bytes + 4, coverage + i);
+            }
+            float sum = _mm_cvtss_f32(carry);
+            for (; i < count; i++)
+            {
+                sum += acc[i];
+                acc[i] = 0;
+                coverage[i] = fold(sum, nonzero);
+            }
+        }
+#endif
+
+        //! Kernel set, picked once from the CPU features.
+        struct Kernels
+        {
+            const char *name;
+            void (*resolve)(float *, uint8_t *, size_t, bool);
+        };
+
+        Kernels pick_kernels()
+        {
+#ifdef SVG_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("sse2"))
+            {
+                return Kernels{"sse2", resolve_sse2};
+            }
+#endif
+            return Kernels{"scalar", resolve_scalar};
+        }
+
+        const Kernels &kernels()
+        {
+            static const Kernels k = pick_kernels();
+            return k;
+        }
+    }
+
+    void resolve_coverage(float *acc, uint8_t *coverage, size_t count, FillRule rule)
+    {
+        kernels().resolve(acc, coverage, count, rule == FillRule::NONZERO);
+    }
+
+    const char *coverage_kernels_name()
+    {
+        return kernels().name;
+    }
+
+    const int CoverageMask::BAND_ROWS;
+
+    CoverageMask::CoverageMask() : rule_(FillRule::EVEN_ODD), stride_(0)
+    {
+        clear();
+    }
+
+    void CoverageMask::clear(FillRule rule)
+    {
+        rule_ = rule;
+        points_.clear();
+        ends_.clear();
+        edges_.clear();
+        min_x_ = min_y_ = std::numeric_limits<double>::infinity();
+        max_x_ = max_y_ = -std::numeric_limits<double>::infinity();
+    }
+
+    void CoverageMask::add_edge(double x0, double y0, double x1, double y1)
+    {
+        if (y0 == y1 || !std::isfinite(x0) || !std::isfinite(y0) || !std::isfinite(x1) || !std::isfinite(y1))
+        {
+            return;
+        }
+        if (y0 < y1)
+        {
+            edges_.push_back(Edge{x0, y0, x1, y1, 1.0f});
+        }
+        else
+        {
+            edges_.push_back(Edge{x1, y1, x0, y0, -1.0f});
+        }
+        min_x_ = std::min(min_x_, std::floor(std::min(x0, x1)));
+        max_x_ = std::max(max_x_, std::ceil(std::max(x0, x1)) - 1);
+        min_y_ = std::min(min_y_, std::floor(std::min(y0, y1)));
+        max_y_ = std::max(max_y_, std::ceil(std::max(y0, y1)) - 1);
+    }
+
+    void CoverageMask::add_ellipse(const Point &center, const Point &radius, int degrees)
+    {
+        double sin_a, cos_a;
+        degree_sin_cos(degrees, sin_a, cos_a);
+        // Pixel (center + r) is the last one the aliased fill paints
+        double cx = center.x + 0.5, cy = center.y + 0.5;
+        double rx = std::abs(radius.x) + 0.5, ry = std::abs(radius.y) + 0.5;
+        double r = std::max(rx, ry);
+        // The chord of an angle step a is r (1 - cos(a / 2)) away from the arc
+        int steps = std::max(8, (int)std::ceil(M_PI / std::acos(1 - ELLIPSE_TOLERANCE / r)));
+        steps = std::min(steps, 1 << 16);
+        double px = cx + cos_a * rx, py = cy + sin_a * rx;
+        for (int i = 1; i <= steps; i++)
+        {
+            double a = 2 * M_PI * i / steps;
+            double u = i == steps ? rx : rx * std::cos(a);
+            double v = i == steps ? 0 : ry * std::sin(a);
+            double x = cx + cos_a * u - sin_a * v;
+            double y = cy + sin_a * u + cos_a * v;
+            add_edge(px, py, x, y);
+            px = x;
+            py = y;
+        }
+    }
+
+    int CoverageMask::winding_others(double x, double y, size_t contour) const
+    {
+        int winding = 0;
+        size_t begin = 0;
+        for (size_t c = 0; c < ends_.size(); c++)
+        {
+            size_t end = ends_[c];
+            if (c != contour && end > begin)
+            {
+                for (size_t i = begin, j = end - 1; i < end; j = i++)
+                {
+                    const Point &a = points_[j], &b = points_[i];
+                    if ((a.y > y) != (b.y > y) &&
+                        x < a.x + (y - a.y) * (double)(b.x - a.x) / (b.y - a.y))
+                    {
+                        // Edges going down wind as contours of positive area do
+                        winding += b.y > a.y ? 1 : -1;
+                    }
+                }
+            }
+            begin = end;
+        }
+        return winding;
+    }
+
+    void CoverageMask::build_edges()
+    {
+        size_t begin = 0;
+        for (size_t c = 0; c < ends_.size(); c++)
+        {
+            size_t end = ends_[c];
+            // Vertices as x, y pairs, without repeated points
+            grown_.clear();
+            for (size_t i = begin; i < end; i++)
+            {
+                size_t k = grown_.size();
+                if (k == 0 || grown_[k - 2] != points_[i].x || grown_[k - 1] != points_[i].y)
+                {
+                    grown_.push_back(points_[i].x);
+                    grown_.push_back(points_[i].y);
+                }
+            }
+            size_t k = grown_.size();
+            if (k >= 4 && grown_[0] == grown_[k - 2] && grown_[1] == grown_[k - 1])
+            {
+                grown_.resize(k - 2);
+            }
+            size_t n = grown_.size() / 2;
+            if (n < 2)
+            {
+                begin = end;
+                continue;
+            }
+            double area = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                size_t j = (i + 1) % n;
+                area += grown_[2 * i] * grown_[2 * j + 1] - grown_[2 * j] * grown_[2 * i + 1];
+            }
+            // Half a pixel outwards, or inwards for holes: contours whose
+            // inside is outside the shape, and outside inside it
+            double side = area >= 0 ? 0.5 : -0.5;
+            if (ends_.size() > 1)
+            {
+                int others = winding_others(points_[begin].x, points_[begin].y, c);
+                bool hole = rule_ == FillRule::NONZERO ? others != 0 && others + (area >= 0 ? 1 : -1) == 0
+                                                       : (others & 1) != 0;
+                if (hole)
+                {
+                    side = -side;
+                }
+            }
+            // Each vertex moves to where its two edges, moved along their
+            // normals, meet; the miter of sharp spikes is cut short
+            double first_x = 0, first_y = 0, last_x = 0, last_y = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                size_t p = (i + n - 1) % n, q = (i + 1) % n;
+                double x = grown_[2 * i], y = grown_[2 * i + 1];
+                double d1x = x - grown_[2 * p], d1y = y - grown_[2 * p + 1];
+                double d2x = grown_[2 * q] - x, d2y = grown_[2 * q + 1] - y;
+                double l1 = std::hypot(d1x, d1y), l2 = std::hypot(d2x, d2y);
+                double n1x = d1y / l1, n1y = -d1x / l1;
+                double n2x = d2y / l2, n2y = -d2x / l2;
+                double k = std::max(1 + n1x * n2x + n1y * n2y, 0.125);
+                double gx = x + 0.5 + (n1x + n2x) * side / k;
+                double gy = y + 0.5 + (n1y + n2y) * side / k;
+                if (i == 0)
+                {
+                    first_x = gx;
+                    first_y = gy;
+                }
+                else
+                {
+                    add_edge(last_x, last_y, gx, gy);
+                }
+                last_x = gx;
+                last_y = gy;
+            }
+            add_edge(last_x, last_y, first_x, first_y);
+            begin = end;
+        }
+        points_.clear();
+        ends_.clear();
+    }
+
+    void CoverageMask::accumulate_band(int top, int rows, int left, int width)
+    {
+        stride_ = (size_t)width + 2;
+        if (acc_.size() < stride_ * rows)
+        {
+            // Resolving zeroes the buffer, so it is only cleared when it grows
+            acc_.assign(stride_ * rows, 0.0f);
+        }
+        for (const Edge &e : edges_)
+        {
+            accumulate(e, top, rows, left, width);
+        }
+    }
+
+    void CoverageMask::accumulate(const Edge &e, int top, int rows, int left, int width)
+    {
+        double y_lo = std::max(e.y0, (double)top);
+        double y_hi = std::min(e.y1, (double)(top + rows));
+        if (y_lo >= y_hi)
+        {
+            return;
+        }
+        double dxdy = (e.x1 - e.x0) / (e.y1 - e.y0);
+        double ax = e.x0 + (y_lo - e.y0) * dxdy - left, ay = y_lo - top;
+        double bx = e.x0 + (y_hi - e.y0) * dxdy - left, by = y_hi - top;
+        // Split where the edge crosses the sides of the band; the parts
+        // outside run along the side instead, which gives the same area
+        // to every pixel inside
+        double t[4] = {0, 1, 1, 1};
+        int n = 1;
+        const double sides[2] = {0, (double)width};
+        for (double side : sides)
+        {
+            if ((ax - side) * (bx - side) < 0)
+            {
+                t[n++] = (side - ax) / (bx - ax);
+            }
+        }
+        std::sort(t + 1, t + n);
+        t[n++] = 1;
+        for (int i = 0; i + 1 < n; i++)
+        {
+            double x0 = std::max(0.0, std::min(ax + (bx - ax) * t[i], (double)width));
+            double x1 = std::max(0.0, std::min(ax + (bx - ax) * t[i + 1], (double)width));
+            add_line(x0, ay + (by - ay) * t[i], x1, ay + (by - ay) * t[i + 1], e.dir);
+        }
+    }
+
+    void CoverageMask::add_line(double x0, double y0, double x1, double y1, float dir)
+    {
+        if (y1 <= y0)
+        {
+            return;
+        }
+        double dxdy = (x1 - x0) / (y1 - y0);
+        double x = x0;
+        int y_end = (int)std::ceil(y1);
+        for (int y = (int)y0; y < y_end; y++)
+        {
+            float *row = acc_.data() + (size_t)y * stride_;
+            double dy = std::min((double)(y + 1), y1) - std::max((double)y, y0);
+            double x_next = std::max(0.0, std::min(x + dxdy * dy, x1 > x0 ? x1 : x0));
+            double d = dy * dir;
+            double xa = std::min(x, x_next), xb = std::max(x, x_next);
+            double xa_floor = std::floor(xa);
+            int ia = (int)xa_floor;
+            int ib = (int)std::ceil(xb);
+            if (ib <= ia + 1)
+            {
+                // Within one pixel: split by the mean x
+                double xm = 0.5 * (x + x_next) - xa_floor;
+                row[ia] += (float)(d - d * xm);
+                row[ia + 1] += (float)(d * xm);
+            }
+            else
+            {
+                // Across several pixels: the triangle at each end, and an
+                // equal share in between
+                double s = 1 / (xb - xa);
+                double fa = xa - xa_floor;
+                double a0 = 0.5 * s * (1 - fa) * (1 - fa);
+                double fb = xb - ib + 1;
+                double am = 0.5 * s * fb * fb;
+                row[ia] += (float)(d * a0);
+                if (ib == ia + 2)
+                {
+                    row[ia + 1] += (float)(d * (1 - a0 - am));
+                }
+                else
+                {
+                    double a1 = s * (1.5 - fa);
+                    row[ia + 1] += (float)(d * (a1 - a0));
+                    for (int xi = ia + 2; xi < ib - 1; xi++)
+                    {
+                        row[xi] += (float)(d * s);
+                    }
+                    double a2 = a1 + (ib - ia - 3) * s;
+                    row[ib - 1] += (float)(d * (1 - a2 - am));
+                }
+                row[ib] += (float)(d * am);
+            }
+            x = x_next;
+        }
+    }
+
+    const uint8_t *CoverageMask::resolve_row(int row, int width)
+    {
+        coverage_.resize(width);
+        float *acc = acc_.data() + (size_t)row * stride_;
+        resolve_coverage(acc, coverage_.data(), width, rule_);
+        // Areas pushed past the last column are dropped
+        acc[width] = acc[width + 1] = 0;
+        return coverage_.data();
+    }
+}
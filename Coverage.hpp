@@ -0,0 +1,166 @@
+//! @file Coverage.hpp
+#ifndef __svg_Coverage_hpp__
+#define __svg_Coverage_hpp__
+
+#include "FillRule.hpp"
+#include "Point.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace svg
+{
+    //! Turn one row of a signed-area accumulation buffer into coverage.
+    //! The running sum of the row is the signed area of each pixel inside
+    //! the shape; it is folded by the fill rule, like the aliased fills
+    //! (even-odd, or nonzero by capping its magnitude at 1), and scaled
+    //! to 0..255. Every kernel sums in the same order, so all produce the
+    //! same coverage.
+    //! @param acc Accumulated areas; zeroed on return.
+    //! @param coverage Receives the coverage of each pixel.
+    //! @param count Number of pixels.
+    //! @param rule Fill rule.
+    void resolve_coverage(float *acc, uint8_t *coverage, size_t count, FillRule rule);
+    //! Get the name of the kernel set chosen for this CPU.
+    //! @return "sse2" or "scalar".
+    const char *coverage_kernels_name();
+
+    //! Anti-aliased shape, filled by exact area coverage.
+    //! Edges are accumulated as signed areas into a band of rows, and a
+    //! prefix sum along each row then gives the fraction of every pixel
+    //! inside the shape: an edge costs the pixels it crosses, whatever the
+    //! size of the shape.
+    //! As in the aliased fills, points are pixel centers, and shapes are
+    //! grown by half a pixel to include their outline: a shape covers
+    //! about the pixels its aliased fill paints (a rectangle exactly those).
+    class CoverageMask
+    {
+    public:
+        //! Rows accumulated and resolved together.
+        static const int BAND_ROWS = 32;
+
+        CoverageMask();
+        //! Forget the previous shape.
+        //! @param rule Fill rule of the next one.
+        void clear(FillRule rule = FillRule::EVEN_ODD);
+        //! Add a closed contour. Contours are inside the shape by the fill
+        //! rule; those bounding a hole in another one shrink by half a pixel
+        //! instead.
+        //! @param first Iterator to the first point.
+        //! @param count Number of points.
+        template <class Iterator>
+        void add_contour(Iterator first, size_t count)
+        {
+            for (size_t i = 0; i < count; i++, ++first)
+            {
+                points_.push_back(*first);
+            }
+            ends_.push_back(points_.size());
+        }
+        //! Add an ellipse, as a polygon within 1/20 pixel of it.
+        //! @param center Center.
+        //! @param radius Radius in X and Y axis, before rotation.
+        //! @param degrees Rotation about the center, as in Point::rotate.
+        void add_ellipse(const Point &center, const Point &radius, int degrees);
+        //! Paint the shape inside a rectangle.
+        //! A Plot here has a member 'void span(int y, int x0, int x1, uint8_t coverage)'
+        //! painting pixels x0..x1 of row y at coverage / 255 opacity. Spans are
+        //! runs of equal coverage, so the inside of the shape comes as solid
+        //! spans of coverage 255; pixels outside the shape are not sent.
+        //! @param clip_min Top-left corner of the rectangle.
+        //! @param clip_max Bottom-right corner (inclusive).
+        //! @param plot Span receiver.
+        template <class Plot>
+        void render(const Point &clip_min, const Point &clip_max, Plot &plot)
+        {
+            build_edges();
+            if (edges_.empty())
+            {
+                return;
+            }
+            int x0 = std::max(clip_min.x, (int)std::max(min_x_, -1e9));
+            int x1 = std::min(clip_max.x, (int)std::min(max_x_, 1e9));
+            int y0 = std::max(clip_min.y, (int)std::max(min_y_, -1e9));
+            int y1 = std::min(clip_max.y, (int)std::min(max_y_, 1e9));
+            if (x0 > x1 || y0 > y1)
+            {
+                return;
+            }
+            int width = x1 - x0 + 1;
+            for (int top = y0; top <= y1; top += BAND_ROWS)
+            {
+                int rows = std::min(BAND_ROWS, y1 - top + 1);
+                accumulate_band(top, rows, x0, width);
+                for (int r = 0; r < rows; r++)
+                {
+                    const uint8_t *cov = resolve_row(r, width);
+                    for (int i = 0; i < width;)
+                    {
+                        uint8_t c = cov[i];
+                        int j = i + 1;
+                        while (j < width && cov[j] == c)
+                        {
+                            j++;
+                        }
+                        if (c != 0)
+                        {
+                            plot.span(top + r, x0 + i, x0 + j - 1, c);
+                        }
+                        i = j;
+                    }
+                }
+            }
+        }
+
+    private:
+        //! Non-horizontal edge, from top to bottom.
+        struct Edge
+        {
+            double x0;
+            double y0;
+            double x1;
+            double y1;
+            //! +1 if the edge went down, -1 if it went up.
+            float dir;
+        };
+
+        //! Add an edge of a closed contour, in continuous coordinates.
+        void add_edge(double x0, double y0, double x1, double y1);
+        //! Turn the contours added since the last call into grown edges.
+        void build_edges();
+        //! Get the winding number of the contours other than one around a point.
+        int winding_others(double x, double y, size_t contour) const;
+        //! Accumulate every edge into the rows [top, top + rows) and the
+        //! columns [left, left + width).
+        void accumulate_band(int top, int rows, int left, int width);
+        //! Accumulate the part of an edge inside the band.
+        void accumulate(const Edge &e, int top, int rows, int left, int width);
+        //! Accumulate a line, in band coordinates, with 0 <= x <= width.
+        void add_line(double x0, double y0, double x1, double y1, float dir);
+        //! Resolve a row of the band.
+        //! @return Coverage of the row.
+        const uint8_t *resolve_row(int row, int width);
+
+        //! Points of the contours, one after the other.
+        std::vector<Point> points_;
+        //! End of each contour in points_.
+        std::vector<size_t> ends_;
+        //! Vertices of the contour being grown.
+        std::vector<double> grown_;
+        //! Edges of the shape.
+        std::vector<Edge> edges_;
+        //! Fill rule of the shape.
+        FillRule rule_;
+        //! Bounds of the edges, in whole pixels (inclusive).
+        double min_x_, min_y_, max_x_, max_y_;
+        //! Accumulation buffer of a band, width + 2 floats per row.
+        std::vector<float> acc_;
+        //! Floats per row of acc_.
+        size_t stride_;
+        //! Coverage of a row.
+        std::vector<uint8_t> coverage_;
+    };
+}
+#endif
@@ -0,0 +1,553 @@
+//! @file Daemon.cpp
+#include "Daemon.hpp"
+#include "Cancel.hpp"
+#include "RenderCost.hpp"
+#include "SVGElements.hpp"
+#include "external/tinyxml2/tinyxml2.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+// POSIX headers
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace svg
+{
+    namespace
+    {
+        //! State kept by a worker between jobs.
+        struct WorkerState
+        {
+            //! XML document, its node pools are recycled by every parse.
+            tinyxml2::XMLDocument doc;
+        };
+
+        //! Largest inline document, in bytes.
+        const long MAX_INLINE_SIZE = 64L << 20;
+        //! Longest job line buffered for a socket client, in bytes.
+        const size_t MAX_LINE_SIZE = 64 << 10;
+
+        //! Get the inline payload size of a job line.
+        //! @param size Receives the size; -1 if it is malformed or negative,
+        //!             LONG_MAX if it overflows.
+        //! @return False if the input is a file.
+        bool inline_size(const std::string &line, long &size)
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line[start] != '@')
+            {
+                return false;
+            }
+            const char *digits = line.c_str() + start + 1;
+            char *end;
+            size = std::isdigit((unsigned char)*digits) ? std::strtol(digits, &end, 10) : -1;
+            if (size >= 0 && *end != '\0' && !std::isspace((unsigned char)*end))
+            {
+                size = -1;
+            }
+            return true;
+        }
+
+        //! Memory reserved by a job, returned when it ends.
+        struct Reservation
+        {
+            MemoryBudget &budget;
+            size_t bytes;
+            ~Reservation()
+            {
+                budget.release(bytes);
+            }
+        };
+
+        //! Estimate the cost of a job input.
+        void estimate_job(const std::string &svg_file, const std::string &data, RenderCost &cost)
+        {
+            if (svg_file[0] == '@')
+            {
+                estimate_cost(data.data(), data.size(), cost);
+            }
+            else
+            {
+                estimate_cost(svg_file, cost);
+            }
+        }
+
+        //! Run one job, returning the reply without the sequence number.
+        //! @param time_budget Time budget of the job in milliseconds, 0 for none.
+        //! @param cost Estimate of the job, made here if estimated is false.
+        std::string run_job(WorkerState &state, MemoryBudget &budget, double time_budget, const std::string &line,
+                            const std::string &data, bool estimated, RenderCost &cost)
+        {
+            std::istringstream iss(line);
+            std::string svg_file, png_file, extra;
+            if (!(iss >> svg_file >> png_file) || (iss >> extra))
+            {
+                return "error expected: in_file.svg out_file.png\n";
+            }
+            long size;
+            if (inline_size(line, size) && (size < 0 || size > MAX_INLINE_SIZE))
+            {
+                std::ostringstream reply;
+                reply << "error " << svg_file << ": inline document size must be 0 to " << MAX_INLINE_SIZE
+                      << " bytes!\n";
+                return reply.str();
+            }
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            Point dimensions;
+            std::vector<SVGElement *> svg_elements;
+            std::vector<unsigned char> png_data;
+            Reservation reservation = {budget, 0};
+            // Counts from the start, waiting for memory included
+            CancelToken token(time_budget);
+            CancelScope scope(&token);
+            const char *stage = "parsing";
+            double parse_ms = 0;
+            try
+            {
+                if (budget.limit() != 0)
+                {
+                    if (!estimated)
+                    {
+                        estimate_job(svg_file, data, cost);
+                    }
+                    stage = "waiting for memory";
+                    try
+                    {
+                        budget.acquire(cost.memory, &token);
+                    }
+                    catch (const Cancelled &)
+                    {
+                        throw;
+                    }
+                    catch (const std::runtime_error &ex)
+                    {
+                        throw std::runtime_error(svg_file + ": " + ex.what());
+                    }
+                    reservation.bytes = cost.memory;
+                    stage = "parsing";
+                }
+                if (svg_file[0] == '@')
+                {
+                    parseSVG(state.doc, data.data(), data.size(), dimensions, svg_elements);
+                }
+                else
+                {
+                    readSVG(state.doc, svg_file, dimensions, svg_elements);
+                }
+                if (budget.limit() != 0)
+                {
+                    // The elements as built may hold more than estimated
+                    size_t element_memory = svg_elements.capacity() * sizeof(SVGElement *);
+                    for (SVGElement *e : svg_elements)
+                    {
+                        element_memory += e->get_memory();
+                    }
+                    if (element_memory > cost.element_memory)
+                    {
+                        size_t growth = element_memory - cost.element_memory;
+                        if (!budget.try_acquire(growth))
+                        {
+                            throw std::runtime_error(svg_file + ": elements outgrew the memory budget!");
+                        }
+                        reservation.bytes += growth;
+                    }
+                }
+                parse_ms = token.elapsed();
+                stage = "drawing";
+                // Pixels come from the global framebuffer pool
+                PNGImage img(dimensions.x, dimensions.y);
+                render_elements(svg_elements, img, RenderOptions());
+                stage = "encoding";
+                if (png_file == "-")
+                {
+                    img.encode(png_data);
+                }
+                else
+                {
+                    img.save(png_file);
+                }
+            }
+            catch (const Cancelled &ex)
+            {
+                for (SVGElement *e : svg_elements)
+                {
+                    delete e;
+                }
+                std::ostringstream reply;
+                reply << "error " << svg_file << ": " << ex.what() << " Stopped while " << stage;
+                if (parse_ms > 0)
+                {
+                    reply << ", parsed at " << parse_ms << " ms";
+                }
+                reply << "\n";
+                return reply.str();
+            }
+            catch (const std::exception &ex)
+            {
+                for (SVGElement *e : svg_elements)
+                {
+                    delete e;
+                }
+                return std::string("error ") + ex.what() + "\n";
+            }
+            for (SVGElement *e : svg_elements)
+            {
+                delete e;
+            }
+            std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+            std::ostringstream reply;
+            reply << "ok " << ms.count();
+            if (png_file == "-")
+            {
+                reply << ' ' << png_data.size() << '\n';
+                reply.write((const char *)png_data.data(), png_data.size());
+            }
+            else
+            {
+                reply << '\n';
+            }
+            return reply.str();
+        }
+
+        //! Client connection of the socket server.
+        //! Closed once the reader and all replies are done with it.
+        class Connection
+        {
+        public:
+            Connection(int fd) : fd_(fd) {}
+            ~Connection() { ::close(fd_); }
+            int fd() const { return fd_; }
+            //! Send a reply.
+            void send(const std::string &msg)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                size_t sent = 0;
+                while (sent < msg.size())
+                {
+                    ssize_t n = ::send(fd_, msg.data() + sent, msg.size() - sent, MSG_NOSIGNAL);
+                    if (n <= 0)
+                    {
+                        return;
+                    }
+                    sent += n;
+                }
+            }
+
+        private:
+            int fd_;
+            std::mutex mutex_;
+        };
+    }
+
+    Daemon::Daemon(unsigned workers, size_t memory_budget, double time_budget)
+        : memory_(memory_budget), time_budget_(time_budget), heavy_workers_(0), pending_(0), stopping_(false)
+    {
+        if (workers == 0)
+        {
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < workers; i++)
+        {
+            workers_.push_back(std::thread(&Daemon::work, this, i));
+        }
+    }
+
+    Daemon::~Daemon()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        job_ready_.notify_all();
+        for (std::thread &t : workers_)
+        {
+            t.join();
+        }
+    }
+
+    void Daemon::submit(unsigned long seq, const std::string &line,
+                        const std::string &data, const Reply &reply)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(Job{seq, line, data, reply, false, RenderCost()});
+            pending_++;
+        }
+        job_ready_.notify_one();
+    }
+
+    void Daemon::work(unsigned index)
+    {
+        WorkerState state;
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while (queue_.empty() && heavy_.empty() && !stopping_)
+                {
+                    job_ready_.wait(lock);
+                }
+                if (queue_.empty() && heavy_.empty())
+                {
+                    return;
+                }
+                // Own lane first, then the other one
+                bool heavy = index < heavy_workers_ ? !heavy_.empty() : queue_.empty();
+                std::deque<Job> &lane = heavy ? heavy_ : queue_;
+                job = lane.front();
+                lane.pop_front();
+            }
+            std::ostringstream reply;
+            reply << job.seq << ' ' << run_job(state, memory_, time_budget_, job.line, job.data, job.estimated, job.cost);
+            job.reply(reply.str());
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_--;
+            }
+            job_done_.notify_all();
+        }
+    }
+
+    MemoryBudget::Stats Daemon::memory_stats() const
+    {
+        return memory_.stats();
+    }
+
+    void Daemon::drain()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (pending_ > 0)
+        {
+            job_done_.wait(lock);
+        }
+    }
+
+    void Daemon::read_jobs(std::istream &in, const std::function<void(const std::string &, const std::string &)> &job)
+    {
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+            std::string data;
+            long n = 0;
+            if (inline_size(line, n) && n > MAX_INLINE_SIZE)
+            {
+                // Rejected when run, its payload is skipped
+                in.ignore(n);
+            }
+            else if (n > 0)
+            {
+                data.resize(n);
+                in.read(&data[0], n);
+                data.resize(in.gcount());
+            }
+            job(line, data);
+        }
+    }
+
+    void Daemon::serve(std::istream &in, std::ostream &out)
+    {
+        std::mutex out_mutex;
+        Reply reply = [&out, &out_mutex](const std::string &msg) {
+            std::lock_guard<std::mutex> lock(out_mutex);
+            out.write(msg.data(), msg.size());
+            out.flush();
+        };
+        unsigned long seq = 0;
+        read_jobs(in, [&](const std::string &line, const std::string &data)
+                  {
+                      submit(++seq, line, data, reply);
+                  });
+        drain();
+    }
+
+    void Daemon::serve_batch(std::istream &in, std::ostream &out)
+    {
+        std::mutex out_mutex;
+        Reply reply = [&out, &out_mutex](const std::string &msg) {
+            std::lock_guard<std::mutex> lock(out_mutex);
+            out.write(msg.data(), msg.size());
+            out.flush();
+        };
+        std::vector<Job> jobs;
+        std::vector<double> costs;
+        read_jobs(in, [&](const std::string &line, const std::string &data)
+                  {
+                      jobs.push_back(Job{(unsigned long)jobs.size() + 1, line, data, reply, false, RenderCost()});
+                      Job &job = jobs.back();
+                      std::istringstream iss(line);
+                      std::string svg_file;
+                      iss >> svg_file;
+                      try
+                      {
+                          estimate_job(svg_file, job.data, job.cost);
+                          job.estimated = true;
+                          costs.push_back(job.cost.cost);
+                      }
+                      catch (const std::exception &)
+                      {
+                          // Fails fast when run, and reports why
+                          costs.push_back(0);
+                      }
+                  });
+        std::vector<size_t> order(jobs.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+        double total = 0;
+        for (double c : costs)
+        {
+            total += c;
+        }
+        // Jobs longer than an even share of a worker are heavy
+        unsigned workers = (unsigned)workers_.size();
+        double share = total / workers, heavy_cost = 0;
+        size_t heavy_jobs = 0;
+        while (heavy_jobs < order.size() && costs[order[heavy_jobs]] > share)
+        {
+            heavy_cost += costs[order[heavy_jobs++]];
+        }
+        // Otherwise one lane, largest first
+        unsigned lane = 0;
+        if (workers > 1 && heavy_jobs > 0 && heavy_jobs < order.size())
+        {
+            lane = (unsigned)std::lround(workers * heavy_cost / total);
+            lane = std::min(std::max(lane, 1u), workers - 1);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            heavy_workers_ = lane;
+            for (size_t k = 0; k < order.size(); k++)
+            {
+                (k < heavy_jobs && lane > 0 ? heavy_ : queue_).push_back(std::move(jobs[order[k]]));
+                pending_++;
+            }
+        }
+        job_ready_.notify_all();
+        drain();
+        std::lock_guard<std::mutex> lock(mutex_);
+        heavy_workers_ = 0;
+    }
+
+    void Daemon::serve(const std::string &socket_path)
+    {
+        sockaddr_un addr;
+        ::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(addr.sun_path))
+        {
+            throw std::runtime_error(socket_path + ": socket path too long!");
+        }
+        ::strcpy(addr.sun_path, socket_path.c_str());
+        int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        ::unlink(socket_path.c_str());
+        if (server < 0 ||
+            ::bind(server, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+            ::listen(server, 64) != 0)
+        {
+            throw std::runtime_error(socket_path + ": " + ::strerror(errno));
+        }
+        for (;;)
+        {
+            int fd = ::accept(server, nullptr, nullptr);
+            if (fd < 0)
+            {
+                continue;
+            }
+            std::shared_ptr<Connection> conn(new Connection(fd));
+            // One reader per client; jobs of all clients share the worker pool.
+            std::thread([this, conn]() {
+                Reply reply = [conn](const std::string &msg) { conn->send(msg); };
+                unsigned long seq = 0;
+                std::string input;
+                // Bytes of a rejected inline document still to drop
+                size_t skip = 0;
+                // Set while dropping the rest of an overlong job line
+                bool overlong = false;
+                char buf[4096];
+                ssize_t n;
+                while ((n = ::recv(conn->fd(), buf, sizeof(buf), 0)) > 0)
+                {
+                    input.append(buf, n);
+                    for (;;)
+                    {
+                        if (overlong)
+                        {
+                            size_t eol = input.find('\n');
+                            input.erase(0, eol == std::string::npos ? input.size() : eol + 1);
+                            if (eol == std::string::npos)
+                            {
+                                break;
+                            }
+                            overlong = false;
+                        }
+                        if (skip > 0)
+                        {
+                            size_t dropped = std::min(skip, input.size());
+                            input.erase(0, dropped);
+                            skip -= dropped;
+                            if (skip > 0)
+                            {
+                                break;
+                            }
+                        }
+                        size_t eol = input.find('\n');
+                        if (eol == std::string::npos)
+                        {
+                            if (input.size() > MAX_LINE_SIZE)
+                            {
+                                std::ostringstream error;
+                                error << ++seq << " error job line over " << MAX_LINE_SIZE << " bytes!\n";
+                                conn->send(error.str());
+                                input.clear();
+                                overlong = true;
+                            }
+                            break;
+                        }
+                        std::string job = input.substr(0, eol);
+                        long size;
+                        if (!inline_size(job, size) || size < 0)
+                        {
+                            size = 0;
+                        }
+                        else if (size > MAX_INLINE_SIZE)
+                        {
+                            // Rejected when run, its payload is skipped
+                            skip = size;
+                            size = 0;
+                        }
+                        else if (input.size() - eol - 1 < (size_t)size)
+                        {
+                            // Inline document not fully received yet
+                            break;
+                        }
+                        std::string data = input.substr(eol + 1, size);
+                        input.erase(0, eol + 1 + size);
+                        if (job.find_first_not_of(" \t\r") != std::string::npos)
+                        {
+                            submit(++seq, job, data, reply);
+                        }
+                    }
+                }
+            }).detach();
+        }
+    }
+}
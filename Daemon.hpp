@@ -0,0 +1,129 @@
+//! @file Daemon.hpp
+#ifndef __svg_Daemon_hpp__
+#define __svg_Daemon_hpp__
+
+#include "MemoryBudget.hpp"
+#include "RenderCost.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace svg
+{
+    //! Long-running conversion service.
+    //! Jobs are text lines of the form "in_file.svg out_file.png".
+    //! An input of "@<n>" means that the n bytes following the line
+    //! are the SVG document, and an output of "-" means that the PNG is
+    //! returned in the reply. Documents over 64 MB are skipped and answered
+    //! with an error, and so are socket job lines over 64 KB, which are
+    //! dropped up to their end.
+    //! Each job is answered with one line, "<seq> ok <ms>" on success
+    //! or "<seq> error <message>" on failure, where seq is the 1-based
+    //! job number on its stream and ms is the job latency in milliseconds.
+    //! When the PNG is returned the line is "<seq> ok <ms> <n>", followed
+    //! by the n PNG bytes. Replies may arrive out of order.
+    //! With a memory budget, each job reserves its estimated peak memory
+    //! (see RenderCost) before it is parsed and waits while the running jobs
+    //! hold too much; the reservation grows if the elements turn out larger
+    //! than estimated. A job that cannot fit is answered with an error.
+    //! With a time budget, a job still running when it runs out is stopped
+    //! (see CancelToken) and answered with an error telling where it was.
+    class Daemon
+    {
+    public:
+        //! Callback receiving the complete reply of a job.
+        typedef std::function<void(const std::string &)> Reply;
+
+        //! Constructor, starts the worker pool.
+        //! @param workers Number of worker threads (0 = one per core).
+        //! @param memory_budget Bytes the running jobs may use together (0 = no limit).
+        //! @param time_budget Milliseconds each job may take (0 = no limit).
+        Daemon(unsigned workers, size_t memory_budget = 0, double time_budget = 0);
+        //! Destructor, finishes queued jobs and stops the workers.
+        ~Daemon();
+        //! Queue a job.
+        //! @param seq Job number, echoed in the reply.
+        //! @param line Job line.
+        //! @param data Inline SVG document, for "@<n>" inputs.
+        //! @param reply Reply callback, called from a worker thread.
+        void submit(unsigned long seq, const std::string &line,
+                    const std::string &data, const Reply &reply);
+        //! Serve jobs read from a stream, one per line, until end of input.
+        //! Returns once every job has been answered.
+        //! @param in Job stream.
+        //! @param out Reply stream.
+        void serve(std::istream &in, std::ostream &out);
+        //! Run a batch of jobs read from a stream, one per line, until end of
+        //! input, then return once every job has been answered.
+        //! Jobs are all read first, their cost estimated (see RenderCost),
+        //! and run largest first, so that no long job starts last. Jobs
+        //! costing more than an even share of the batch per worker get a
+        //! lane of their own, with workers in proportion to their share of
+        //! the cost, so cheap jobs keep the other cores instead of queueing
+        //! behind them. Workers of a lane that runs dry help the other one.
+        //! @param in Job stream.
+        //! @param out Reply stream.
+        void serve_batch(std::istream &in, std::ostream &out);
+        //! Get the usage counters of the memory budget.
+        //! @return Counters.
+        MemoryBudget::Stats memory_stats() const;
+        //! Serve jobs from clients of a Unix domain socket. Does not return.
+        //! @param socket_path Socket path; an existing file is replaced.
+        void serve(const std::string &socket_path);
+
+    private:
+        Daemon(const Daemon &);
+        Daemon &operator=(const Daemon &);
+
+        //! Queued job.
+        struct Job
+        {
+            unsigned long seq;
+            std::string line;
+            std::string data;
+            Reply reply;
+            //! Estimate of the job, if already made.
+            bool estimated;
+            RenderCost cost;
+        };
+        //! Worker thread body.
+        //! @param index Worker number.
+        void work(unsigned index);
+        //! Read jobs from a stream until end of input.
+        //! @param in Job stream.
+        //! @param job Called with each job line and its inline document.
+        void read_jobs(std::istream &in, const std::function<void(const std::string &, const std::string &)> &job);
+        //! Wait until no job is queued or running.
+        void drain();
+
+        //! Memory shared by the running jobs.
+        MemoryBudget memory_;
+        //! Time budget of a job, in milliseconds.
+        double time_budget_;
+        //! Worker threads.
+        std::vector<std::thread> workers_;
+        //! Pending jobs.
+        std::deque<Job> queue_;
+        //! Pending expensive jobs of a batch, largest first.
+        std::deque<Job> heavy_;
+        //! Workers taking from heavy_ first, during a batch.
+        unsigned heavy_workers_;
+        //! Jobs queued or running.
+        unsigned long pending_;
+        //! Set when workers must exit.
+        bool stopping_;
+        //! Protects the queue and counters.
+        std::mutex mutex_;
+        //! Signaled when a job is queued or when stopping.
+        std::condition_variable job_ready_;
+        //! Signaled when a job completes.
+        std::condition_variable job_done_;
+    };
+}
+#endif
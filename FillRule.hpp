@@ -0,0 +1,16 @@
+//! @file FillRule.hpp
+#ifndef __svg_FillRule_hpp__
+#define __svg_FillRule_hpp__
+
+namespace svg
+{
+    //! Points inside a shape of several contours (fill-rule).
+    enum class FillRule
+    {
+        //! Where the contours wind around a nonzero number of times (the SVG default).
+        NONZERO,
+        //! Where the contours overlap an odd number of times.
+        EVEN_ODD
+    };
+}
+#endif
@@ -0,0 +1,338 @@
+//! @file FormatImage.cpp
+#include "FormatImage.hpp"
+#include "ImageFormat.hpp"
+#include "Raster.hpp"
+
+#include "external/stb/stb_image_write.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+
+namespace svg
+{
+    bool parse_pixel_format(const std::string &name, PixelFormat &format)
+    {
+        static const struct
+        {
+            const char *name;
+            PixelFormat format;
+        } NAMES[] = {{"rgb", PixelFormat::RGB}, {"rgba", PixelFormat::RGBA},
+                     {"gray", PixelFormat::GRAY}, {"mask", PixelFormat::MASK}};
+        for (const auto &entry : NAMES)
+        {
+            if (name == entry.name)
+            {
+                format = entry.format;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    namespace
+    {
+        //! Paints the spans of one shape in a solid pixel, blending the
+        //! union of translucent ones in finish (as PNGImage does).
+        template <class Format>
+        class FormatPlot
+        {
+        public:
+            typedef typename Format::Pixel Pixel;
+
+            FormatPlot(FormatImage<Format> &img, const Color &color, rgb_value alpha)
+                : img(img), pixel(Format::convert(color)), alpha(alpha) {}
+            void span(int y, int x0, int x1)
+            {
+                if (alpha == OPAQUE_ALPHA)
+                {
+                    img.fill_span(y, x0, x1, pixel);
+                }
+                else
+                {
+                    spans.span(y, x0, x1);
+                }
+            }
+            void finish()
+            {
+                struct BlendPlot
+                {
+                    FormatImage<Format> &img;
+                    const Pixel &pixel;
+                    rgb_value alpha;
+                    void span(int y, int x0, int x1)
+                    {
+                        img.blend_span(y, x0, x1, pixel, alpha);
+                    }
+                };
+                BlendPlot blend_plot = {img, pixel, alpha};
+                spans.flush(blend_plot);
+            }
+
+        private:
+            FormatImage<Format> &img;
+            Pixel pixel;
+            rgb_value alpha;
+            SpanList spans;
+        };
+
+        void append_bytes(void *context, void *data, int size)
+        {
+            std::vector<unsigned char> *out = (std::vector<unsigned char> *)context;
+            out->insert(out->end(), (unsigned char *)data, (unsigned char *)data + size);
+        }
+    }
+
+    template <class Format>
+    FormatImage<Format>::FormatImage(int w, int h)
+        : width_(w), height_(h), stride_(Format::units(w)), pixels_(stride_ * h), alpha_(OPAQUE_ALPHA)
+    {
+        assert(w > 0 && h > 0);
+        clear();
+    }
+
+    template <class Format>
+    int FormatImage<Format>::width() const
+    {
+        return width_;
+    }
+
+    template <class Format>
+    int FormatImage<Format>::height() const
+    {
+        return height_;
+    }
+
+    template <class Format>
+    typename FormatImage<Format>::Unit *FormatImage<Format>::row(int y)
+    {
+        return pixels_.data() + (size_t)y * stride_;
+    }
+
+    template <class Format>
+    const typename FormatImage<Format>::Unit *FormatImage<Format>::row(int y) const
+    {
+        return pixels_.data() + (size_t)y * stride_;
+    }
+
+    template <class Format>
+    typename FormatImage<Format>::Pixel FormatImage<Format>::at(int x, int y) const
+    {
+        assert(x >= 0 && x < width_ && y >= 0 && y < height_);
+        return Format::get(row(y), x);
+    }
+
+    template <class Format>
+    Color FormatImage<Format>::color(int x, int y) const
+    {
+        assert(x >= 0 && x < width_ && y >= 0 && y < height_);
+        return Format::color(row(y), x);
+    }
+
+    template <class Format>
+    size_t FormatImage<Format>::memory() const
+    {
+        return pixels_.size() * sizeof(Unit);
+    }
+
+    template <class Format>
+    void FormatImage<Format>::clear()
+    {
+        for (int y = 0; y < height_; y++)
+        {
+            Format::fill(row(y), 0, width_ - 1, Format::background());
+        }
+    }
+
+    template <class Format>
+    void FormatImage<Format>::encode(std::vector<unsigned char> &png_data) const
+    {
+        size_t stride = (size_t)width_ * Format::CHANNELS;
+        std::vector<unsigned char> bytes(stride * height_);
+        for (int y = 0; y < height_; y++)
+        {
+            Format::encode(row(y), width_, &bytes[y * stride]);
+        }
+        png_data.clear();
+        if (!::stbi_write_png_to_func(append_bytes, &png_data, width_, height_, Format::CHANNELS,
+                                      bytes.data(), (int)stride))
+        {
+            throw std::runtime_error("PNG encoding failed!");
+        }
+    }
+
+    template <class Format>
+    void FormatImage<Format>::save(const std::string &file_name, ImageFormat format) const
+    {
+        if (resolve_format(format, file_name) != ImageFormat::PNG)
+        {
+            std::vector<Color> pixels((size_t)width_ * height_);
+            for (int y = 0; y < height_; y++)
+            {
+                for (int x = 0; x < width_; x++)
+                {
+                    pixels[(size_t)y * width_ + x] = Format::color(row(y), x);
+                }
+            }
+            write_image(file_name, format, pixels.data(), width_, height_);
+            return;
+        }
+        std::vector<unsigned char> png_data;
+        encode(png_data);
+        FILE *f = ::fopen(file_name.c_str(), "wb");
+        if (f == nullptr)
+        {
+            throw std::runtime_error(file_name + ": could not open for writing!");
+        }
+        bool ok = ::fwrite(png_data.data(), 1, png_data.size(), f) == png_data.size();
+        ok = (::fclose(f) == 0) && ok;
+        if (!ok)
+        {
+            throw std::runtime_error(file_name + ": write failed!");
+        }
+    }
+
+    template <class Format>
+    void FormatImage<Format>::fill_span(int y, int x0, int x1, const Pixel &p)
+    {
+        if (y < 0 || y >= height_)
+        {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, width_ - 1);
+        if (x0 <= x1)
+        {
+            Format::fill(row(y), x0, x1, p);
+        }
+    }
+
+    template <class Format>
+    void FormatImage<Format>::blend_span(int y, int x0, int x1, const Pixel &p, rgb_value alpha)
+    {
+        if (y < 0 || y >= height_)
+        {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, width_ - 1);
+        if (x0 <= x1)
+        {
+            Format::blend(row(y), x0, x1, p, alpha);
+        }
+    }
+
+    template <class Format>
+    void FormatImage<Format>::set_alpha(rgb_value alpha)
+    {
+        alpha_ = alpha;
+    }
+
+    template <class Format>
+    void FormatImage<Format>::begin_layer(const Point &top_left, const Point &bottom_right)
+    {
+        Layer layer = {Point{std::max(top_left.x, 0), std::max(top_left.y, 0)},
+                       Point{std::min(bottom_right.x, width_ - 1), std::min(bottom_right.y, height_ - 1)},
+                       std::vector<Unit>()};
+        if (layer.top_left.x <= layer.bottom_right.x && layer.top_left.y <= layer.bottom_right.y)
+        {
+            layer.below.assign(row(layer.top_left.y), row(layer.bottom_right.y) + stride_);
+        }
+        layers_.push_back(std::move(layer));
+    }
+
+    template <class Format>
+    void FormatImage<Format>::end_layer(rgb_value alpha)
+    {
+        assert(!layers_.empty());
+        const Layer &layer = layers_.back();
+        for (size_t i = 0; i * stride_ < layer.below.size(); i++)
+        {
+            Format::composite(row(layer.top_left.y + (int)i), &layer.below[i * stride_],
+                              layer.top_left.x, layer.bottom_right.x, alpha);
+        }
+        layers_.pop_back();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::draw_line(const Point &a, const Point &b, const Color &c)
+    {
+        FormatPlot<Format> plot(*this, c, alpha_);
+        raster_line(a, b, plot);
+        plot.finish();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c)
+    {
+        FormatPlot<Format> plot(*this, c, alpha_);
+        raster_stroke(points, count, style, plot);
+        plot.finish();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c)
+    {
+        FormatPlot<Format> plot(*this, c, alpha_);
+        raster_stroke(points.begin(), points.size(), style, plot);
+        plot.finish();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::draw_polygon(const Point *points, size_t count, const Color &fill)
+    {
+        FormatPlot<Format> plot(*this, fill, alpha_);
+        raster_polygon(points, count, plot);
+        plot.finish();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::draw_polygon(const PackedPoints &points, const Color &fill)
+    {
+        FormatPlot<Format> plot(*this, fill, alpha_);
+        raster_polygon(points.begin(), points.size(), plot);
+        plot.finish();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                                        const Color &fill)
+    {
+        FormatPlot<Format> plot(*this, fill, alpha_);
+        raster_contours(points, ends, contours, rule, plot);
+        plot.finish();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill)
+    {
+        FormatPlot<Format> plot(*this, fill, alpha_);
+        raster_ellipse(center, radius, degrees, plot);
+        plot.finish();
+    }
+
+    template <class Format>
+    void FormatImage<Format>::fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill)
+    {
+        Pixel p = Format::convert(fill);
+        int y0 = std::max(top_left.y, 0);
+        int y1 = std::min(bottom_right.y, height_ - 1);
+        for (int y = y0; y <= y1; y++)
+        {
+            if (alpha_ == OPAQUE_ALPHA)
+            {
+                fill_span(y, top_left.x, bottom_right.x, p);
+            }
+            else
+            {
+                blend_span(y, top_left.x, bottom_right.x, p, alpha_);
+            }
+        }
+    }
+
+    template class FormatImage<RGBPixels>;
+    template class FormatImage<RGBAPixels>;
+    template class FormatImage<GrayPixels>;
+    template class FormatImage<MaskPixels>;
+}
@@ -0,0 +1,127 @@
+//! @file FormatImage.hpp
+#ifndef __svg_FormatImage_hpp__
+#define __svg_FormatImage_hpp__
+
+#include "Canvas.hpp"
+#include "Color.hpp"
+#include "PixelFormat.hpp"
+#include "Point.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Canvas of any pixel format (see PixelFormat.hpp).
+    //! Shapes are rasterized as in PNGImage, and their spans are filled,
+    //! blended and encoded by the format policy, specialized at compile
+    //! time. Instantiated for the formats of PixelFormat.hpp only.
+    //! Drawing is aliased, in painter's order.
+    template <class Format>
+    class FormatImage : public Canvas
+    {
+    public:
+        typedef typename Format::Pixel Pixel;
+        typedef typename Format::Unit Unit;
+
+        //! Constructor of blank image, filled with the background of the format.
+        //! @param w Image width.
+        //! @param h Image height.
+        FormatImage(int w, int h);
+        int width() const override;
+        int height() const override;
+        //! Get a pixel.
+        //! @param x X position
+        //! @param y Y position.
+        //! @return Pixel.
+        Pixel at(int x, int y) const;
+        //! Get a pixel as a color, composited over white.
+        //! @param x X position
+        //! @param y Y position.
+        //! @return Color.
+        Color color(int x, int y) const;
+        //! Get the size of the pixels.
+        //! @return Bytes.
+        size_t memory() const;
+        //! Reset all pixels to the background, so the image can be reused.
+        void clear();
+        using Canvas::save;
+        //! Save to output file.
+        //! PNG files keep the channels of the format; the other formats
+        //! are written as RGB, composited over white.
+        //! @param file_name Output file name.
+        //! @param format File format.
+        void save(const std::string &file_name, ImageFormat format) const override;
+        //! Encode as PNG into memory, with the channels of the format.
+        //! @param png_data Receives the PNG bytes.
+        void encode(std::vector<unsigned char> &png_data) const;
+        //! Paint a horizontal run of pixels, clipped to the image.
+        //! @param y Row.
+        //! @param x0 First column.
+        //! @param x1 Last column (inclusive).
+        //! @param p Pixel.
+        void fill_span(int y, int x0, int x1, const Pixel &p);
+        //! Composite a pixel over a horizontal run of pixels, clipped to the image.
+        //! @param y Row.
+        //! @param x0 First column.
+        //! @param x1 Last column (inclusive).
+        //! @param p Pixel.
+        //! @param alpha Opacity of p.
+        void blend_span(int y, int x0, int x1, const Pixel &p, rgb_value alpha);
+        void set_alpha(rgb_value alpha) override;
+        //! Start a layer, saving the rows of its area (clipped) until end_layer.
+        //! @param top_left Top-left corner of the area drawn in the layer.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        void begin_layer(const Point &top_left, const Point &bottom_right) override;
+        void end_layer(rgb_value alpha) override;
+        void draw_line(const Point &a, const Point &b, const Color &c) override;
+        void draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c) override;
+        void draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c) override;
+        using Canvas::draw_polygon;
+        void draw_polygon(const Point *points, size_t count, const Color &fill) override;
+        void draw_polygon(const PackedPoints &points, const Color &fill) override;
+        void draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                       const Color &fill) override;
+        void draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill) override;
+        void fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill) override;
+
+    private:
+        //! Get the first unit of a row.
+        Unit *row(int y);
+        const Unit *row(int y) const;
+
+        //! Width.
+        int width_;
+        //! Height.
+        int height_;
+        //! Units per row.
+        size_t stride_;
+        //! Rows of units.
+        std::vector<Unit> pixels_;
+        //! Opacity of the shapes drawn next.
+        rgb_value alpha_;
+        //! Layer started by begin_layer.
+        struct Layer
+        {
+            //! Top-left corner of the saved area.
+            Point top_left;
+            //! Bottom-right corner of the saved area (inclusive).
+            Point bottom_right;
+            //! Saved rows of the area, whole (empty if the area is).
+            std::vector<Unit> below;
+        };
+        //! Layers started and not ended yet, innermost last.
+        std::vector<Layer> layers_;
+    };
+
+    //! 8-bit RGB canvas, drawing the pixels of PNGImage.
+    typedef FormatImage<RGBPixels> RGBImage;
+    //! 8-bit RGBA canvas, transparent where nothing was drawn.
+    typedef FormatImage<RGBAPixels> RGBAImage;
+    //! 8-bit grayscale canvas.
+    typedef FormatImage<GrayPixels> GrayImage;
+    //! 1-bit coverage canvas.
+    typedef FormatImage<MaskPixels> MaskImage;
+}
+#endif
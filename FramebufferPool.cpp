@@ -0,0 +1,115 @@
+//! @file FramebufferPool.cpp
+#include "FramebufferPool.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace svg
+{
+    FramebufferPool::FramebufferPool(size_t max_cached_bytes)
+        : max_cached_bytes_(max_cached_bytes)
+    {
+        stats_.hits = stats_.misses = stats_.bytes_cleared = stats_.bytes_cached = 0;
+    }
+
+    FramebufferPool::~FramebufferPool()
+    {
+        trim();
+    }
+
+    FramebufferPool &FramebufferPool::global()
+    {
+        static FramebufferPool pool(256 << 20);
+        return pool;
+    }
+
+    size_t FramebufferPool::size_class(size_t bytes)
+    {
+        // Four classes per power of two, so at most 25% is wasted.
+        const size_t min_class = 4096;
+        if (bytes <= min_class)
+        {
+            return min_class;
+        }
+        size_t p = min_class;
+        while (p * 2 <= bytes)
+        {
+            p *= 2;
+        }
+        size_t step = p / 4;
+        return (bytes + step - 1) / step * step;
+    }
+
+    unsigned char *FramebufferPool::acquire(size_t bytes, size_t &capacity)
+    {
+        capacity = size_class(bytes);
+        Entry e = {nullptr, 0, 0};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::map<size_t, std::vector<Entry>>::iterator it = free_.find(capacity);
+            if (it == free_.end() || it->second.empty())
+            {
+                stats_.misses++;
+            }
+            else
+            {
+                e = it->second.back();
+                it->second.pop_back();
+                stats_.hits++;
+                stats_.bytes_cached -= capacity;
+                stats_.bytes_cleared += e.dirty_end - e.dirty_begin;
+            }
+        }
+        if (e.buffer == nullptr)
+        {
+            e.buffer = (unsigned char *)::malloc(capacity);
+            if (e.buffer == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            ::memset(e.buffer, 0xFF, capacity);
+        }
+        else if (e.dirty_begin < e.dirty_end)
+        {
+            ::memset(e.buffer + e.dirty_begin, 0xFF, e.dirty_end - e.dirty_begin);
+        }
+        return e.buffer;
+    }
+
+    void FramebufferPool::release(unsigned char *buffer, size_t capacity,
+                                  size_t dirty_begin, size_t dirty_end)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stats_.bytes_cached + capacity <= max_cached_bytes_)
+            {
+                Entry e = {buffer, dirty_begin, dirty_end};
+                free_[capacity].push_back(e);
+                stats_.bytes_cached += capacity;
+                return;
+            }
+        }
+        ::free(buffer);
+    }
+
+    FramebufferPool::Stats FramebufferPool::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void FramebufferPool::trim()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::map<size_t, std::vector<Entry>>::iterator it = free_.begin(); it != free_.end(); ++it)
+        {
+            for (const Entry &e : it->second)
+            {
+                ::free(e.buffer);
+            }
+        }
+        free_.clear();
+        stats_.bytes_cached = 0;
+    }
+}
@@ -0,0 +1,82 @@
+//! @file FramebufferPool.hpp
+#ifndef __svg_FramebufferPool_hpp__
+#define __svg_FramebufferPool_hpp__
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace svg
+{
+    //! Size-classed pool of white framebuffers.
+    //! Returned buffers keep the byte range their user touched;
+    //! only that range is reset to white when the buffer is lent again.
+    class FramebufferPool
+    {
+    public:
+        //! Pool usage counters.
+        struct Stats
+        {
+            //! Buffers lent from the pool.
+            size_t hits;
+            //! Buffers that had to be allocated.
+            size_t misses;
+            //! Bytes reset to white when lending pooled buffers.
+            size_t bytes_cleared;
+            //! Bytes currently held by the pool.
+            size_t bytes_cached;
+        };
+
+        //! Constructor.
+        //! @param max_cached_bytes Buffers that would exceed this amount are freed on release.
+        FramebufferPool(size_t max_cached_bytes);
+        //! Destructor, frees the pooled buffers.
+        ~FramebufferPool();
+        //! Get the process-wide pool used by PNGImage.
+        //! @return Global pool.
+        static FramebufferPool &global();
+        //! Borrow a buffer whose first bytes are all 0xFF (white).
+        //! @param bytes Minimum size.
+        //! @param capacity Receives the actual size, to be passed back to release.
+        //! @return Buffer.
+        unsigned char *acquire(size_t bytes, size_t &capacity);
+        //! Return a buffer to the pool.
+        //! Every byte outside [dirty_begin, dirty_end) must still be 0xFF.
+        //! @param buffer Buffer from acquire.
+        //! @param capacity Capacity from acquire.
+        //! @param dirty_begin Start of the range written by the user.
+        //! @param dirty_end End of the range written by the user.
+        void release(unsigned char *buffer, size_t capacity,
+                     size_t dirty_begin, size_t dirty_end);
+        //! Get usage counters.
+        //! @return Counters.
+        Stats stats() const;
+        //! Free all pooled buffers.
+        void trim();
+
+    private:
+        FramebufferPool(const FramebufferPool &);
+        FramebufferPool &operator=(const FramebufferPool &);
+
+        //! Pooled buffer.
+        struct Entry
+        {
+            unsigned char *buffer;
+            size_t dirty_begin;
+            size_t dirty_end;
+        };
+        //! Round a size up to its size class.
+        static size_t size_class(size_t bytes);
+
+        //! Free buffers, by capacity.
+        std::map<size_t, std::vector<Entry>> free_;
+        //! Cache limit.
+        size_t max_cached_bytes_;
+        //! Counters.
+        Stats stats_;
+        //! Protects the free lists and counters.
+        mutable std::mutex mutex_;
+    };
+}
+#endif
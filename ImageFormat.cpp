@@ -0,0 +1,540 @@
+//! @file ImageFormat.cpp
+#include "ImageFormat.hpp"
+
+#include "external/stb/stb_image.h"
+#include "external/stb/stb_image_write.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace svg
+{
+    namespace
+    {
+        //! Largest image read, in pixels.
+        const size_t MAX_PIXELS = (size_t)1 << 28;
+
+        bool has_extension(const std::string &file_name, const char *ext)
+        {
+            size_t n = std::strlen(ext);
+            return file_name.size() > n &&
+                   file_name.compare(file_name.size() - n, n, ext) == 0;
+        }
+
+        //! Write buffers entirely, resuming after partial writes.
+        void write_all(const std::string &file_name, struct iovec *iov, int count)
+        {
+            int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                throw std::runtime_error(file_name + ": could not open for writing!");
+            }
+            while (count > 0)
+            {
+                ssize_t n = ::writev(fd, iov, count);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n < 0)
+                {
+                    ::close(fd);
+                    throw std::runtime_error(file_name + ": write failed!");
+                }
+                while (count > 0 && (size_t)n >= iov->iov_len)
+                {
+                    n -= iov->iov_len;
+                    iov++;
+                    count--;
+                }
+                if (count > 0)
+                {
+                    iov->iov_base = (char *)iov->iov_base + n;
+                    iov->iov_len -= n;
+                }
+            }
+            if (::close(fd) != 0)
+            {
+                throw std::runtime_error(file_name + ": write failed!");
+            }
+        }
+
+        void read_file(const std::string &file_name, std::vector<unsigned char> &data)
+        {
+            FILE *f = ::fopen(file_name.c_str(), "rb");
+            if (f == nullptr)
+            {
+                throw std::runtime_error(file_name + ": could not load image!");
+            }
+            unsigned char buffer[65536];
+            size_t n;
+            while ((n = ::fread(buffer, 1, sizeof(buffer), f)) > 0)
+            {
+                data.insert(data.end(), buffer, buffer + n);
+            }
+            ::fclose(f);
+        }
+
+        //! Allocate the pixels of a w x h image read from a file.
+        Color *allocate_pixels(const std::string &file_name, int w, int h)
+        {
+            if (w <= 0 || h <= 0 || (size_t)w * h > MAX_PIXELS)
+            {
+                throw std::runtime_error(file_name + ": invalid image dimensions!");
+            }
+            Color *pixels = (Color *)std::malloc((size_t)w * h * sizeof(Color));
+            if (pixels == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            return pixels;
+        }
+
+        //! Header fields of PPM and PAM files.
+        struct NetpbmHeader
+        {
+            int width;
+            int height;
+            int depth;
+            int maxval;
+        };
+
+        //! Read the next decimal number of a PPM header, skipping blanks and comments.
+        bool ppm_number(const std::vector<unsigned char> &data, size_t &pos, int &value)
+        {
+            while (pos < data.size() && (std::isspace(data[pos]) || data[pos] == '#'))
+            {
+                if (data[pos] == '#')
+                {
+                    while (pos < data.size() && data[pos] != '\n')
+                    {
+                        pos++;
+                    }
+                }
+                else
+                {
+                    pos++;
+                }
+            }
+            if (pos >= data.size() || !std::isdigit(data[pos]))
+            {
+                return false;
+            }
+            long v = 0;
+            while (pos < data.size() && std::isdigit(data[pos]) && v < 1000000000)
+            {
+                v = v * 10 + (data[pos++] - '0');
+            }
+            value = (int)v;
+            return true;
+        }
+
+        //! Parse a P6 header; pos is left on the first pixel byte.
+        bool parse_ppm(const std::vector<unsigned char> &data, size_t &pos, NetpbmHeader &header)
+        {
+            if (data.size() < 2 || data[0] != 'P' || data[1] != '6')
+            {
+                return false;
+            }
+            pos = 2;
+            header.depth = 3;
+            if (!ppm_number(data, pos, header.width) || !ppm_number(data, pos, header.height) ||
+                !ppm_number(data, pos, header.maxval) || pos >= data.size())
+            {
+                return false;
+            }
+            // A single blank separates the header from the pixels
+            pos++;
+            return true;
+        }
+
+        //! Parse a P7 header; pos is left on the first pixel byte.
+        bool parse_pam(const std::vector<unsigned char> &data, size_t &pos, NetpbmHeader &header)
+        {
+            if (data.size() < 3 || data[0] != 'P' || data[1] != '7' || data[2] != '\n')
+            {
+                return false;
+            }
+            pos = 3;
+            header = NetpbmHeader{0, 0, 0, 0};
+            while (pos < data.size())
+            {
+                size_t end = pos;
+                while (end < data.size() && data[end] != '\n')
+                {
+                    end++;
+                }
+                std::string line(data.begin() + pos, data.begin() + end);
+                pos = end + 1;
+                char key[16];
+                int value;
+                if (line == "ENDHDR")
+                {
+                    return pos <= data.size();
+                }
+                if (line.empty() || line[0] == '#' || std::sscanf(line.c_str(), "%15s %d", key, &value) != 2)
+                {
+                    continue;
+                }
+                if (std::strcmp(key, "WIDTH") == 0)
+                {
+                    header.width = value;
+                }
+                else if (std::strcmp(key, "HEIGHT") == 0)
+                {
+                    header.height = value;
+                }
+                else if (std::strcmp(key, "DEPTH") == 0)
+                {
+                    header.depth = value;
+                }
+                else if (std::strcmp(key, "MAXVAL") == 0)
+                {
+                    header.maxval = value;
+                }
+            }
+            return false;
+        }
+
+        Color *read_netpbm(const std::string &file_name, ImageFormat format, int &w, int &h)
+        {
+            std::vector<unsigned char> data;
+            read_file(file_name, data);
+            size_t pos = 0;
+            NetpbmHeader header;
+            bool ok = format == ImageFormat::PPM ? parse_ppm(data, pos, header) : parse_pam(data, pos, header);
+            if (!ok || header.depth != 3 || header.maxval != 255)
+            {
+                throw std::runtime_error(file_name + ": unsupported image header!");
+            }
+            Color *pixels = allocate_pixels(file_name, header.width, header.height);
+            size_t bytes = (size_t)header.width * header.height * sizeof(Color);
+            if (data.size() - pos < bytes)
+            {
+                std::free(pixels);
+                throw std::runtime_error(file_name + ": truncated image!");
+            }
+            std::memcpy(pixels, data.data() + pos, bytes);
+            w = header.width;
+            h = header.height;
+            return pixels;
+        }
+
+        //! QOI operations.
+        enum
+        {
+            QOI_OP_INDEX = 0x00,
+            QOI_OP_DIFF = 0x40,
+            QOI_OP_LUMA = 0x80,
+            QOI_OP_RUN = 0xC0,
+            QOI_OP_RGB = 0xFE,
+            QOI_OP_RGBA = 0xFF
+        };
+        //! Size of the QOI header.
+        const size_t QOI_HEADER = 14;
+        //! End marker of QOI streams.
+        const unsigned char QOI_END[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+        //! QOI pixel, with the alpha channel the format hashes.
+        struct QoiPixel
+        {
+            unsigned char r, g, b, a;
+            bool operator==(const QoiPixel &o) const
+            {
+                return r == o.r && g == o.g && b == o.b && a == o.a;
+            }
+            bool operator!=(const QoiPixel &o) const
+            {
+                return !(*this == o);
+            }
+            unsigned hash() const
+            {
+                return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+            }
+        };
+
+        void put_be32(std::vector<unsigned char> &out, uint32_t v)
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                out.push_back((unsigned char)(v >> shift));
+            }
+        }
+
+        uint32_t get_be32(const unsigned char *p)
+        {
+            return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+
+        Color *decode_qoi(const std::string &file_name, const std::vector<unsigned char> &data, int &w, int &h)
+        {
+            if (data.size() < QOI_HEADER + sizeof(QOI_END) || std::memcmp(data.data(), "qoif", 4) != 0)
+            {
+                throw std::runtime_error(file_name + ": invalid QOI image!");
+            }
+            uint32_t width = get_be32(&data[4]), height = get_be32(&data[8]);
+            if (width > MAX_PIXELS || height > MAX_PIXELS)
+            {
+                throw std::runtime_error(file_name + ": invalid image dimensions!");
+            }
+            Color *pixels = allocate_pixels(file_name, (int)width, (int)height);
+            size_t count = (size_t)width * height;
+            size_t end = data.size() - sizeof(QOI_END);
+            size_t pos = QOI_HEADER;
+            QoiPixel index[64];
+            std::memset(index, 0, sizeof(index));
+            QoiPixel px = {0, 0, 0, 255};
+            int run = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (run > 0)
+                {
+                    run--;
+                }
+                else if (pos < end)
+                {
+                    unsigned char b1 = data[pos++];
+                    if (b1 == QOI_OP_RGB)
+                    {
+                        px.r = data[pos];
+                        px.g = data[pos + 1];
+                        px.b = data[pos + 2];
+                        pos += 3;
+                    }
+                    else if (b1 == QOI_OP_RGBA)
+                    {
+                        px.r = data[pos];
+                        px.g = data[pos + 1];
+                        px.b = data[pos + 2];
+                        px.a = data[pos + 3];
+                        pos += 4;
+                    }
+                    else if ((b1 & 0xC0) == QOI_OP_INDEX)
+                    {
+                        px = index[b1];
+                    }
+                    else if ((b1 & 0xC0) == QOI_OP_DIFF)
+                    {
+                        px.r += ((b1 >> 4) & 3) - 2;
+                        px.g += ((b1 >> 2) & 3) - 2;
+                        px.b += (b1 & 3) - 2;
+                    }
+                    else if ((b1 & 0xC0) == QOI_OP_LUMA)
+                    {
+                        unsigned char b2 = data[pos++];
+                        int dg = (b1 & 0x3F) - 32;
+                        px.r += dg - 8 + ((b2 >> 4) & 0x0F);
+                        px.g += dg;
+                        px.b += dg - 8 + (b2 & 0x0F);
+                    }
+                    else
+                    {
+                        run = b1 & 0x3F;
+                    }
+                    index[px.hash()] = px;
+                }
+                else
+                {
+                    std::free(pixels);
+                    throw std::runtime_error(file_name + ": truncated image!");
+                }
+                pixels[i] = Color{px.r, px.g, px.b};
+            }
+            w = (int)width;
+            h = (int)height;
+            return pixels;
+        }
+    }
+
+    ImageFormat resolve_format(ImageFormat format, const std::string &file_name)
+    {
+        if (format != ImageFormat::AUTO)
+        {
+            return format;
+        }
+        if (has_extension(file_name, ".qoi"))
+        {
+            return ImageFormat::QOI;
+        }
+        if (has_extension(file_name, ".ppm"))
+        {
+            return ImageFormat::PPM;
+        }
+        if (has_extension(file_name, ".pam"))
+        {
+            return ImageFormat::PAM;
+        }
+        if (has_extension(file_name, ".rgb") || has_extension(file_name, ".raw"))
+        {
+            return ImageFormat::RAW;
+        }
+        return ImageFormat::PNG;
+    }
+
+    bool parse_format(const std::string &name, ImageFormat &format)
+    {
+        static const struct
+        {
+            const char *name;
+            ImageFormat format;
+        } NAMES[] = {{"png", ImageFormat::PNG}, {"qoi", ImageFormat::QOI}, {"ppm", ImageFormat::PPM},
+                     {"pam", ImageFormat::PAM}, {"raw", ImageFormat::RAW}};
+        for (const auto &entry : NAMES)
+        {
+            if (name == entry.name)
+            {
+                format = entry.format;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void encode_qoi(const Color *pixels, int w, int h, std::vector<unsigned char> &data)
+    {
+        size_t count = (size_t)w * h;
+        data.clear();
+        // Flat art is mostly runs and index hits, so this is rarely grown
+        data.reserve(QOI_HEADER + count + sizeof(QOI_END));
+        data.insert(data.end(), {'q', 'o', 'i', 'f'});
+        put_be32(data, (uint32_t)w);
+        put_be32(data, (uint32_t)h);
+        data.push_back(3); // RGB
+        data.push_back(0); // sRGB with linear alpha
+        QoiPixel index[64];
+        std::memset(index, 0, sizeof(index));
+        QoiPixel prev = {0, 0, 0, 255};
+        int run = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            QoiPixel px = {pixels[i].red, pixels[i].green, pixels[i].blue, 255};
+            if (px == prev)
+            {
+                if (++run == 62 || i + 1 == count)
+                {
+                    data.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                data.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+                run = 0;
+            }
+            unsigned h = px.hash();
+            if (index[h] == px)
+            {
+                data.push_back((unsigned char)(QOI_OP_INDEX | h));
+            }
+            else
+            {
+                index[h] = px;
+                signed char dr = (signed char)(px.r - prev.r);
+                signed char dg = (signed char)(px.g - prev.g);
+                signed char db = (signed char)(px.b - prev.b);
+                int dr_dg = dr - dg, db_dg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    data.push_back((unsigned char)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                {
+                    data.push_back((unsigned char)(QOI_OP_LUMA | (dg + 32)));
+                    data.push_back((unsigned char)((dr_dg + 8) << 4 | (db_dg + 8)));
+                }
+                else
+                {
+                    data.push_back(QOI_OP_RGB);
+                    data.push_back(px.r);
+                    data.push_back(px.g);
+                    data.push_back(px.b);
+                }
+            }
+            prev = px;
+        }
+        data.insert(data.end(), QOI_END, QOI_END + sizeof(QOI_END));
+    }
+
+    void write_image(const std::string &file_name, ImageFormat format, const Color *pixels, int w, int h)
+    {
+        std::string header;
+        std::vector<unsigned char> qoi;
+        struct iovec iov[2];
+        switch (resolve_format(format, file_name))
+        {
+        case ImageFormat::QOI:
+            encode_qoi(pixels, w, h, qoi);
+            iov[0].iov_base = qoi.data();
+            iov[0].iov_len = qoi.size();
+            write_all(file_name, iov, 1);
+            return;
+        case ImageFormat::PPM:
+            header = "P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n";
+            break;
+        case ImageFormat::PAM:
+            header = "P7\nWIDTH " + std::to_string(w) + "\nHEIGHT " + std::to_string(h) +
+                     "\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n";
+            break;
+        case ImageFormat::RAW:
+            break;
+        default:
+            if (!::stbi_write_png(file_name.c_str(), w, h, 3, pixels, w * 3))
+            {
+                throw std::runtime_error(file_name + ": write failed!");
+            }
+            return;
+        }
+        iov[0].iov_base = &header[0];
+        iov[0].iov_len = header.size();
+        iov[1].iov_base = (void *)pixels;
+        iov[1].iov_len = (size_t)w * h * sizeof(Color);
+        write_all(file_name, iov, 2);
+    }
+
+    Color *read_image(const std::string &file_name, ImageFormat format, int &w, int &h)
+    {
+        std::vector<unsigned char> data;
+        switch (resolve_format(format, file_name))
+        {
+        case ImageFormat::QOI:
+            read_file(file_name, data);
+            return decode_qoi(file_name, data, w, h);
+        case ImageFormat::PPM:
+        case ImageFormat::PAM:
+            return read_netpbm(file_name, resolve_format(format, file_name), w, h);
+        case ImageFormat::RAW:
+        {
+            Color *pixels = allocate_pixels(file_name, w, h);
+            read_file(file_name, data);
+            if (data.size() != (size_t)w * h * sizeof(Color))
+            {
+                std::free(pixels);
+                throw std::runtime_error(file_name + ": raw image size does not match its dimensions!");
+            }
+            std::memcpy(pixels, data.data(), data.size());
+            return pixels;
+        }
+        default:
+        {
+            int channels;
+            Color *pixels = (Color *)::stbi_load(file_name.c_str(), &w, &h, &channels, 3);
+            if (pixels == nullptr)
+            {
+                throw std::runtime_error(file_name + ": could not load image!");
+            }
+            return pixels;
+        }
+        }
+    }
+}
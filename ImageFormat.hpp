@@ -0,0 +1,63 @@
+//! @file ImageFormat.hpp
+#ifndef __svg_ImageFormat_hpp__
+#define __svg_ImageFormat_hpp__
+
+#include "Color.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Image file formats.
+    enum class ImageFormat
+    {
+        //! Chosen from the file extension.
+        AUTO,
+        //! PNG (.png), the default.
+        PNG,
+        //! Quite OK Image format (.qoi): lossless, encoded in one fast pass.
+        QOI,
+        //! Binary PPM (.ppm): a text header followed by the pixels.
+        PPM,
+        //! PAM (.pam): same, with a self-describing header.
+        PAM,
+        //! Headerless RGB rows (.rgb or .raw): the pixels as they are in memory.
+        RAW
+    };
+
+    //! Get the format of a file.
+    //! @param format Requested format.
+    //! @param file_name File name.
+    //! @return format, or the format of the file extension if format is AUTO (PNG if unknown).
+    ImageFormat resolve_format(ImageFormat format, const std::string &file_name);
+    //! Get a format from its name (png, qoi, ppm, pam or raw).
+    //! @param name Format name.
+    //! @param format Receives the format.
+    //! @return False if the name is unknown.
+    bool parse_format(const std::string &name, ImageFormat &format);
+    //! Encode pixels as QOI.
+    //! @param pixels Row-major pixels.
+    //! @param w Width.
+    //! @param h Height.
+    //! @param data Receives the QOI bytes.
+    void encode_qoi(const Color *pixels, int w, int h, std::vector<unsigned char> &data);
+    //! Write pixels to a file.
+    //! PPM, PAM and raw files are written with a single writev of their
+    //! header and the pixels, so they cost no encoding at all.
+    //! @param file_name File name.
+    //! @param format Format.
+    //! @param pixels Row-major pixels.
+    //! @param w Width.
+    //! @param h Height.
+    void write_image(const std::string &file_name, ImageFormat format, const Color *pixels, int w, int h);
+    //! Read pixels from a file.
+    //! @param file_name File name.
+    //! @param format Format.
+    //! @param w Receives the width; for raw files, which have no header, the width to read.
+    //! @param h Receives the height; for raw files, the height to read.
+    //! @return Row-major pixels, to be freed with free().
+    Color *read_image(const std::string &file_name, ImageFormat format, int &w, int &h);
+}
+#endif
@@ -0,0 +1,130 @@
+//! @file MemoryBudget.cpp
+#include "MemoryBudget.hpp"
+#include "Cancel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace svg
+{
+    namespace
+    {
+        //! Longest wait between two checks of a cancellation token, which
+        //! cancel() does not signal.
+        const std::chrono::milliseconds CANCEL_POLL(10);
+
+        //! Format a size in megabytes, rounded up.
+        std::string megabytes(size_t bytes)
+        {
+            std::ostringstream out;
+            out << (bytes + (1 << 20) - 1) / (1 << 20) << " MB";
+            return out.str();
+        }
+    }
+
+    MemoryBudget::MemoryBudget(size_t limit) : limit_(limit), next_ticket_(0), serving_(0)
+    {
+        stats_.reserved = stats_.peak = stats_.waits = stats_.refused = 0;
+    }
+
+    size_t MemoryBudget::limit() const
+    {
+        return limit_;
+    }
+
+    bool MemoryBudget::fits(size_t bytes) const
+    {
+        return limit_ == 0 || bytes <= limit_ - stats_.reserved;
+    }
+
+    void MemoryBudget::serve_next()
+    {
+        serving_++;
+        while (abandoned_.erase(serving_) != 0)
+        {
+            serving_++;
+        }
+    }
+
+    void MemoryBudget::acquire(size_t bytes, const CancelToken *token)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (limit_ != 0 && bytes > limit_)
+        {
+            stats_.refused++;
+            throw std::runtime_error("needs " + megabytes(bytes) + ", over the memory budget of " +
+                                     megabytes(limit_) + "!");
+        }
+        unsigned long ticket = next_ticket_++;
+        if (ticket != serving_ || !fits(bytes))
+        {
+            stats_.waits++;
+            while (ticket != serving_ || !fits(bytes))
+            {
+                if (token == nullptr)
+                {
+                    changed_.wait(lock);
+                    continue;
+                }
+                if (token->stopped())
+                {
+                    // Give the turn up, so the tickets behind it are not stuck
+                    if (ticket == serving_)
+                    {
+                        serve_next();
+                    }
+                    else
+                    {
+                        abandoned_.insert(ticket);
+                    }
+                    lock.unlock();
+                    changed_.notify_all();
+                    token->check();
+                }
+                std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + CANCEL_POLL, deadline;
+                if (token->deadline(deadline))
+                {
+                    until = std::min(until, deadline);
+                }
+                changed_.wait_until(lock, until);
+            }
+        }
+        serve_next();
+        stats_.reserved += bytes;
+        stats_.peak = std::max(stats_.peak, stats_.reserved);
+        lock.unlock();
+        // The next ticket may fit as well
+        changed_.notify_all();
+    }
+
+    bool MemoryBudget::try_acquire(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!fits(bytes))
+        {
+            stats_.refused++;
+            return false;
+        }
+        stats_.reserved += bytes;
+        stats_.peak = std::max(stats_.peak, stats_.reserved);
+        return true;
+    }
+
+    void MemoryBudget::release(size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.reserved -= bytes;
+        }
+        changed_.notify_all();
+    }
+
+    MemoryBudget::Stats MemoryBudget::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+}
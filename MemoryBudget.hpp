@@ -0,0 +1,83 @@
+//! @file MemoryBudget.hpp
+#ifndef __svg_MemoryBudget_hpp__
+#define __svg_MemoryBudget_hpp__
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <set>
+
+namespace svg
+{
+    class CancelToken;
+
+    //! Memory shared by concurrent conversions.
+    //! Each conversion reserves its estimated peak before it starts and
+    //! waits while the others hold too much; reservations are granted in
+    //! request order, so small jobs cannot starve a large one. Jobs that
+    //! could never fit are refused at once.
+    class MemoryBudget
+    {
+    public:
+        //! Usage counters.
+        struct Stats
+        {
+            //! Bytes currently reserved.
+            size_t reserved;
+            //! Most bytes reserved at once.
+            size_t peak;
+            //! Reservations that had to wait for others to be released.
+            size_t waits;
+            //! Reservations refused, larger than what was left.
+            size_t refused;
+        };
+
+        //! Constructor.
+        //! @param limit Bytes that may be reserved at once (0 = no limit).
+        MemoryBudget(size_t limit);
+        //! Get the limit.
+        //! @return Bytes that may be reserved at once (0 = no limit).
+        size_t limit() const;
+        //! Reserve memory, waiting until it is available.
+        //! Throws std::runtime_error if it exceeds the whole budget, and
+        //! Cancelled if the token stops while waiting.
+        //! @param bytes Size to reserve.
+        //! @param token Cancellation token of the job, nullptr for none.
+        void acquire(size_t bytes, const CancelToken *token = nullptr);
+        //! Reserve memory if it is available now.
+        //! @param bytes Size to reserve.
+        //! @return False if it was not reserved.
+        bool try_acquire(size_t bytes);
+        //! Return reserved memory.
+        //! @param bytes Size reserved by acquire or try_acquire.
+        void release(size_t bytes);
+        //! Get usage counters.
+        //! @return Counters.
+        Stats stats() const;
+
+    private:
+        MemoryBudget(const MemoryBudget &);
+        MemoryBudget &operator=(const MemoryBudget &);
+
+        //! Check if a reservation fits now.
+        bool fits(size_t bytes) const;
+        //! Serve the next ticket, skipping abandoned ones. Requires mutex_.
+        void serve_next();
+
+        //! Limit, 0 for none.
+        size_t limit_;
+        //! Counters.
+        Stats stats_;
+        //! Ticket of the next acquire call.
+        unsigned long next_ticket_;
+        //! Ticket allowed to reserve next.
+        unsigned long serving_;
+        //! Tickets of cancelled waits, not served yet.
+        std::set<unsigned long> abandoned_;
+        //! Protects the counters and tickets.
+        mutable std::mutex mutex_;
+        //! Signaled when memory is released or a ticket is served.
+        std::condition_variable changed_;
+    };
+}
+#endif
@@ -0,0 +1,115 @@
+//! @file Optimize.cpp
+#include "Optimize.hpp"
+#include "SVGElements.hpp"
+
+#include <algorithm>
+
+namespace svg
+{
+    namespace
+    {
+        //! Replace groups by their members, recursively.
+        //! Translucent groups are kept, their members are composited together.
+        void flatten_groups(const std::vector<SVGElement *> &elements,
+                            std::vector<SVGElement *> &leaves,
+                            OptimizeStats &stats)
+        {
+            for (SVGElement *e : elements)
+            {
+                Group *group = dynamic_cast<Group *>(e);
+                if (group == nullptr || group->get_alpha() != OPAQUE_ALPHA)
+                {
+                    leaves.push_back(e);
+                    continue;
+                }
+                std::vector<SVGElement *> members = group->release_elements();
+                flatten_groups(members, leaves, stats);
+                delete group;
+                stats.groups_flattened++;
+            }
+        }
+
+        //! Check if two boxes cover exactly their bounding box together.
+        bool mergeable(const Point &a0, const Point &a1, const Point &b0, const Point &b1)
+        {
+            // Same columns, rows touching or overlapping
+            if (a0.x == b0.x && a1.x == b1.x)
+            {
+                return b0.y <= a1.y + 1 && a0.y <= b1.y + 1;
+            }
+            // Same rows, columns touching or overlapping
+            if (a0.y == b0.y && a1.y == b1.y)
+            {
+                return b0.x <= a1.x + 1 && a0.x <= b1.x + 1;
+            }
+            return false;
+        }
+
+        bool same_color(const Color &a, const Color &b)
+        {
+            return a.red == b.red && a.green == b.green && a.blue == b.blue;
+        }
+    }
+
+    OptimizeStats optimize_elements(std::vector<SVGElement *> &elements, const Point &dimensions)
+    {
+        OptimizeStats stats = {0, 0, 0, 0, 0};
+        std::vector<SVGElement *> leaves;
+        flatten_groups(elements, leaves, stats);
+
+        std::vector<SVGElement *> result;
+        for (SVGElement *e : leaves)
+        {
+            Point top_left, bottom_right;
+            e->get_bounds(top_left, bottom_right);
+            if (top_left.x > bottom_right.x || top_left.y > bottom_right.y || e->get_alpha() == 0)
+            {
+                delete e;
+                stats.empty_dropped++;
+                continue;
+            }
+            if (bottom_right.x < 0 || bottom_right.y < 0 ||
+                top_left.x >= dimensions.x || top_left.y >= dimensions.y)
+            {
+                delete e;
+                stats.offcanvas_dropped++;
+                continue;
+            }
+
+            Polygon *polygon = dynamic_cast<Polygon *>(e);
+            if (polygon == nullptr || !polygon->get_box(top_left, bottom_right))
+            {
+                result.push_back(e);
+                continue;
+            }
+            if (dynamic_cast<Box *>(e) == nullptr)
+            {
+                stats.boxes++;
+            }
+            Color fill = polygon->get_fill();
+            rgb_value alpha = polygon->get_alpha();
+            delete e;
+
+            Box *previous = result.empty() ? nullptr : dynamic_cast<Box *>(result.back());
+            Point prev_top_left, prev_bottom_right;
+            // Translucent boxes are not merged: overlapping rows would be blended twice
+            if (previous != nullptr && alpha == OPAQUE_ALPHA &&
+                previous->get_alpha() == OPAQUE_ALPHA &&
+                same_color(previous->get_fill(), fill) &&
+                previous->get_box(prev_top_left, prev_bottom_right) &&
+                mergeable(prev_top_left, prev_bottom_right, top_left, bottom_right))
+            {
+                top_left = Point{std::min(top_left.x, prev_top_left.x), std::min(top_left.y, prev_top_left.y)};
+                bottom_right = Point{std::max(bottom_right.x, prev_bottom_right.x), std::max(bottom_right.y, prev_bottom_right.y)};
+                delete previous;
+                result.pop_back();
+                stats.boxes_merged++;
+            }
+            Box *box = new Box(fill, top_left, bottom_right);
+            box->set_alpha(alpha);
+            result.push_back(box);
+        }
+        elements.swap(result);
+        return stats;
+    }
+}
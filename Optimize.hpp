@@ -0,0 +1,43 @@
+//! @file Optimize.hpp
+#ifndef __svg_Optimize_hpp__
+#define __svg_Optimize_hpp__
+
+#include "Point.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace svg
+{
+    class SVGElement;
+
+    //! Number of elements changed by each rule of optimize_elements.
+    struct OptimizeStats
+    {
+        //! Groups replaced by their members.
+        size_t groups_flattened;
+        //! Polygons replaced by boxes drawn with Canvas::fill_rect.
+        size_t boxes;
+        //! Boxes merged into the box drawn just before them.
+        size_t boxes_merged;
+        //! Elements dropped because they draw nothing (or are fully transparent).
+        size_t empty_dropped;
+        //! Elements dropped because they are entirely off the canvas.
+        size_t offcanvas_dropped;
+    };
+
+    //! Rewrite a parsed scene into fewer, simpler draw calls.
+    //! The rules keep painter's order, so the image is pixel-identical:
+    //! - groups are replaced by their members (transforms are already
+    //!   folded into the geometry when the document is read);
+    //! - elements drawing nothing, or nothing on the canvas, are dropped;
+    //! - polygons painting exactly an axis-aligned rectangle become Box;
+    //! - a box is merged into the previous element when that is a box of
+    //!   the same color and their union is a rectangle.
+    //! Removed elements are deleted.
+    //! @param elements Elements, in drawing order; replaced by the result.
+    //! @param dimensions Canvas dimensions.
+    //! @return Counts per rule.
+    OptimizeStats optimize_elements(std::vector<SVGElement *> &elements, const Point &dimensions);
+}
+#endif
@@ -1,4 +1,9 @@
 #include "PNGImage.hpp"
+#include "BlendKernels.hpp"
+#include "FramebufferPool.hpp"
+#include "ImageFormat.hpp"
+#include "Raster.hpp"
+#include "ThreadPool.hpp"
 
 #include <stdexcept>
 #include <cmath>
@@ -15,38 +20,90 @@
 namespace svg
 {
     PNGImage::PNGImage(const std::string &png_file_name)
+        : owned_(true), pool_(nullptr), capacity_(0), coverage_words_(0),
+          parallel_min_vertices_(PARALLEL_FILL_VERTICES), parallel_min_area_(PARALLEL_FILL_AREA),
+          alpha_(OPAQUE_ALPHA), antialias_(false)
     {
-        int dummy;
-        pixels_ = (Color *)::stbi_load(png_file_name.c_str(),
-                                       &width_, &height_,
-                                       &dummy, 3);
-        if (pixels_ == nullptr)
+        pixels_ = read_image(png_file_name, ImageFormat::AUTO, width_, height_);
+        dirty_top_ = 0;
+        dirty_bottom_ = height_;
+        reset_clip();
+    }
+    PNGImage::PNGImage(const std::string &raw_file_name, int w, int h)
+        : width_(w), height_(h), owned_(true), pool_(nullptr), capacity_(0),
+          dirty_top_(0), dirty_bottom_(h), coverage_words_(0),
+          parallel_min_vertices_(PARALLEL_FILL_VERTICES), parallel_min_area_(PARALLEL_FILL_AREA),
+          alpha_(OPAQUE_ALPHA), antialias_(false)
+    {
+        pixels_ = read_image(raw_file_name, ImageFormat::RAW, width_, height_);
+        reset_clip();
+    }
+    PNGImage::PNGImage(int w, int h) : PNGImage(w, h, FramebufferPool::global())
+    {
+    }
+    PNGImage::PNGImage(int w, int h, FramebufferPool &pool)
+        : width_(w), height_(h), owned_(false), pool_(&pool),
+          dirty_top_(0), dirty_bottom_(0), coverage_words_(0),
+          parallel_min_vertices_(PARALLEL_FILL_VERTICES), parallel_min_area_(PARALLEL_FILL_AREA),
+          alpha_(OPAQUE_ALPHA), antialias_(false)
+    {
+        assert(w > 0 && h > 0);
+        size_t sz = (size_t)w * h * sizeof(Color);
+        pixels_ = (Color *)pool.acquire(sz, capacity_);
+        reset_clip();
+    }
+    PNGImage::PNGImage(int w, int h, Color *pixels)
+        : width_(w), height_(h), pixels_(pixels), owned_(false),
+          pool_(nullptr), capacity_(0), dirty_top_(0), dirty_bottom_(h),
+          coverage_words_(0),
+          parallel_min_vertices_(PARALLEL_FILL_VERTICES), parallel_min_area_(PARALLEL_FILL_AREA),
+          alpha_(OPAQUE_ALPHA), antialias_(false)
+    {
+        assert(w > 0 && h > 0);
+        reset_clip();
+    }
+    void PNGImage::clear()
+    {
+        if (dirty_top_ < dirty_bottom_)
         {
-            throw std::runtime_error(png_file_name + ": could not load image!");
+            ::memset(pixels_ + (size_t)dirty_top_ * width_, 0xFF,
+                     (size_t)(dirty_bottom_ - dirty_top_) * width_ * sizeof(Color));
         }
+        dirty_top_ = dirty_bottom_ = 0;
     }
-    PNGImage::PNGImage(int w, int h)
+    void PNGImage::save(const std::string &png_file_name, ImageFormat format) const
     {
-        assert(w > 0 && h > 0);
-        size_t sz = w * h * sizeof(Color);
-        pixels_ = (Color *)::stbi__malloc(sz);
-        width_ = w;
-        height_ = h;
-        ::memset(pixels_, 0xFF, sz);
+        write_image(png_file_name, format, pixels_, width_, height_);
+    }
+
+    static void append_bytes(void *context, void *data, int size)
+    {
+        std::vector<unsigned char> *out = (std::vector<unsigned char> *)context;
+        out->insert(out->end(), (unsigned char *)data, (unsigned char *)data + size);
     }
-    void PNGImage::save(const std::string &png_file_name) const
+    void PNGImage::encode(std::vector<unsigned char> &png_data) const
     {
-        ::stbi_write_png(png_file_name.c_str(),
-                         width_,
-                         height_,
-                         3,
-                         pixels_,
-                         width_ * 3);
+        png_data.clear();
+        if (!::stbi_write_png_to_func(append_bytes, &png_data,
+                                      width_, height_, 3, pixels_, width_ * 3))
+        {
+            throw std::runtime_error("PNG encoding failed!");
+        }
     }
 
     PNGImage::~PNGImage()
     {
-        stbi_image_free(pixels_);
+        if (pool_ != nullptr)
+        {
+            size_t row = (size_t)width_ * sizeof(Color);
+            pool_->release((unsigned char *)pixels_, capacity_,
+                           dirty_top_ * row, std::max(dirty_top_, dirty_bottom_) * row);
+        }
+        else if (owned_)
+        {
+            // read_image buffers come from malloc, as stb_image ones
+            stbi_image_free(pixels_);
+        }
     }
 
     int PNGImage::width() const
@@ -58,153 +115,480 @@ namespace svg
         return height_;
     }
     Color &PNGImage::at(int x, int y)
+    {
+        mark_dirty(y, y);
+        return pixel(x, y);
+    }
+    Color &PNGImage::pixel(int x, int y)
     {
         assert(x >= 0 && x < width_);
         assert(y >= 0 && y < height_);
         return pixels_[y * width_ + x];
     }
+    void PNGImage::mark_dirty(int y0, int y1)
+    {
+        y0 = std::max(y0, 0);
+        y1 = std::min(y1 + 1, height_);
+        if (y0 >= y1)
+        {
+            return;
+        }
+        if (dirty_top_ >= dirty_bottom_)
+        {
+            dirty_top_ = y0;
+            dirty_bottom_ = y1;
+        }
+        else
+        {
+            dirty_top_ = std::min(dirty_top_, y0);
+            dirty_bottom_ = std::max(dirty_bottom_, y1);
+        }
+    }
     Color PNGImage::at(int x, int y) const
     {
         assert(x >= 0 && x < width_);
         assert(y >= 0 && y < height_);
         return pixels_[y * width_ + x];
     }
-    void PNGImage::draw_line(const Point &a, const Point &b, const Color &c)
+    bool PNGImage::clip_span(int y, int &x0, int &x1) const
+    {
+        if (y < clip_min_.y || y > clip_max_.y)
+        {
+            return false;
+        }
+        x0 = std::max(x0, clip_min_.x);
+        x1 = std::min(x1, clip_max_.x);
+        return x0 <= x1;
+    }
+
+    void PNGImage::set_clip(const Point &top_left, const Point &bottom_right)
+    {
+        clip_min_ = Point{std::max(top_left.x, 0), std::max(top_left.y, 0)};
+        clip_max_ = Point{std::min(bottom_right.x, width_ - 1), std::min(bottom_right.y, height_ - 1)};
+    }
+
+    void PNGImage::reset_clip()
+    {
+        set_clip(Point{0, 0}, Point{width_ - 1, height_ - 1});
+    }
+
+    void PNGImage::fill_span(int y, int x0, int x1, const Color &c)
     {
-        //  Bresenham Algorithm.
-        int x_from = a.x;
-        int y_from = a.y;
-        int x_to = b.x;
-        int y_to = b.y;
-        int dy = y_to - y_from;
-        int dx = x_to - x_from;
-        int step_x = 1, step_y = 1;
-        if (dy < 0)
+        if (!clip_span(y, x0, x1))
         {
-            dy = -dy;
-            step_y = -1;
+            return;
         }
-        if (dx < 0)
+        mark_dirty(y, y);
+        paint_span(y, x0, x1, c);
+    }
+
+    void PNGImage::paint_span(int y, int x0, int x1, const Color &c)
+    {
+        Color *row = pixels_ + (size_t)y * width_;
+        if (coverage_.empty())
         {
-            dx = -dx;
-            step_x = -1;
+            std::fill(row + x0, row + x1 + 1, c);
+            return;
         }
-        dy *= 2;
-        dx *= 2;
-        at(x_from, y_from) = c;
-        if (dx > dy)
+        // Occlusion: only paint pixels not covered yet, one mask word at a time.
+        uint64_t *mask = &coverage_[(size_t)y * coverage_words_];
+        for (int w = x0 >> 6; w <= (x1 >> 6); w++)
         {
-            int fraction = dy - (dx / 2);
-            while (x_from != x_to)
+            int lo = std::max(x0, w << 6) & 63;
+            int hi = std::min(x1, (w << 6) + 63) & 63;
+            uint64_t bits = (~(uint64_t)0 >> (63 - hi)) & (~(uint64_t)0 << lo);
+            uint64_t todo = bits & ~mask[w];
+            if (todo == bits)
+            {
+                std::fill(row + (w << 6) + lo, row + (w << 6) + hi + 1, c);
+            }
+            else
             {
-                if (fraction >= 0)
+                while (todo != 0)
                 {
-                    y_from += step_y;
-                    fraction -= dx;
+                    row[(w << 6) + __builtin_ctzll(todo)] = c;
+                    todo &= todo - 1;
                 }
-                x_from += step_x;
-                fraction += dy;
-                at(x_from, y_from) = c;
             }
+            mask[w] |= bits;
         }
-        else
+    }
+
+    void PNGImage::blend_span(int y, int x0, int x1, const Color &c, rgb_value alpha)
+    {
+        if (!clip_span(y, x0, x1))
+        {
+            return;
+        }
+        mark_dirty(y, y);
+        svg::blend_span(pixels_ + (size_t)y * width_ + x0, x1 - x0 + 1, c, alpha);
+    }
+
+    void PNGImage::set_alpha(rgb_value alpha)
+    {
+        alpha_ = alpha;
+    }
+
+    void PNGImage::begin_layer(const Point &top_left, const Point &bottom_right)
+    {
+        Layer layer = {Point{std::max(top_left.x, clip_min_.x), std::max(top_left.y, clip_min_.y)},
+                       Point{std::min(bottom_right.x, clip_max_.x), std::min(bottom_right.y, clip_max_.y)},
+                       std::vector<Color>()};
+        int w = layer.bottom_right.x - layer.top_left.x + 1;
+        int h = layer.bottom_right.y - layer.top_left.y + 1;
+        if (w > 0 && h > 0)
         {
-            int fraction = dx - (dy >> 1);
-            while (y_from != y_to)
+            layer.below.resize((size_t)w * h);
+            for (int y = 0; y < h; y++)
             {
-                if (fraction >= 0)
+                const Color *row = pixels_ + (size_t)(layer.top_left.y + y) * width_ + layer.top_left.x;
+                std::copy(row, row + w, layer.below.begin() + (size_t)y * w);
+            }
+        }
+        layers_.push_back(std::move(layer));
+    }
+
+    void PNGImage::end_layer(rgb_value alpha)
+    {
+        assert(!layers_.empty());
+        const Layer &layer = layers_.back();
+        if (!layer.below.empty())
+        {
+            int w = layer.bottom_right.x - layer.top_left.x + 1;
+            for (int y = layer.top_left.y; y <= layer.bottom_right.y; y++)
+            {
+                blend_pixels(pixels_ + (size_t)y * width_ + layer.top_left.x,
+                             layer.below.data() + (size_t)(y - layer.top_left.y) * w, w, alpha);
+            }
+        }
+        layers_.pop_back();
+    }
+
+    void PNGImage::set_antialias(bool enabled)
+    {
+        antialias_ = enabled;
+    }
+
+    void PNGImage::set_parallel_fill(size_t min_vertices, size_t min_area)
+    {
+        parallel_min_vertices_ = min_vertices;
+        parallel_min_area_ = min_area;
+    }
+
+    void PNGImage::set_occlusion(bool enabled)
+    {
+        coverage_words_ = enabled ? (width_ + 63) / 64 : 0;
+        coverage_.assign((size_t)coverage_words_ * (enabled ? height_ : 0), 0);
+    }
+
+    bool PNGImage::covered(const Point &top_left, const Point &bottom_right) const
+    {
+        int x0 = std::max(top_left.x, 0), x1 = std::min(bottom_right.x, width_ - 1);
+        int y0 = std::max(top_left.y, 0), y1 = std::min(bottom_right.y, height_ - 1);
+        if (x0 > x1 || y0 > y1)
+        {
+            // Nothing inside the image.
+            return true;
+        }
+        if (coverage_.empty())
+        {
+            return false;
+        }
+        for (int y = y0; y <= y1; y++)
+        {
+            const uint64_t *mask = &coverage_[(size_t)y * coverage_words_];
+            for (int w = x0 >> 6; w <= (x1 >> 6); w++)
+            {
+                int lo = std::max(x0, w << 6) & 63;
+                int hi = std::min(x1, (w << 6) + 63) & 63;
+                uint64_t bits = (~(uint64_t)0 >> (63 - hi)) & (~(uint64_t)0 << lo);
+                if ((mask[w] & bits) != bits)
                 {
-                    x_from += step_x;
-                    fraction -= dy;
+                    return false;
                 }
-                y_from += step_y;
-                fraction += dx;
-                at(x_from, y_from) = c;
             }
         }
+        return true;
     }
 
-    void PNGImage::draw_polygon(const std::vector<Point> &points, const Color &c)
+    namespace
     {
-        int x_min = width(), x_max = 0, y_min = height(), y_max = 0;
-        for (const Point &p : points)
+        //! Paints the spans of one shape in a solid color. Opaque spans
+        //! are painted straight away; translucent ones are collected, and
+        //! finish blends their union, so that each pixel is blended once.
+        class SolidPlot
         {
-            x_min = std::min(x_min, p.x);
-            x_max = std::max(x_max, p.x);
-            y_min = std::min(y_min, p.y);
-            y_max = std::max(y_max, p.y);
-        }
+        public:
+            SolidPlot(PNGImage &img, const Color &color, rgb_value alpha)
+                : img(img), color(color), alpha(alpha) {}
+            void span(int y, int x0, int x1)
+            {
+                if (alpha == OPAQUE_ALPHA)
+                {
+                    img.fill_span(y, x0, x1, color);
+                }
+                else
+                {
+                    spans.span(y, x0, x1);
+                }
+            }
+            void finish()
+            {
+                struct BlendPlot
+                {
+                    PNGImage &img;
+                    const Color &color;
+                    rgb_value alpha;
+                    void span(int y, int x0, int x1)
+                    {
+                        img.blend_span(y, x0, x1, color, alpha);
+                    }
+                };
+                BlendPlot blend_plot = {img, color, alpha};
+                spans.flush(blend_plot);
+            }
 
-        std::vector<double> seg;
-        for (int y = y_min; y < y_max; y++)
+        private:
+            PNGImage &img;
+            const Color &color;
+            rgb_value alpha;
+            SpanList spans;
+        };
+    }
+
+    namespace
+    {
+        //! Paints the coverage spans of an anti-aliased shape: solid inside,
+        //! blended along the edges.
+        struct CoveragePlot
         {
-            for (size_t i = 0; i < points.size(); i++)
+            PNGImage &img;
+            const Color &color;
+            rgb_value alpha;
+            void span(int y, int x0, int x1, uint8_t coverage)
             {
-                Point a = points[i];
-                Point b = points[(i + 1) % points.size()];
-                if (y < std::min(a.y, b.y) || y > std::max(a.y, b.y))
+                unsigned a = coverage == 255 ? alpha : (alpha * coverage + 127) / 255;
+                if (a == OPAQUE_ALPHA)
                 {
-                    continue;
+                    img.fill_span(y, x0, x1, color);
                 }
-                if (a.y != b.y)
+                else if (a != 0)
                 {
-                    double x_inters = (double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y) + a.x;
-                    seg.push_back(x_inters);
+                    img.blend_span(y, x0, x1, color, (rgb_value)a);
                 }
             }
-            std::sort(seg.begin(), seg.end());
-            size_t i_s = 0;
-            while ((i_s + 1) < seg.size())
+        };
+    }
+
+    void PNGImage::draw_line(const Point &a, const Point &b, const Color &c)
+    {
+        SolidPlot plot(*this, c, alpha_);
+        raster_line(a, b, plot);
+        plot.finish();
+    }
+
+    void PNGImage::downsample(const PNGImage &src, const Point &top_left, int factor)
+    {
+        assert(factor >= 1);
+        // Source columns of the output, and the part of them inside src
+        int x_begin = top_left.x, x_end = top_left.x + width_ * factor;
+        int in_begin = std::max(x_begin, 0), in_end = std::min(x_end, src.width_);
+        size_t line_bytes = (size_t)width_ * factor * sizeof(Color);
+        std::vector<uint32_t> sums(line_bytes);
+        std::vector<unsigned char> line(line_bytes);
+        uint32_t area = (uint32_t)factor * factor;
+        for (int y = 0; y < height_; y++)
+        {
+            std::fill(sums.begin(), sums.end(), 0);
+            for (int k = 0; k < factor; k++)
             {
-                Point a = {(int)round(seg.at(i_s)), y};
-                Point b = {(int)round(seg.at(i_s + 1)), y};
-                if (a.x == b.x)
+                int sy = top_left.y + y * factor + k;
+                const unsigned char *in = line.data();
+                if (sy < 0 || sy >= src.height_ || in_begin >= in_end)
+                {
+                    ::memset(line.data(), 0xFF, line_bytes);
+                }
+                else if (in_begin == x_begin && in_end == x_end)
                 {
-                    i_s++;
+                    in = (const unsigned char *)(src.pixels_ + (size_t)sy * src.width_ + x_begin);
                 }
                 else
                 {
-                    draw_line(a, b, c);
-                    i_s += 2;
+                    ::memset(line.data(), 0xFF, line_bytes);
+                    ::memcpy(line.data() + (size_t)(in_begin - x_begin) * sizeof(Color),
+                             src.pixels_ + (size_t)sy * src.width_ + in_begin,
+                             (size_t)(in_end - in_begin) * sizeof(Color));
+                }
+                // Channel-wise over the whole line, so the compiler can vectorize it
+                uint32_t *sum = sums.data();
+                for (size_t i = 0; i < line_bytes; i++)
+                {
+                    sum[i] += in[i];
                 }
             }
-            seg.clear();
-        }
-        for (size_t i = 0; i < points.size(); i++)
-        {
-            draw_line(points[i], points[(i + 1) % points.size()], c);
+            Color *out = pixels_ + (size_t)y * width_;
+            const uint32_t *block = sums.data();
+            for (int x = 0; x < width_; x++)
+            {
+                uint32_t r = 0, g = 0, b = 0;
+                for (int j = 0; j < factor; j++, block += 3)
+                {
+                    r += block[0];
+                    g += block[1];
+                    b += block[2];
+                }
+                out[x] = Color{(rgb_value)((r + area / 2) / area),
+                               (rgb_value)((g + area / 2) / area),
+                               (rgb_value)((b + area / 2) / area)};
+            }
         }
+        mark_dirty(0, height_ - 1);
     }
 
-    void PNGImage::draw_ellipse(const Point &center, const Point &radius, const Color &fill)
+    template <class Iterator>
+    void PNGImage::draw_polygon_points(Iterator first, size_t count, const Color &c)
     {
-        draw_line(center.translate({-radius.x, 0}),
-                  center.translate({+radius.x, 0}),
-                  fill);
-        int x0 = radius.x;
-        int dx = 0;
-        for (int y = 1; y <= radius.y; y++)
+        if (antialias_)
+        {
+            mask_.clear();
+            mask_.add_contour(first, count);
+            CoveragePlot plot = {*this, c, alpha_};
+            mask_.render(clip_min_, clip_max_, plot);
+            return;
+        }
+        SolidPlot plot(*this, c, alpha_);
+        if (count == 0)
         {
-            double vy = (double)y / (double)radius.y;
-            vy *= vy;
-            int x1 = x0 - (dx - 1);
-            for (; x1 > 0; x1--)
+            return;
+        }
+        Point top_left = *first, bottom_right = *first;
+        Iterator it = first;
+        for (size_t i = 1; i < count; i++)
+        {
+            ++it;
+            top_left = Point{std::min(top_left.x, it->x), std::min(top_left.y, it->y)};
+            bottom_right = Point{std::max(bottom_right.x, it->x), std::max(bottom_right.y, it->y)};
+        }
+        // Rows of the scanline pass, [top_left.y, bottom_right.y), that are in the image
+        int y0 = std::max(top_left.y, 0);
+        int y1 = std::min(bottom_right.y, height_);
+        int x0 = std::max(top_left.x, 0);
+        int x1 = std::min(bottom_right.x, width_ - 1);
+        size_t area = (y0 < y1 && x0 <= x1) ? (size_t)(y1 - y0) * (size_t)(x1 - x0 + 1) : 0;
+        ThreadPool &pool = ThreadPool::global();
+        // Translucent polygons are blended from their merged spans, serially
+        if ((count < parallel_min_vertices_ && area < parallel_min_area_) || y1 - y0 < 2 ||
+            alpha_ != OPAQUE_ALPHA)
+        {
+            raster_polygon(first, count, plot);
+            plot.finish();
+            return;
+        }
+
+        std::vector<PolygonEdge> edges;
+        build_edge_table(first, count, edges);
+        // Bands only paint rows, so the dirty range is set once up front
+        mark_dirty(y0, y1 - 1);
+        struct BandPlot
+        {
+            PNGImage &img;
+            const Color &color;
+            void span(int y, int x0, int x1)
             {
-                double vx = (double)x1 / (double)radius.x;
-                vx *= vx;
-                if (vx + vy <= 1)
+                if (img.clip_span(y, x0, x1))
                 {
-                    break;
+                    img.paint_span(y, x0, x1, color);
                 }
             }
-            dx = x0 - x1;
-            x0 = x1;
-            draw_line(center.translate({-x0, -y}),
-                      center.translate({+x0, -y}),
-                      fill);
-            draw_line(center.translate({-x0, +y}),
-                      center.translate({+x0, +y}),
-                      fill);
+        };
+        size_t rows = y1 - y0;
+        size_t bands = std::min(rows, (size_t)pool.size() * 4);
+        pool.run(bands, [&](size_t band)
+                 {
+                     BandPlot band_plot = {*this, c};
+                     raster_edge_rows(edges, y0 + (int)(rows * band / bands),
+                                      y0 + (int)(rows * (band + 1) / bands), band_plot);
+                 });
+        auto outline = [&plot](const Point &a, const Point &b)
+        {
+            raster_line(a, b, plot);
+        };
+        for_each_edge(first, count, outline);
+    }
+
+    void PNGImage::draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c)
+    {
+        SolidPlot plot(*this, c, alpha_);
+        raster_stroke(points, count, style, plot);
+        plot.finish();
+    }
+
+    void PNGImage::draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c)
+    {
+        SolidPlot plot(*this, c, alpha_);
+        raster_stroke(points.begin(), points.size(), style, plot);
+        plot.finish();
+    }
+
+    void PNGImage::draw_polygon(const Point *points, size_t count, const Color &c)
+    {
+        draw_polygon_points(points, count, c);
+    }
+
+    void PNGImage::draw_polygon(const PackedPoints &points, const Color &c)
+    {
+        draw_polygon_points(points.begin(), points.size(), c);
+    }
+
+    void PNGImage::draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                             const Color &fill)
+    {
+        if (antialias_)
+        {
+            mask_.clear(rule);
+            for (size_t i = 0; i < contours; i++)
+            {
+                size_t begin = i > 0 ? ends[i - 1] : 0;
+                mask_.add_contour(points + begin, ends[i] - begin);
+            }
+            CoveragePlot plot = {*this, fill, alpha_};
+            mask_.render(clip_min_, clip_max_, plot);
+            return;
+        }
+        SolidPlot plot(*this, fill, alpha_);
+        raster_contours(points, ends, contours, rule, plot);
+        plot.finish();
+    }
+
+    void PNGImage::draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill)
+    {
+        if (antialias_)
+        {
+            mask_.clear();
+            mask_.add_ellipse(center, radius, degrees);
+            CoveragePlot plot = {*this, fill, alpha_};
+            mask_.render(clip_min_, clip_max_, plot);
+            return;
+        }
+        SolidPlot plot(*this, fill, alpha_);
+        raster_ellipse(center, radius, degrees, plot);
+        plot.finish();
+    }
+
+    void PNGImage::fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill)
+    {
+        int y0 = std::max(top_left.y, 0);
+        int y1 = std::min(bottom_right.y, height_ - 1);
+        for (int y = y0; y <= y1; y++)
+        {
+            if (alpha_ == OPAQUE_ALPHA)
+            {
+                fill_span(y, top_left.x, bottom_right.x, fill);
+            }
+            else
+            {
+                blend_span(y, top_left.x, bottom_right.x, fill, alpha_);
+            }
         }
     }
 
@@ -2,34 +2,62 @@
 #ifndef __svg_png_image_hpp__
 #define __svg_png_image_hpp__
 
+#include "Canvas.hpp"
 #include "Color.hpp"
+#include "Coverage.hpp"
 #include "Point.hpp"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 namespace svg
 {
+    class FramebufferPool;
+
     //! PNG image.
-    class PNGImage
+    class PNGImage : public Canvas
     {
     public:
+        //! Default number of vertices from which polygons are filled in parallel.
+        static const size_t PARALLEL_FILL_VERTICES = 4096;
+        //! Default on-canvas bounding box area, in pixels, from which polygons are filled in parallel.
+        static const size_t PARALLEL_FILL_AREA = (size_t)1 << 22;
+
         //! Constructor that loads image from a file.
+        //! The format is that of the file extension (see ImageFormat).
         //! @param png_file_name File name.
         PNGImage(const std::string &png_file_name);
-        //! Constructor of blank image.
+        //! Constructor that loads a headerless raw RGB file.
+        //! @param raw_file_name File name.
+        //! @param w Image width.
+        //! @param h Image height.
+        PNGImage(const std::string &raw_file_name, int w, int h);
+        //! Constructor of blank image, borrowing its pixels from the global framebuffer pool.
         //! Initally, all pixels will be white.
         //! @param w Image width.
         //! @param h Image height.
         PNGImage(int w, int h);
+        //! Constructor of blank image, borrowing its pixels from a framebuffer pool.
+        //! Initally, all pixels will be white.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param pool Pool the pixels are borrowed from and returned to.
+        PNGImage(int w, int h, FramebufferPool &pool);
+        //! Constructor of image over a caller-provided buffer.
+        //! The buffer is neither copied, cleared nor freed.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param pixels Row-major buffer of w * h pixels.
+        PNGImage(int w, int h, Color *pixels);
         //! Destructor.
         ~PNGImage();
         //! Get image width.
         //! @return The image width.
-        int width() const;
+        int width() const override;
         //! Get image height.
         //! @return The image height.
-        int height() const;
+        int height() const override;
         //! Get mutable reference to image pixel.
         //! @param x X position
         //! @param y Y position.
@@ -40,32 +68,191 @@ namespace svg
         //! @param y Y position.
         //! @return Reference to pixel.
         Color at(int x, int y) const;
+        //! Reset all pixels to white, so the image can be reused.
+        //! Only rows written since the last clear are touched.
+        void clear();
+        using Canvas::save;
         //! Save to output file.
         //! @param png_file_name Output file name.
-        void save(const std::string &png_file_name) const;
+        //! @param format File format; PPM, PAM and raw files are written straight from the pixels.
+        void save(const std::string &png_file_name, ImageFormat format) const override;
+        //! Encode as PNG into memory.
+        //! @param png_data Receives the PNG bytes.
+        void encode(std::vector<unsigned char> &png_data) const;
+        //! Paint a horizontal run of pixels, clipped to the image.
+        //! @param y Row.
+        //! @param x0 First column.
+        //! @param x1 Last column (inclusive).
+        //! @param c Color.
+        void fill_span(int y, int x0, int x1, const Color &c);
+        //! Composite a constant color over a horizontal run of pixels, clipped to the image.
+        //! Occlusion mode does not apply: only opaque shapes can hide others.
+        //! @param y Row.
+        //! @param x0 First column.
+        //! @param x1 Last column (inclusive).
+        //! @param c Color.
+        //! @param alpha Opacity of c.
+        void blend_span(int y, int x0, int x1, const Color &c, rgb_value alpha);
+        //! Set the opacity of the shapes drawn next.
+        //! @param alpha Opacity, from 0 to 255 (opaque).
+        void set_alpha(rgb_value alpha) override;
+        //! Start a layer, saving the pixels of its area (clipped) until end_layer.
+        //! @param top_left Top-left corner of the area drawn in the layer.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        void begin_layer(const Point &top_left, const Point &bottom_right) override;
+        //! Composite the pixels of the last layer over the saved ones.
+        //! @param alpha Opacity of the layer.
+        void end_layer(rgb_value alpha) override;
+        //! Enable or disable occlusion mode.
+        //! In occlusion mode a pixel is only painted the first time it is
+        //! drawn, so elements drawn in reverse order produce the same image
+        //! as the painter's order. Enabling it resets the coverage.
+        //! @param enabled Whether to track coverage.
+        void set_occlusion(bool enabled);
+        //! Enable or disable anti-aliasing of filled shapes.
+        //! Polygons, paths and ellipses are then painted at the exact
+        //! fraction of each pixel they cover (see CoverageMask), instead of
+        //! filling the pixels whose center is inside and their outline.
+        //! Rectangles are unchanged; lines and strokes stay aliased.
+        //! @param enabled Whether to anti-alias.
+        void set_antialias(bool enabled);
+        //! Set when draw_polygon fills a polygon in parallel.
+        //! Such polygons have their rows split in bands, filled concurrently on
+        //! the global thread pool from a shared edge table; the outline is then
+        //! drawn serially. The result is identical to a serial fill.
+        //! @param min_vertices Polygons with at least this many vertices are filled in parallel.
+        //! @param min_area So are polygons whose bounding box covers at least this many pixels of the image.
+        void set_parallel_fill(size_t min_vertices, size_t min_area);
+        //! Restrict drawing to a rectangle.
+        //! Every drawing function, and fill_span, leaves pixels outside it untouched.
+        //! @param top_left Top-left corner.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        void set_clip(const Point &top_left, const Point &bottom_right);
+        //! Allow drawing on the whole image again.
+        void reset_clip();
+        //! Check if a rectangle is entirely covered in occlusion mode.
+        //! Rectangles fully outside the image count as covered.
+        //! @param top_left Top-left corner.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        //! @return Whether drawing inside the rectangle has no effect.
+        bool covered(const Point &top_left, const Point &bottom_right) const;
         //! Draw a line defined by 2 points.
         //! @param a First point.
         //! @param b Second point.
         //! @param c Color to use for the line.
-        void draw_line(const Point &a, const Point &b, const Color &c);
+        void draw_line(const Point &a, const Point &b, const Color &c) override;
+        //! Draw a polyline as a wide stroke, with joins and caps.
+        //! @param points First point.
+        //! @param count Number of points.
+        //! @param style Stroke geometry.
+        //! @param c Color to use for the stroke.
+        void draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c) override;
+        //! Draw a polyline as a wide stroke, decoding its points on the fly.
+        //! @param points Compressed points.
+        //! @param style Stroke geometry.
+        //! @param c Color to use for the stroke.
+        void draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c) override;
+        using Canvas::draw_polygon;
         //! Draw a polygon.
-        //! @param points Vector of points defining the polygon.
+        //! @param points First point of the polygon.
+        //! @param count Number of points.
         //! @param fill Color to use for the polygon fill.
-        void draw_polygon(const std::vector<Point> &points, const Color &fill);
+        void draw_polygon(const Point *points, size_t count, const Color &fill) override;
+        //! Draw a polygon, decoding its points on the fly.
+        //! @param points Compressed points of the polygon.
+        //! @param fill Color to use for the polygon fill.
+        void draw_polygon(const PackedPoints &points, const Color &fill) override;
+        //! Draw a path of several closed contours, filled as one shape.
+        //! @param points Points of all contours, one after the other.
+        //! @param ends End of each contour in points (one past its last point).
+        //! @param contours Number of contours.
+        //! @param rule Fill rule.
+        //! @param fill Color to use for the path fill.
+        void draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                       const Color &fill) override;
         //! Draw an ellipse.
         //! @param center Coordinates for the ellipse center.
-        //! @param radius Radius in X and Y axis.
+        //! @param radius Radius in X and Y axis, before rotation.
+        //! @param degrees Rotation about the center.
         //! @param fill Color to use for the ellipse fill.
-        //! @param orientation ellipse orientation.
-        void draw_ellipse(const Point &center, const Point &radius, const Color &fill);
+        void draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill) override;
+        //! Fill an axis-aligned rectangle, clipped to the image.
+        //! @param top_left Top-left corner.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        //! @param fill Fill color.
+        void fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill) override;
+        //! Fill the image with a box-filtered region of another image.
+        //! Pixel (x, y) is the rounded average of the factor x factor block
+        //! of src starting at top_left + factor * (x, y); pixels of the block
+        //! outside src count as white. With factor 1 this is a crop.
+        //! @param src Source image, usually larger.
+        //! @param top_left Source position of pixel (0, 0).
+        //! @param factor Reduction factor, at least 1.
+        void downsample(const PNGImage &src, const Point &top_left, int factor);
 
     private:
+        //! Get pixel without marking its row as dirty.
+        Color &pixel(int x, int y);
+        //! Mark rows as written.
+        //! @param y0 First row.
+        //! @param y1 Last row.
+        void mark_dirty(int y0, int y1);
+        //! Clip a span to the image and the clip rectangle.
+        //! @return False if nothing is left.
+        bool clip_span(int y, int &x0, int &x1) const;
+        //! Paint a clipped span, without marking its row as dirty.
+        //! Only touches row y, so different rows may be painted concurrently.
+        void paint_span(int y, int x0, int x1, const Color &c);
+        //! Draw a polygon, filling it in parallel if it is above the thresholds.
+        template <class Iterator>
+        void draw_polygon_points(Iterator first, size_t count, const Color &c);
+
         //! Width.
         int width_;
         //! Height.
         int height_;
         //! Pixels.
         Color *pixels_;
+        //! Whether pixels_ is freed by the destructor.
+        bool owned_;
+        //! Pool pixels_ was borrowed from, if any.
+        FramebufferPool *pool_;
+        //! Size of the borrowed buffer.
+        size_t capacity_;
+        //! Rows [dirty_top_, dirty_bottom_) may differ from white.
+        int dirty_top_;
+        //! End of the dirty rows.
+        int dirty_bottom_;
+        //! Occlusion mode coverage, one bit per pixel; empty when disabled.
+        std::vector<uint64_t> coverage_;
+        //! Coverage words per row.
+        int coverage_words_;
+        //! Top-left corner of the clip rectangle.
+        Point clip_min_;
+        //! Bottom-right corner of the clip rectangle (inclusive).
+        Point clip_max_;
+        //! Vertex threshold of parallel polygon fills.
+        size_t parallel_min_vertices_;
+        //! Area threshold of parallel polygon fills.
+        size_t parallel_min_area_;
+        //! Opacity of the shapes drawn next.
+        rgb_value alpha_;
+        //! Layer started by begin_layer.
+        struct Layer
+        {
+            //! Top-left corner of the saved area.
+            Point top_left;
+            //! Bottom-right corner of the saved area (inclusive).
+            Point bottom_right;
+            //! Saved pixels, row-major (empty if the area is).
+            std::vector<Color> below;
+        };
+        //! Layers started and not ended yet, innermost last.
+        std::vector<Layer> layers_;
+        //! Whether filled shapes are anti-aliased.
+        bool antialias_;
+        //! Edges and accumulation buffer of anti-aliased shapes, kept across draws.
+        CoverageMask mask_;
     };
 }
 
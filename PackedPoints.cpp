@@ -0,0 +1,135 @@
+//! @file PackedPoints.cpp
+#include "PackedPoints.hpp"
+
+namespace svg
+{
+    namespace
+    {
+        //! Append a signed difference as a zig-zag varint.
+        //! Differences wrap around like unsigned arithmetic, so any pair of ints encodes.
+        void put_delta(std::vector<uint8_t> &out, int from, int to)
+        {
+            uint32_t d = (uint32_t)to - (uint32_t)from;
+            uint32_t zz = (d << 1) ^ (uint32_t)-(int32_t)(d >> 31);
+            while (zz >= 0x80)
+            {
+                out.push_back((uint8_t)(zz | 0x80));
+                zz >>= 7;
+            }
+            out.push_back((uint8_t)zz);
+        }
+
+        //! Apply the next zig-zag varint to a coordinate.
+        inline int get_delta(const uint8_t *&p, int from)
+        {
+            uint32_t zz = *p++;
+            if (zz >= 0x80)
+            {
+                zz &= 0x7F;
+                int shift = 7;
+                uint32_t b;
+                do
+                {
+                    b = *p++;
+                    zz |= (b & 0x7F) << shift;
+                    shift += 7;
+                } while (b >= 0x80);
+            }
+            uint32_t d = (zz >> 1) ^ (uint32_t)-(int32_t)(zz & 1);
+            return (int)((uint32_t)from + d);
+        }
+    }
+
+    PackedPoints::const_iterator::const_iterator(const PackedPoints *owner, size_t i)
+        : owner_(owner), index_(i), data_(nullptr), point_{0, 0}
+    {
+        if (i < owner->size_)
+        {
+            const Block &block = owner->blocks_[i / BLOCK_POINTS];
+            point_ = block.first;
+            data_ = owner->data_.data() + block.offset;
+            for (size_t k = i % BLOCK_POINTS; k > 0; k--)
+            {
+                point_.x = get_delta(data_, point_.x);
+                point_.y = get_delta(data_, point_.y);
+            }
+        }
+    }
+
+    PackedPoints::const_iterator &PackedPoints::const_iterator::operator++()
+    {
+        if (++index_ >= owner_->size_)
+        {
+            return *this;
+        }
+        if (index_ % BLOCK_POINTS == 0)
+        {
+            // Blocks are contiguous, so only the first point needs the index
+            point_ = owner_->blocks_[index_ / BLOCK_POINTS].first;
+            return *this;
+        }
+        point_.x = get_delta(data_, point_.x);
+        point_.y = get_delta(data_, point_.y);
+        return *this;
+    }
+
+    PackedPoints::PackedPoints() : size_(0) {}
+
+    PackedPoints::PackedPoints(const Point *points, size_t count) : size_(count)
+    {
+        blocks_.reserve((count + BLOCK_POINTS - 1) / BLOCK_POINTS);
+        data_.reserve(2 * count);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i % BLOCK_POINTS == 0)
+            {
+                blocks_.push_back(Block{points[i], data_.size()});
+                continue;
+            }
+            put_delta(data_, points[i - 1].x, points[i].x);
+            put_delta(data_, points[i - 1].y, points[i].y);
+        }
+        data_.shrink_to_fit();
+    }
+
+    size_t PackedPoints::size() const
+    {
+        return size_;
+    }
+
+    size_t PackedPoints::bytes() const
+    {
+        return data_.capacity() + blocks_.capacity() * sizeof(Block);
+    }
+
+    Point PackedPoints::at(size_t i) const
+    {
+        return *const_iterator(this, i);
+    }
+
+    void PackedPoints::unpack(std::vector<Point> &points) const
+    {
+        points.assign(begin(), end());
+    }
+
+    void PackedPoints::translate(const Point &t)
+    {
+        for (Block &block : blocks_)
+        {
+            block.first = block.first.translate(t);
+        }
+    }
+
+    PackedPoints::const_iterator PackedPoints::begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    PackedPoints::const_iterator PackedPoints::end() const
+    {
+        const_iterator it;
+        it.owner_ = this;
+        it.index_ = size_;
+        return it;
+    }
+}
@@ -0,0 +1,118 @@
+//! @file PackedPoints.hpp
+#ifndef __svg_PackedPoints_hpp__
+#define __svg_PackedPoints_hpp__
+
+#include "Point.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace svg
+{
+    //! Compressed, read-mostly point sequence for very long point lists.
+    //! Points are split in blocks of BLOCK_POINTS. The block index keeps
+    //! the first point of each block and where its data starts; the other
+    //! points are stored as zig-zag varint deltas from their predecessor,
+    //! so neighbours a few pixels apart take 2 bytes instead of 8.
+    class PackedPoints
+    {
+    public:
+        //! Points per block of the index.
+        static const size_t BLOCK_POINTS = 64;
+
+        //! Forward iterator decoding points on the fly.
+        class const_iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef Point value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const Point *pointer;
+            typedef const Point &reference;
+
+            const_iterator() : owner_(nullptr), index_(0), data_(nullptr), point_{0, 0} {}
+            const Point &operator*() const
+            {
+                return point_;
+            }
+            const Point *operator->() const
+            {
+                return &point_;
+            }
+            const_iterator &operator++();
+            const_iterator operator++(int)
+            {
+                const_iterator copy = *this;
+                ++*this;
+                return copy;
+            }
+            bool operator==(const const_iterator &other) const
+            {
+                return index_ == other.index_;
+            }
+            bool operator!=(const const_iterator &other) const
+            {
+                return index_ != other.index_;
+            }
+
+        private:
+            friend class PackedPoints;
+            //! Iterator at point i.
+            const_iterator(const PackedPoints *owner, size_t i);
+
+            //! Sequence being decoded.
+            const PackedPoints *owner_;
+            //! Current point number.
+            size_t index_;
+            //! Deltas of the following points.
+            const uint8_t *data_;
+            //! Current point.
+            Point point_;
+        };
+
+        //! Constructor of an empty sequence.
+        PackedPoints();
+        //! Constructor compressing points.
+        //! @param points First point.
+        //! @param count Number of points.
+        PackedPoints(const Point *points, size_t count);
+        //! Get the number of points.
+        //! @return Number of points.
+        size_t size() const;
+        //! Get the memory used by the compressed points and the index.
+        //! @return Size in bytes.
+        size_t bytes() const;
+        //! Get a point, decoding from the start of its block.
+        //! @param i Point number.
+        //! @return Point.
+        Point at(size_t i) const;
+        //! Decompress all points.
+        //! @param points Receives the points.
+        void unpack(std::vector<Point> &points) const;
+        //! Translate all points. Only the block index changes.
+        //! @param t Translation.
+        void translate(const Point &t);
+        const_iterator begin() const;
+        const_iterator end() const;
+
+    private:
+        //! Entry of the block index.
+        struct Block
+        {
+            //! First point.
+            Point first;
+            //! Offset of the deltas of the remaining points.
+            size_t offset;
+        };
+
+        //! Number of points.
+        size_t size_;
+        //! Block index.
+        std::vector<Block> blocks_;
+        //! Varint deltas.
+        std::vector<uint8_t> data_;
+    };
+}
+#endif
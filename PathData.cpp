@@ -0,0 +1,375 @@
+//! @file PathData.cpp
+#include "PathData.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+namespace svg
+{
+    namespace
+    {
+        //! Deepest curve subdivision; 2^16 pieces is finer than any pixel grid.
+        const int MAX_DEPTH = 16;
+        //! Coordinates are clamped to this magnitude, so that the rasterizers
+        //! can take the difference of two and double it within int.
+        const double MAX_COORDINATE = 1 << 28;
+
+        //! Point with fractional coordinates.
+        struct Vec
+        {
+            double x;
+            double y;
+        };
+
+        Vec lerp(const Vec &a, const Vec &b, double t)
+        {
+            return Vec{a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+        }
+
+        //! Skip blanks and commas.
+        void skip_separators(const char *&p)
+        {
+            while (*p == ',' || std::isspace((unsigned char)*p))
+            {
+                p++;
+            }
+        }
+
+        //! Read a number.
+        //! @return False, leaving p unchanged, if there is none.
+        bool read_number(const char *&p, double &v)
+        {
+            skip_separators(p);
+            if (!std::isdigit((unsigned char)*p) && *p != '-' && *p != '+' && *p != '.')
+            {
+                return false;
+            }
+            char *end;
+            v = std::strtod(p, &end);
+            if (end == p || !std::isfinite(v))
+            {
+                return false;
+            }
+            p = end;
+            return true;
+        }
+
+        //! Read an arc flag, which needs no separator after it.
+        bool read_flag(const char *&p, bool &flag)
+        {
+            skip_separators(p);
+            if (*p != '0' && *p != '1')
+            {
+                return false;
+            }
+            flag = *p++ == '1';
+            return true;
+        }
+
+        //! Builds the contours while the path data is read.
+        class Flattener
+        {
+        public:
+            Flattener(std::vector<Point> &points, std::vector<size_t> &ends, double tolerance)
+                : points_(points), ends_(ends), begin_(points.size()),
+                  flatness_(16 * tolerance * tolerance) {}
+
+            //! Start a subpath.
+            void move_to(const Vec &p)
+            {
+                end_contour();
+                add(p);
+            }
+            //! Add a straight segment.
+            void line_to(const Vec &p)
+            {
+                add(p);
+            }
+            //! Add a cubic Bézier curve from the current point.
+            void cubic_to(const Vec &from, const Vec &c1, const Vec &c2, const Vec &to)
+            {
+                subdivide(from, c1, c2, to, 0);
+            }
+            //! Finish the current contour, if it has more than one point.
+            void end_contour()
+            {
+                if (points_.size() - begin_ >= 2)
+                {
+                    ends_.push_back(points_.size());
+                }
+                else
+                {
+                    points_.resize(begin_);
+                }
+                begin_ = points_.size();
+            }
+
+        private:
+            //! Append a point, unless it rounds to the previous one.
+            void add(const Vec &v)
+            {
+                Point p = {(int)std::lround(std::max(-MAX_COORDINATE, std::min(v.x, MAX_COORDINATE))),
+                           (int)std::lround(std::max(-MAX_COORDINATE, std::min(v.y, MAX_COORDINATE)))};
+                if (points_.size() > begin_ && points_.back().x == p.x && points_.back().y == p.y)
+                {
+                    return;
+                }
+                points_.push_back(p);
+            }
+            //! Split a cubic until its control points are within tolerance of the chord.
+            void subdivide(const Vec &p0, const Vec &p1, const Vec &p2, const Vec &p3, int depth)
+            {
+                double ux = 3 * p1.x - 2 * p0.x - p3.x, uy = 3 * p1.y - 2 * p0.y - p3.y;
+                double vx = 3 * p2.x - p0.x - 2 * p3.x, vy = 3 * p2.y - p0.y - 2 * p3.y;
+                double flatness = std::max(ux * ux, vx * vx) + std::max(uy * uy, vy * vy);
+                if (flatness <= flatness_ || depth >= MAX_DEPTH || !std::isfinite(flatness))
+                {
+                    add(p3);
+                    return;
+                }
+                // de Casteljau at t = 0.5
+                Vec p01 = lerp(p0, p1, 0.5), p12 = lerp(p1, p2, 0.5), p23 = lerp(p2, p3, 0.5);
+                Vec p012 = lerp(p01, p12, 0.5), p123 = lerp(p12, p23, 0.5);
+                Vec mid = lerp(p012, p123, 0.5);
+                subdivide(p0, p01, p012, mid, depth + 1);
+                subdivide(mid, p123, p23, p3, depth + 1);
+            }
+
+            std::vector<Point> &points_;
+            std::vector<size_t> &ends_;
+            //! Start of the current contour in points_.
+            size_t begin_;
+            //! Flatness bound of subdivide, 16 tolerance².
+            double flatness_;
+        };
+
+        //! Add an elliptical arc, as in the SVG implementation notes (F.6.5).
+        void arc_to(Flattener &out, const Vec &from, double rx, double ry, double angle,
+                    bool large_arc, bool sweep, const Vec &to)
+        {
+            rx = std::fabs(rx);
+            ry = std::fabs(ry);
+            if (rx == 0 || ry == 0 || (from.x == to.x && from.y == to.y))
+            {
+                out.line_to(to);
+                return;
+            }
+            double phi = angle * M_PI / 180.0;
+            double cos_phi = std::cos(phi), sin_phi = std::sin(phi);
+            // Endpoints in the frame of the ellipse axes
+            double dx = (from.x - to.x) / 2, dy = (from.y - to.y) / 2;
+            double x1 = cos_phi * dx + sin_phi * dy;
+            double y1 = -sin_phi * dx + cos_phi * dy;
+            // Radii too small to reach the end point are scaled up
+            double lambda = (x1 * x1) / (rx * rx) + (y1 * y1) / (ry * ry);
+            if (lambda > 1)
+            {
+                rx *= std::sqrt(lambda);
+                ry *= std::sqrt(lambda);
+            }
+            double num = rx * rx * ry * ry - rx * rx * y1 * y1 - ry * ry * x1 * x1;
+            double den = rx * rx * y1 * y1 + ry * ry * x1 * x1;
+            double k = std::sqrt(std::max(num, 0.0) / den);
+            if (large_arc == sweep)
+            {
+                k = -k;
+            }
+            double cx1 = k * rx * y1 / ry, cy1 = -k * ry * x1 / rx;
+            Vec center = {cos_phi * cx1 - sin_phi * cy1 + (from.x + to.x) / 2,
+                          sin_phi * cx1 + cos_phi * cy1 + (from.y + to.y) / 2};
+            double theta = std::atan2((y1 - cy1) / ry, (x1 - cx1) / rx);
+            double delta = std::atan2((-y1 - cy1) / ry, (-x1 - cx1) / rx) - theta;
+            if (sweep && delta < 0)
+            {
+                delta += 2 * M_PI;
+            }
+            else if (!sweep && delta > 0)
+            {
+                delta -= 2 * M_PI;
+            }
+            // Pieces of at most 90 degrees, each approximated by a cubic
+            int pieces = std::max((int)std::ceil(std::fabs(delta) / (M_PI / 2) - 1e-9), 1);
+            double step = delta / pieces;
+            double handle = 4.0 / 3.0 * std::tan(step / 4);
+            // Point at angle t, moved by h times the tangent
+            auto at = [&](double t, double h)
+            {
+                double ex = rx * (std::cos(t) - h * std::sin(t));
+                double ey = ry * (std::sin(t) + h * std::cos(t));
+                return Vec{center.x + cos_phi * ex - sin_phi * ey, center.y + sin_phi * ex + cos_phi * ey};
+            };
+            Vec p0 = from;
+            for (int i = 0; i < pieces; i++)
+            {
+                double t0 = theta + i * step, t1 = t0 + step;
+                Vec c1 = at(t0, handle);
+                Vec c2 = at(t1, -handle);
+                Vec p3 = (i + 1 == pieces) ? to : at(t1, 0);
+                out.cubic_to(p0, c1, c2, p3);
+                p0 = p3;
+            }
+        }
+    }
+
+    void parse_path_data(const char *d, std::vector<Point> &points, std::vector<size_t> &ends, double tolerance)
+    {
+        if (d == nullptr)
+        {
+            return;
+        }
+        Flattener out(points, ends, tolerance);
+        Vec current = {0, 0}, start = {0, 0};
+        // Control point reflected by S and T, and whether it applies
+        Vec control = {0, 0};
+        char previous = 0;
+        char command = 0;
+        // After Z, drawing resumes from the start of the closed subpath
+        bool open = false;
+        const char *p = d;
+        for (;;)
+        {
+            skip_separators(p);
+            if (*p == '\0')
+            {
+                break;
+            }
+            if (std::isalpha((unsigned char)*p))
+            {
+                command = *p++;
+                if (previous == 0 && command != 'M' && command != 'm')
+                {
+                    // Path data starts with a move
+                    break;
+                }
+                if (command == 'Z' || command == 'z')
+                {
+                    out.end_contour();
+                    current = start;
+                    open = false;
+                    previous = 'Z';
+                    continue;
+                }
+            }
+            else if (command == 0 || command == 'Z' || command == 'z')
+            {
+                break;
+            }
+            bool relative = std::islower((unsigned char)command);
+            char upper = (char)std::toupper((unsigned char)command);
+            Vec base = relative ? current : Vec{0, 0};
+            if (upper != 'M' && !open)
+            {
+                out.move_to(current);
+                open = true;
+            }
+            double v[7];
+            bool flags[2];
+            bool ok = true;
+            switch (upper)
+            {
+            case 'M':
+                ok = read_number(p, v[0]) && read_number(p, v[1]);
+                if (ok)
+                {
+                    current = start = Vec{base.x + v[0], base.y + v[1]};
+                    out.move_to(current);
+                    open = true;
+                    // Further coordinate pairs are implicit line commands
+                    command = relative ? 'l' : 'L';
+                }
+                break;
+            case 'L':
+                ok = read_number(p, v[0]) && read_number(p, v[1]);
+                if (ok)
+                {
+                    current = Vec{base.x + v[0], base.y + v[1]};
+                    out.line_to(current);
+                }
+                break;
+            case 'H':
+                ok = read_number(p, v[0]);
+                if (ok)
+                {
+                    current.x = base.x + v[0];
+                    out.line_to(current);
+                }
+                break;
+            case 'V':
+                ok = read_number(p, v[0]);
+                if (ok)
+                {
+                    current.y = (relative ? current.y : 0) + v[0];
+                    out.line_to(current);
+                }
+                break;
+            case 'C':
+            case 'S':
+            {
+                Vec c1 = (previous == 'C' || previous == 'S')
+                             ? Vec{2 * current.x - control.x, 2 * current.y - control.y}
+                             : current;
+                if (upper == 'C')
+                {
+                    ok = read_number(p, v[0]) && read_number(p, v[1]);
+                    c1 = Vec{base.x + v[0], base.y + v[1]};
+                }
+                ok = ok && read_number(p, v[2]) && read_number(p, v[3]) &&
+                     read_number(p, v[4]) && read_number(p, v[5]);
+                if (ok)
+                {
+                    Vec c2 = {base.x + v[2], base.y + v[3]};
+                    Vec to = {base.x + v[4], base.y + v[5]};
+                    out.cubic_to(current, c1, c2, to);
+                    control = c2;
+                    current = to;
+                }
+                break;
+            }
+            case 'Q':
+            case 'T':
+            {
+                Vec q = (previous == 'Q' || previous == 'T')
+                            ? Vec{2 * current.x - control.x, 2 * current.y - control.y}
+                            : current;
+                if (upper == 'Q')
+                {
+                    ok = read_number(p, v[0]) && read_number(p, v[1]);
+                    q = Vec{base.x + v[0], base.y + v[1]};
+                }
+                ok = ok && read_number(p, v[2]) && read_number(p, v[3]);
+                if (ok)
+                {
+                    Vec to = {base.x + v[2], base.y + v[3]};
+                    // Degree elevation: the same curve as a cubic
+                    out.cubic_to(current, lerp(current, q, 2.0 / 3.0), lerp(to, q, 2.0 / 3.0), to);
+                    control = q;
+                    current = to;
+                }
+                break;
+            }
+            case 'A':
+                ok = read_number(p, v[0]) && read_number(p, v[1]) && read_number(p, v[2]) &&
+                     read_flag(p, flags[0]) && read_flag(p, flags[1]) &&
+                     read_number(p, v[3]) && read_number(p, v[4]);
+                if (ok)
+                {
+                    Vec to = {base.x + v[3], base.y + v[4]};
+                    arc_to(out, current, v[0], v[1], v[2], flags[0], flags[1], to);
+                    current = to;
+                }
+                break;
+            default:
+                ok = false;
+                break;
+            }
+            if (!ok)
+            {
+                break;
+            }
+            previous = upper;
+        }
+        out.end_contour();
+    }
+}
@@ -0,0 +1,31 @@
+//! @file PathData.hpp
+#ifndef __svg_PathData_hpp__
+#define __svg_PathData_hpp__
+
+#include "Point.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace svg
+{
+    //! Default flattening tolerance, in pixels.
+    const double PATH_TOLERANCE = 0.25;
+
+    //! Parse SVG path data and flatten it into closed contours.
+    //! All commands are supported (M, L, H, V, C, S, Q, T, A and Z, absolute
+    //! and relative). The data is read in a single pass, straight from the
+    //! string. Curves and arcs are split until every piece is within
+    //! tolerance of its chord, so straight parts cost one point and tight
+    //! curves get as many as they need. Each subpath becomes a contour,
+    //! closed or not, as fills close them; repeated points are dropped and
+    //! so are contours of a single point.
+    //! As in browsers, parsing stops at the first error, keeping what was read.
+    //! @param d Path data (nullptr for none).
+    //! @param points Receives the points of all contours, one after the other.
+    //! @param ends Receives the end of each contour in points (one past its last point).
+    //! @param tolerance Maximum distance between a curve and its flattening, in pixels.
+    void parse_path_data(const char *d, std::vector<Point> &points, std::vector<size_t> &ends,
+                         double tolerance = PATH_TOLERANCE);
+}
+#endif
@@ -0,0 +1,165 @@
+//! @file PickBuffer.cpp
+#include "PickBuffer.hpp"
+#include "ImageFormat.hpp"
+#include "Raster.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace svg
+{
+    namespace
+    {
+        //! Sets the current ID on the spans of a shape. IDs are not
+        //! blended, so overlapping spans need no merging.
+        struct PickPlot
+        {
+            PickBuffer &buffer;
+            void span(int y, int x0, int x1)
+            {
+                buffer.fill_span(y, x0, x1);
+            }
+        };
+    }
+
+    const uint32_t PickBuffer::NO_ELEMENT;
+
+    PickBuffer::PickBuffer(int w, int h)
+        : width_(w), height_(h), ids_((size_t)w * h, NO_ELEMENT), id_(NO_ELEMENT), visible_(true)
+    {
+        assert(w > 0 && h > 0);
+    }
+
+    int PickBuffer::width() const
+    {
+        return width_;
+    }
+
+    int PickBuffer::height() const
+    {
+        return height_;
+    }
+
+    uint32_t PickBuffer::at(int x, int y) const
+    {
+        assert(x >= 0 && x < width_ && y >= 0 && y < height_);
+        return ids_[(size_t)y * width_ + x];
+    }
+
+    void PickBuffer::set_id(uint32_t id)
+    {
+        id_ = id;
+    }
+
+    void PickBuffer::clear()
+    {
+        std::fill(ids_.begin(), ids_.end(), NO_ELEMENT);
+    }
+
+    void PickBuffer::save(const std::string &file_name, ImageFormat format) const
+    {
+        std::vector<Color> pixels(ids_.size());
+        for (size_t i = 0; i < ids_.size(); i++)
+        {
+            uint32_t id = ids_[i];
+            pixels[i] = Color{(rgb_value)(id >> 16), (rgb_value)(id >> 8), (rgb_value)id};
+        }
+        write_image(file_name, format, pixels.data(), width_, height_);
+    }
+
+    void PickBuffer::fill_span(int y, int x0, int x1)
+    {
+        if (!visible_ || y < 0 || y >= height_)
+        {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, width_ - 1);
+        if (x0 <= x1)
+        {
+            uint32_t *row = &ids_[(size_t)y * width_];
+            std::fill(row + x0, row + x1 + 1, id_);
+        }
+    }
+
+    void PickBuffer::set_alpha(rgb_value alpha)
+    {
+        visible_ = alpha != 0;
+    }
+
+    void PickBuffer::begin_layer(const Point &top_left, const Point &bottom_right)
+    {
+        int top = std::max(top_left.y, 0);
+        int bottom = std::min(bottom_right.y, height_ - 1);
+        Layer layer = {top, std::vector<uint32_t>()};
+        if (std::max(top_left.x, 0) <= std::min(bottom_right.x, width_ - 1) && top <= bottom)
+        {
+            layer.below.assign(ids_.begin() + (size_t)top * width_, ids_.begin() + (size_t)(bottom + 1) * width_);
+        }
+        layers_.push_back(std::move(layer));
+    }
+
+    void PickBuffer::end_layer(rgb_value alpha)
+    {
+        assert(!layers_.empty());
+        const Layer &layer = layers_.back();
+        if (alpha == 0)
+        {
+            std::copy(layer.below.begin(), layer.below.end(), ids_.begin() + (size_t)layer.top * width_);
+        }
+        layers_.pop_back();
+    }
+
+    void PickBuffer::draw_line(const Point &a, const Point &b, const Color &)
+    {
+        PickPlot plot = {*this};
+        raster_line(a, b, plot);
+    }
+
+    void PickBuffer::draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &)
+    {
+        PickPlot plot = {*this};
+        raster_stroke(points, count, style, plot);
+    }
+
+    void PickBuffer::draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &)
+    {
+        PickPlot plot = {*this};
+        raster_stroke(points.begin(), points.size(), style, plot);
+    }
+
+    void PickBuffer::draw_polygon(const Point *points, size_t count, const Color &)
+    {
+        PickPlot plot = {*this};
+        raster_polygon(points, count, plot);
+    }
+
+    void PickBuffer::draw_polygon(const PackedPoints &points, const Color &)
+    {
+        PickPlot plot = {*this};
+        raster_polygon(points.begin(), points.size(), plot);
+    }
+
+    void PickBuffer::draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                               const Color &)
+    {
+        PickPlot plot = {*this};
+        raster_contours(points, ends, contours, rule, plot);
+    }
+
+    void PickBuffer::draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &)
+    {
+        PickPlot plot = {*this};
+        raster_ellipse(center, radius, degrees, plot);
+    }
+
+    void PickBuffer::fill_rect(const Point &top_left, const Point &bottom_right, const Color &)
+    {
+        int y0 = std::max(top_left.y, 0);
+        int y1 = std::min(bottom_right.y, height_ - 1);
+        for (int y = y0; y <= y1; y++)
+        {
+            fill_span(y, top_left.x, bottom_right.x);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+//! @file PickBuffer.hpp
+#ifndef __svg_PickBuffer_hpp__
+#define __svg_PickBuffer_hpp__
+
+#include "Canvas.hpp"
+#include "Color.hpp"
+#include "Point.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Canvas storing, for each pixel, the ID of the topmost element drawn
+    //! there, for hit-testing: what is under a point is then a single read.
+    //! Shapes are rasterized as in PNGImage, so an element is hit exactly
+    //! on the pixels it paints. Colors are ignored; any opacity above 0
+    //! counts as a hit.
+    class PickBuffer : public Canvas
+    {
+    public:
+        //! ID of pixels where nothing was drawn.
+        static const uint32_t NO_ELEMENT = 0;
+
+        //! Constructor of empty buffer.
+        //! @param w Width.
+        //! @param h Height.
+        PickBuffer(int w, int h);
+        int width() const override;
+        int height() const override;
+        //! Get the ID of a pixel.
+        //! @param x X position
+        //! @param y Y position.
+        //! @return ID of the topmost element drawn there, or NO_ELEMENT.
+        uint32_t at(int x, int y) const;
+        //! Set the ID of the shapes drawn next.
+        //! @param id Element ID, not NO_ELEMENT.
+        void set_id(uint32_t id);
+        //! Reset all pixels to NO_ELEMENT, so the buffer can be reused.
+        void clear();
+        using Canvas::save;
+        //! Save the IDs as an image, the low 24 bits of each as RGB.
+        //! @param file_name Output file name.
+        //! @param format File format.
+        void save(const std::string &file_name, ImageFormat format) const override;
+        //! Set the ID of a horizontal run of pixels, clipped to the buffer.
+        //! @param y Row.
+        //! @param x0 First column.
+        //! @param x1 Last column (inclusive).
+        void fill_span(int y, int x0, int x1);
+        void set_alpha(rgb_value alpha) override;
+        //! Start a layer, saving the IDs of its rows until end_layer.
+        //! @param top_left Top-left corner of the area drawn in the layer.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        void begin_layer(const Point &top_left, const Point &bottom_right) override;
+        //! End a layer; an invisible one (alpha 0) gets the saved IDs back.
+        //! @param alpha Opacity of the layer.
+        void end_layer(rgb_value alpha) override;
+        void draw_line(const Point &a, const Point &b, const Color &c) override;
+        void draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c) override;
+        void draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c) override;
+        using Canvas::draw_polygon;
+        void draw_polygon(const Point *points, size_t count, const Color &fill) override;
+        void draw_polygon(const PackedPoints &points, const Color &fill) override;
+        void draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                       const Color &fill) override;
+        void draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill) override;
+        void fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill) override;
+
+    private:
+        //! Width.
+        int width_;
+        //! Height.
+        int height_;
+        //! IDs, row-major.
+        std::vector<uint32_t> ids_;
+        //! ID of the shapes drawn next.
+        uint32_t id_;
+        //! Whether the shapes drawn next are visible (opacity above 0).
+        bool visible_;
+        //! Layer started by begin_layer.
+        struct Layer
+        {
+            //! First saved row.
+            int top;
+            //! Saved rows, whole (empty if the area is).
+            std::vector<uint32_t> below;
+        };
+        //! Layers started and not ended yet, innermost last.
+        std::vector<Layer> layers_;
+    };
+}
+#endif
@@ -0,0 +1,306 @@
+//! @file PixelFormat.hpp
+#ifndef __svg_PixelFormat_hpp__
+#define __svg_PixelFormat_hpp__
+
+#include "BlendKernels.hpp"
+#include "Color.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace svg
+{
+    //! Pixel formats a document can be rendered to.
+    enum class PixelFormat
+    {
+        //! 8-bit RGB, white background (PNGImage, SpanImage).
+        RGB,
+        //! 8-bit RGBA, transparent background.
+        RGBA,
+        //! 8-bit grayscale (luma), white background.
+        GRAY,
+        //! One bit per pixel, set where any shape was drawn.
+        MASK
+    };
+
+    //! Get a pixel format from its name (rgb, rgba, gray or mask).
+    //! @param name Format name.
+    //! @param format Receives the format.
+    //! @return False if the name is unknown.
+    bool parse_pixel_format(const std::string &name, PixelFormat &format);
+
+    //! Pixel format policies of FormatImage.
+    //! Each one says how a row of pixels is stored (as Units), how a shape
+    //! color becomes a Pixel, and how runs of pixels are filled, blended,
+    //! composited and encoded. They are static members, so every drawing
+    //! function of a FormatImage is compiled for its format: there is no
+    //! branch on the format per pixel, or even per span.
+
+    //! 8-bit RGB, the pixels of PNGImage.
+    struct RGBPixels
+    {
+        typedef Color Pixel;
+        typedef Color Unit;
+        //! Channels of the encoded PNG.
+        static const int CHANNELS = 3;
+        static size_t units(int width)
+        {
+            return width;
+        }
+        static Pixel background()
+        {
+            return Color{255, 255, 255};
+        }
+        static Pixel convert(const Color &c)
+        {
+            return c;
+        }
+        static Pixel get(const Unit *row, int x)
+        {
+            return row[x];
+        }
+        static void fill(Unit *row, int x0, int x1, const Pixel &p)
+        {
+            std::fill(row + x0, row + x1 + 1, p);
+        }
+        static void blend(Unit *row, int x0, int x1, const Pixel &p, rgb_value alpha)
+        {
+            blend_span(row + x0, x1 - x0 + 1, p, alpha);
+        }
+        static void composite(Unit *row, const Unit *below, int x0, int x1, rgb_value alpha)
+        {
+            blend_pixels(row + x0, below + x0, x1 - x0 + 1, alpha);
+        }
+        static Color color(const Unit *row, int x)
+        {
+            return row[x];
+        }
+        static void encode(const Unit *row, int width, unsigned char *out)
+        {
+            std::memcpy(out, row, (size_t)width * 3);
+        }
+    };
+
+    //! 8-bit RGBA, stored premultiplied: compositing is then the same
+    //! blend on all four channels, exact as in RGBPixels, and a pixel over
+    //! white is just p + 255 - alpha. Encoded PNGs are straight alpha.
+    struct RGBAPixels
+    {
+        struct Pixel
+        {
+            rgb_value red;
+            rgb_value green;
+            rgb_value blue;
+            rgb_value alpha;
+        };
+        typedef Pixel Unit;
+        static const int CHANNELS = 4;
+        static size_t units(int width)
+        {
+            return width;
+        }
+        static Pixel background()
+        {
+            return Pixel{0, 0, 0, 0};
+        }
+        static Pixel convert(const Color &c)
+        {
+            return Pixel{c.red, c.green, c.blue, 255};
+        }
+        static Pixel get(const Unit *row, int x)
+        {
+            return row[x];
+        }
+        static void fill(Unit *row, int x0, int x1, const Pixel &p)
+        {
+            std::fill(row + x0, row + x1 + 1, p);
+        }
+        static void blend(Unit *row, int x0, int x1, const Pixel &p, rgb_value alpha)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                Unit &u = row[x];
+                u = Pixel{blend_channel(u.red, p.red, alpha), blend_channel(u.green, p.green, alpha),
+                          blend_channel(u.blue, p.blue, alpha), blend_channel(u.alpha, p.alpha, alpha)};
+            }
+        }
+        static void composite(Unit *row, const Unit *below, int x0, int x1, rgb_value alpha)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                Unit &u = row[x];
+                const Unit &b = below[x];
+                u = Pixel{blend_channel(b.red, u.red, alpha), blend_channel(b.green, u.green, alpha),
+                          blend_channel(b.blue, u.blue, alpha), blend_channel(b.alpha, u.alpha, alpha)};
+            }
+        }
+        static Color color(const Unit *row, int x)
+        {
+            const Unit &u = row[x];
+            rgb_value white = 255 - u.alpha;
+            return Color{(rgb_value)(u.red + white), (rgb_value)(u.green + white), (rgb_value)(u.blue + white)};
+        }
+        static void encode(const Unit *row, int width, unsigned char *out)
+        {
+            for (int x = 0; x < width; x++, out += 4)
+            {
+                const Unit &u = row[x];
+                unsigned a = u.alpha;
+                out[3] = u.alpha;
+                if (a == 0)
+                {
+                    out[0] = out[1] = out[2] = 0;
+                    continue;
+                }
+                out[0] = (unsigned char)std::min(255u, (u.red * 255 + a / 2) / a);
+                out[1] = (unsigned char)std::min(255u, (u.green * 255 + a / 2) / a);
+                out[2] = (unsigned char)std::min(255u, (u.blue * 255 + a / 2) / a);
+            }
+        }
+    };
+
+    //! 8-bit grayscale: the luma of the shape colors, a third of RGB.
+    struct GrayPixels
+    {
+        typedef rgb_value Pixel;
+        typedef rgb_value Unit;
+        static const int CHANNELS = 1;
+        static size_t units(int width)
+        {
+            return width;
+        }
+        static Pixel background()
+        {
+            return 255;
+        }
+        static Pixel convert(const Color &c)
+        {
+            // BT.601 weights in 1/256, adding up to 256: white stays 255
+            return (rgb_value)((77 * c.red + 150 * c.green + 29 * c.blue + 128) >> 8);
+        }
+        static Pixel get(const Unit *row, int x)
+        {
+            return row[x];
+        }
+        static void fill(Unit *row, int x0, int x1, Pixel p)
+        {
+            std::memset(row + x0, p, x1 - x0 + 1);
+        }
+        static void blend(Unit *row, int x0, int x1, Pixel p, rgb_value alpha)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                row[x] = blend_channel(row[x], p, alpha);
+            }
+        }
+        static void composite(Unit *row, const Unit *below, int x0, int x1, rgb_value alpha)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                row[x] = blend_channel(below[x], row[x], alpha);
+            }
+        }
+        static Color color(const Unit *row, int x)
+        {
+            return Color{row[x], row[x], row[x]};
+        }
+        static void encode(const Unit *row, int width, unsigned char *out)
+        {
+            std::memcpy(out, row, width);
+        }
+    };
+
+    //! One bit per pixel, 64 pixels per word, set wherever a shape (of
+    //! any color, at any opacity above 0) was drawn: the collision or hit
+    //! mask of the document, 24 times smaller than RGB. Spans are filled
+    //! a word at a time. Encoded as grayscale, white where set.
+    struct MaskPixels
+    {
+        typedef bool Pixel;
+        typedef uint64_t Unit;
+        static const int CHANNELS = 1;
+        static size_t units(int width)
+        {
+            return ((size_t)width + 63) / 64;
+        }
+        static Pixel background()
+        {
+            return false;
+        }
+        static Pixel convert(const Color &)
+        {
+            return true;
+        }
+        static Pixel get(const Unit *row, int x)
+        {
+            return (row[x >> 6] >> (x & 63)) & 1;
+        }
+        static void fill(Unit *row, int x0, int x1, Pixel p)
+        {
+            Unit value = p ? ~(Unit)0 : 0;
+            size_t w0 = x0 >> 6, w1 = x1 >> 6;
+            Unit first = ~(Unit)0 << (x0 & 63);
+            Unit last = ~(Unit)0 >> (63 - (x1 & 63));
+            if (w0 == w1)
+            {
+                merge(row[w0], value, first & last);
+                return;
+            }
+            merge(row[w0], value, first);
+            std::fill(row + w0 + 1, row + w1, value);
+            merge(row[w1], value, last);
+        }
+        static void blend(Unit *row, int x0, int x1, Pixel p, rgb_value alpha)
+        {
+            if (alpha != 0)
+            {
+                fill(row, x0, x1, p);
+            }
+        }
+        static void composite(Unit *row, const Unit *below, int x0, int x1, rgb_value alpha)
+        {
+            if (alpha != 0)
+            {
+                return;
+            }
+            // An invisible layer leaves what was below
+            size_t w0 = x0 >> 6, w1 = x1 >> 6;
+            for (size_t w = w0; w <= w1; w++)
+            {
+                Unit mask = ~(Unit)0;
+                if (w == w0)
+                {
+                    mask &= ~(Unit)0 << (x0 & 63);
+                }
+                if (w == w1)
+                {
+                    mask &= ~(Unit)0 >> (63 - (x1 & 63));
+                }
+                merge(row[w], below[w], mask);
+            }
+        }
+        static Color color(const Unit *row, int x)
+        {
+            rgb_value v = get(row, x) ? 255 : 0;
+            return Color{v, v, v};
+        }
+        static void encode(const Unit *row, int width, unsigned char *out)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                out[x] = get(row, x) ? 255 : 0;
+            }
+        }
+
+    private:
+        //! Replace the bits of a word selected by mask.
+        static void merge(Unit &word, Unit value, Unit mask)
+        {
+            word = (word & ~mask) | (value & mask);
+        }
+    };
+}
+#endif
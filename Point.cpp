@@ -1,6 +1,7 @@
 //! @file point.cpp
 #include <cmath>
 #include "Point.hpp"
+#include "PointKernels.hpp"
 
 namespace svg
 {
@@ -11,11 +12,10 @@ namespace svg
 
     Point Point::rotate(const Point &origin, int degrees) const
     {
-        double angle = M_PI * degrees / 180.0;
+        double s, c;
+        degree_sin_cos(degrees, s, c);
         double dx = x - origin.x;
         double dy = y - origin.y;
-        double s = ::sin(angle);
-        double c = ::cos(angle);
         int rx = (int)::lround(c * dx - s * dy);
         int ry = (int)::lround(s * dx + c * dy);
         return {origin.x + rx, origin.y + ry};
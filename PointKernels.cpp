@@ -0,0 +1,273 @@
+//! @file PointKernels.cpp
+#include "PointKernels.hpp"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SVG_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace svg
+{
+    namespace
+    {
+        //! Largest angle (in absolute value) served from the table.
+        const int TRIG_RANGE = 360;
+
+        //! Sine and cosine of every integer degree in [-TRIG_RANGE, TRIG_RANGE].
+        //! C++11 cannot evaluate sin in a constant expression, so the table
+        //! is filled once, on first use, with the same expression as before.
+        struct TrigTable
+        {
+            double sin_[2 * TRIG_RANGE + 1];
+            double cos_[2 * TRIG_RANGE + 1];
+
+            TrigTable()
+            {
+                for (int d = -TRIG_RANGE; d <= TRIG_RANGE; d++)
+                {
+                    double angle = M_PI * d / 180.0;
+                    sin_[d + TRIG_RANGE] = ::sin(angle);
+                    cos_[d + TRIG_RANGE] = ::cos(angle);
+                }
+            }
+        };
+
+        const TrigTable &trig_table()
+        {
+            static const TrigTable table;
+            return table;
+        }
+
+        void translate_scalar(Point *p, size_t count, const Point &t)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                p[i].x += t.x;
+                p[i].y += t.y;
+            }
+        }
+
+        void rotate_scalar(Point *p, size_t count, const Point &o, double s, double c)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                double dx = p[i].x - o.x;
+                double dy = p[i].y - o.y;
+                p[i].x = o.x + (int)::lround(c * dx - s * dy);
+                p[i].y = o.y + (int)::lround(s * dx + c * dy);
+            }
+        }
+
+        void scale_scalar(Point *p, size_t count, const Point &o, int v)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                p[i].x = o.x + (p[i].x - o.x) * v;
+                p[i].y = o.y + (p[i].y - o.y) * v;
+            }
+        }
+
+#ifdef SVG_X86_KERNELS
+        // Points stay interleaved in memory (x0 y0 x1 y1 ...); the
+        // rotation kernels split x and y into separate registers after
+        // loading and interleave them again before storing.
+
+        //! Round half away from zero, like lround, for values that fit an int.
+        __attribute__((target("sse2"))) inline __m128d round_sse2(__m128d v)
+        {
+            const __m128d sign = _mm_set1_pd(-0.0);
+            __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(v));
+            __m128d frac = _mm_andnot_pd(sign, _mm_sub_pd(v, t));
+            __m128d step = _mm_or_pd(_mm_and_pd(v, sign), _mm_set1_pd(1.0));
+            __m128d half = _mm_cmpge_pd(frac, _mm_set1_pd(0.5));
+            return _mm_add_pd(t, _mm_and_pd(half, step));
+        }
+
+        __attribute__((target("sse2"))) void translate_sse2(Point *p, size_t count, const Point &t)
+        {
+            __m128i d = _mm_setr_epi32(t.x, t.y, t.x, t.y);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2)
+            {
+                __m128i *q = (__m128i *)(p + i);
+                _mm_storeu_si128(q, _mm_add_epi32(_mm_loadu_si128(q), d));
+            }
+            translate_scalar(p + i, count - i, t);
+        }
+
+        __attribute__((target("sse2"))) void rotate_sse2(Point *p, size_t count, const Point &o, double s, double c)
+        {
+            __m128i org = _mm_setr_epi32(o.x, o.x, o.y, o.y);
+            __m128d vs = _mm_set1_pd(s);
+            __m128d vc = _mm_set1_pd(c);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2)
+            {
+                __m128i *q = (__m128i *)(p + i);
+                // x0 x1 y0 y1
+                __m128i xy = _mm_shuffle_epi32(_mm_loadu_si128(q), _MM_SHUFFLE(3, 1, 2, 0));
+                __m128i d = _mm_sub_epi32(xy, org);
+                __m128d dx = _mm_cvtepi32_pd(d);
+                __m128d dy = _mm_cvtepi32_pd(_mm_srli_si128(d, 8));
+                __m128i rx = _mm_cvttpd_epi32(round_sse2(_mm_sub_pd(_mm_mul_pd(vc, dx), _mm_mul_pd(vs, dy))));
+                __m128i ry = _mm_cvttpd_epi32(round_sse2(_mm_add_pd(_mm_mul_pd(vs, dx), _mm_mul_pd(vc, dy))));
+                __m128i r = _mm_add_epi32(_mm_unpacklo_epi64(rx, ry), org);
+                _mm_storeu_si128(q, _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+            rotate_scalar(p + i, count - i, o, s, c);
+        }
+
+        //! Low 32 bits of a 32x32 multiply in every lane, which SSE2 lacks.
+        __attribute__((target("sse2"))) inline __m128i mullo_sse2(__m128i a, __m128i b)
+        {
+            __m128i even = _mm_mul_epu32(a, b);
+            __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+            return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                      _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+
+        __attribute__((target("sse2"))) void scale_sse2(Point *p, size_t count, const Point &o, int v)
+        {
+            __m128i org = _mm_setr_epi32(o.x, o.y, o.x, o.y);
+            __m128i k = _mm_set1_epi32(v);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2)
+            {
+                __m128i *q = (__m128i *)(p + i);
+                __m128i d = _mm_sub_epi32(_mm_loadu_si128(q), org);
+                _mm_storeu_si128(q, _mm_add_epi32(org, mullo_sse2(d, k)));
+            }
+            scale_scalar(p + i, count - i, o, v);
+        }
+
+        __attribute__((target("avx2"))) inline __m256d round_avx2(__m256d v)
+        {
+            const __m256d sign = _mm256_set1_pd(-0.0);
+            __m256d t = _mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            __m256d frac = _mm256_andnot_pd(sign, _mm256_sub_pd(v, t));
+            __m256d step = _mm256_or_pd(_mm256_and_pd(v, sign), _mm256_set1_pd(1.0));
+            __m256d half = _mm256_cmp_pd(frac, _mm256_set1_pd(0.5), _CMP_GE_OQ);
+            return _mm256_add_pd(t, _mm256_and_pd(half, step));
+        }
+
+        __attribute__((target("avx2"))) void translate_avx2(Point *p, size_t count, const Point &t)
+        {
+            __m256i d = _mm256_setr_epi32(t.x, t.y, t.x, t.y, t.x, t.y, t.x, t.y);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m256i *q = (__m256i *)(p + i);
+                _mm256_storeu_si256(q, _mm256_add_epi32(_mm256_loadu_si256(q), d));
+            }
+            translate_scalar(p + i, count - i, t);
+        }
+
+        __attribute__((target("avx2"))) void rotate_avx2(Point *p, size_t count, const Point &o, double s, double c)
+        {
+            const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+            const __m256i join = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            __m256i org = _mm256_setr_epi32(o.x, o.x, o.x, o.x, o.y, o.y, o.y, o.y);
+            __m256d vs = _mm256_set1_pd(s);
+            __m256d vc = _mm256_set1_pd(c);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m256i *q = (__m256i *)(p + i);
+                // x0 x1 x2 x3 y0 y1 y2 y3
+                __m256i xy = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(q), split);
+                __m256i d = _mm256_sub_epi32(xy, org);
+                __m256d dx = _mm256_cvtepi32_pd(_mm256_castsi256_si128(d));
+                __m256d dy = _mm256_cvtepi32_pd(_mm256_extracti128_si256(d, 1));
+                __m128i rx = _mm256_cvttpd_epi32(round_avx2(_mm256_sub_pd(_mm256_mul_pd(vc, dx), _mm256_mul_pd(vs, dy))));
+                __m128i ry = _mm256_cvttpd_epi32(round_avx2(_mm256_add_pd(_mm256_mul_pd(vs, dx), _mm256_mul_pd(vc, dy))));
+                __m256i r = _mm256_add_epi32(_mm256_inserti128_si256(_mm256_castsi128_si256(rx), ry, 1), org);
+                _mm256_storeu_si256(q, _mm256_permutevar8x32_epi32(r, join));
+            }
+            rotate_sse2(p + i, count - i, o, s, c);
+        }
+
+        __attribute__((target("avx2"))) void scale_avx2(Point *p, size_t count, const Point &o, int v)
+        {
+            __m256i org = _mm256_setr_epi32(o.x, o.y, o.x, o.y, o.x, o.y, o.x, o.y);
+            __m256i k = _mm256_set1_epi32(v);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m256i *q = (__m256i *)(p + i);
+                __m256i d = _mm256_sub_epi32(_mm256_loadu_si256(q), org);
+                _mm256_storeu_si256(q, _mm256_add_epi32(org, _mm256_mullo_epi32(d, k)));
+            }
+            scale_scalar(p + i, count - i, o, v);
+        }
+#endif
+
+        //! Kernel set, picked once from the CPU features.
+        struct Kernels
+        {
+            const char *name;
+            void (*translate)(Point *, size_t, const Point &);
+            void (*rotate)(Point *, size_t, const Point &, double, double);
+            void (*scale)(Point *, size_t, const Point &, int);
+        };
+
+        Kernels pick_kernels()
+        {
+#ifdef SVG_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+            {
+                return Kernels{"avx2", translate_avx2, rotate_avx2, scale_avx2};
+            }
+            if (__builtin_cpu_supports("sse2"))
+            {
+                return Kernels{"sse2", translate_sse2, rotate_sse2, scale_sse2};
+            }
+#endif
+            return Kernels{"scalar", translate_scalar, rotate_scalar, scale_scalar};
+        }
+
+        const Kernels &kernels()
+        {
+            static const Kernels k = pick_kernels();
+            return k;
+        }
+    }
+
+    void degree_sin_cos(int degrees, double &s, double &c)
+    {
+        if (degrees >= -TRIG_RANGE && degrees <= TRIG_RANGE)
+        {
+            const TrigTable &t = trig_table();
+            s = t.sin_[degrees + TRIG_RANGE];
+            c = t.cos_[degrees + TRIG_RANGE];
+            return;
+        }
+        double angle = M_PI * degrees / 180.0;
+        s = ::sin(angle);
+        c = ::cos(angle);
+    }
+
+    void translate_points(Point *points, size_t count, const Point &t)
+    {
+        kernels().translate(points, count, t);
+    }
+
+    void rotate_points(Point *points, size_t count, const Point &origin, int degrees)
+    {
+        double s, c;
+        degree_sin_cos(degrees, s, c);
+        kernels().rotate(points, count, origin, s, c);
+    }
+
+    void scale_points(Point *points, size_t count, const Point &origin, int v)
+    {
+        kernels().scale(points, count, origin, v);
+    }
+
+    const char *point_kernels_name()
+    {
+        return kernels().name;
+    }
+}
@@ -0,0 +1,40 @@
+//! @file PointKernels.hpp
+#ifndef __svg_PointKernels_hpp__
+#define __svg_PointKernels_hpp__
+
+#include "Point.hpp"
+
+#include <cstddef>
+
+namespace svg
+{
+    //! Get sine and cosine of an integer angle.
+    //! Angles in [-360, 360] come from a table filled with the exact
+    //! expression Point::rotate always used, so results are bit-identical.
+    //! @param degrees Angle in degrees.
+    //! @param s Receives the sine.
+    //! @param c Receives the cosine.
+    void degree_sin_cos(int degrees, double &s, double &c);
+
+    //! Translate an array of points.
+    //! @param points First point.
+    //! @param count Number of points.
+    //! @param t Translation.
+    void translate_points(Point *points, size_t count, const Point &t);
+    //! Rotate an array of points, with the same rounding as Point::rotate.
+    //! @param points First point.
+    //! @param count Number of points.
+    //! @param origin Rotation origin.
+    //! @param degrees Degrees of rotation.
+    void rotate_points(Point *points, size_t count, const Point &origin, int degrees);
+    //! Scale an array of points.
+    //! @param points First point.
+    //! @param count Number of points.
+    //! @param origin Scaling origin.
+    //! @param v Scale amount.
+    void scale_points(Point *points, size_t count, const Point &origin, int v);
+    //! Get the name of the kernel set chosen for this CPU.
+    //! @return "avx2", "sse2" or "scalar".
+    const char *point_kernels_name();
+}
+#endif
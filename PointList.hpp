@@ -0,0 +1,234 @@
+//! @file PointList.hpp
+#ifndef __svg_PointList_hpp__
+#define __svg_PointList_hpp__
+
+#include "PackedPoints.hpp"
+#include "Point.hpp"
+#include "PointKernels.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+namespace svg
+{
+    //! Point sequence of a shape.
+    //! Up to INLINE_POINTS points (lines, rectangles) are stored inside
+    //! the object itself; longer sequences keep the vector they were
+    //! built from, which is adopted without copying when moved in.
+    //! Long sequences can also be packed (see PackedPoints); while packed,
+    //! the points are only reachable through packed_points().
+    class PointList
+    {
+    public:
+        //! Number of points stored without a heap allocation.
+        static const size_t INLINE_POINTS = 4;
+
+        //! Constructor of an empty list.
+        PointList() : size_(0), inline_() {}
+        //! Constructor of a list of count points at (0, 0).
+        //! @param count Number of points.
+        explicit PointList(size_t count) : size_(count), inline_()
+        {
+            if (size_ > INLINE_POINTS)
+            {
+                heap_.resize(size_);
+            }
+        }
+        //! Constructor copying points.
+        //! @param points Points.
+        PointList(const std::vector<Point> &points) : size_(points.size()), inline_()
+        {
+            if (size_ <= INLINE_POINTS)
+            {
+                std::copy(points.begin(), points.end(), inline_);
+            }
+            else
+            {
+                heap_ = points;
+            }
+        }
+        //! Constructor taking over a vector of points.
+        //! @param points Points.
+        PointList(std::vector<Point> &&points) : size_(points.size()), inline_()
+        {
+            if (size_ <= INLINE_POINTS)
+            {
+                std::copy(points.begin(), points.end(), inline_);
+            }
+            else
+            {
+                heap_ = std::move(points);
+            }
+        }
+        //! Constructor copying a point array.
+        //! @param points First point.
+        //! @param count Number of points.
+        PointList(const Point *points, size_t count) : size_(count), inline_()
+        {
+            if (size_ <= INLINE_POINTS)
+            {
+                std::copy(points, points + count, inline_);
+            }
+            else
+            {
+                heap_.assign(points, points + count);
+            }
+        }
+        //! Constructor from a brace list.
+        //! @param points Points.
+        PointList(std::initializer_list<Point> points) : size_(points.size()), inline_()
+        {
+            if (size_ <= INLINE_POINTS)
+            {
+                std::copy(points.begin(), points.end(), inline_);
+            }
+            else
+            {
+                heap_.assign(points.begin(), points.end());
+            }
+        }
+        //! Get the number of points, packed or not.
+        //! @return Number of points.
+        size_t size() const
+        {
+            return packed() ? packed_.size() : size_;
+        }
+        //! Check if there are no points.
+        //! @return True if empty.
+        bool empty() const
+        {
+            return size() == 0;
+        }
+        //! Check if the points are packed.
+        //! @return True if packed.
+        bool packed() const
+        {
+            return packed_.size() != 0;
+        }
+        //! Get the heap memory held by the points, packed or not.
+        //! @return Size in bytes.
+        size_t heap_bytes() const
+        {
+            return heap_.capacity() * sizeof(Point) + packed_.bytes();
+        }
+        //! Compress the points, if there are more than INLINE_POINTS.
+        void pack()
+        {
+            if (size_ > INLINE_POINTS)
+            {
+                packed_ = PackedPoints(heap_.data(), size_);
+                std::vector<Point>().swap(heap_);
+                size_ = 0;
+            }
+        }
+        //! Decompress packed points.
+        void unpack()
+        {
+            if (packed())
+            {
+                packed_.unpack(heap_);
+                size_ = heap_.size();
+                packed_ = PackedPoints();
+            }
+        }
+        //! Get the packed points.
+        //! @return Packed points (empty if not packed).
+        const PackedPoints &packed_points() const
+        {
+            return packed_;
+        }
+        //! Get the packed points.
+        //! @return Packed points (empty if not packed).
+        PackedPoints &packed_points()
+        {
+            return packed_;
+        }
+        //! Translate all points.
+        //! @param t Translation.
+        void translate(const Point &t)
+        {
+            if (packed())
+            {
+                packed_.translate(t);
+                return;
+            }
+            translate_points(data(), size_, t);
+        }
+        //! Rotate all points.
+        //! @param origin Rotation origin.
+        //! @param degrees Degrees of rotation.
+        void rotate(const Point &origin, int degrees)
+        {
+            bool was_packed = packed();
+            unpack();
+            rotate_points(data(), size_, origin, degrees);
+            if (was_packed)
+            {
+                pack();
+            }
+        }
+        //! Scale all points.
+        //! @param origin Scaling origin.
+        //! @param v Scale amount.
+        void scale(const Point &origin, int v)
+        {
+            bool was_packed = packed();
+            unpack();
+            scale_points(data(), size_, origin, v);
+            if (was_packed)
+            {
+                pack();
+            }
+        }
+        //! Get the points, which must not be packed.
+        //! @return First point.
+        Point *data()
+        {
+            return size_ <= INLINE_POINTS ? inline_ : heap_.data();
+        }
+        //! Get the points.
+        //! @return First point.
+        const Point *data() const
+        {
+            return size_ <= INLINE_POINTS ? inline_ : heap_.data();
+        }
+        Point &operator[](size_t i)
+        {
+            return data()[i];
+        }
+        const Point &operator[](size_t i) const
+        {
+            return data()[i];
+        }
+        Point *begin()
+        {
+            return data();
+        }
+        Point *end()
+        {
+            return data() + size_;
+        }
+        const Point *begin() const
+        {
+            return data();
+        }
+        const Point *end() const
+        {
+            return data() + size_;
+        }
+
+    private:
+        //! Number of points.
+        size_t size_;
+        //! Storage of short lists.
+        Point inline_[INLINE_POINTS];
+        //! Storage of long lists.
+        std::vector<Point> heap_;
+        //! Storage of packed lists.
+        PackedPoints packed_;
+    };
+}
+#endif
@@ -0,0 +1,774 @@
+//! @file Raster.hpp
+#ifndef __svg_Raster_hpp__
+#define __svg_Raster_hpp__
+
+#include "Cancel.hpp"
+#include "FillRule.hpp"
+#include "Point.hpp"
+#include "PointKernels.hpp"
+#include "Stroke.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace svg
+{
+    //! Rasterization of the drawing primitives into horizontal spans.
+    //! A Plot is any type with a member 'void span(int y, int x0, int x1)'
+    //! that paints pixels x0..x1 (inclusive, x0 <= x1) of row y.
+    //! Spans are not clipped; that is up to the Plot.
+    //! Shapes far larger than the canvas still take a row per scanline, so
+    //! every scanline calls check_cancel: a job out of time stops mid-shape.
+    //! Every primitive emits exactly the pixels it always painted,
+    //! so all targets stay pixel-identical.
+
+    //! Plot collecting spans, to paint a shape whose spans overlap (a
+    //! polygon outline over its fill, for instance) with each pixel once.
+    class SpanList
+    {
+    public:
+        void span(int y, int x0, int x1)
+        {
+            spans_.push_back(Span{y, x0, x1});
+        }
+        //! Send the union of the collected spans to a Plot, as disjoint
+        //! spans sorted by row and column, and empty the list.
+        //! @param plot Span receiver.
+        template <class Plot>
+        void flush(Plot &plot)
+        {
+            std::sort(spans_.begin(), spans_.end(),
+                      [](const Span &l, const Span &r) { return l.y < r.y || (l.y == r.y && l.x0 < r.x0); });
+            for (size_t i = 0; i < spans_.size();)
+            {
+                Span s = spans_[i];
+                for (i++; i < spans_.size() && spans_[i].y == s.y && spans_[i].x0 <= s.x1 + 1; i++)
+                {
+                    s.x1 = std::max(s.x1, spans_[i].x1);
+                }
+                plot.span(s.y, s.x0, s.x1);
+            }
+            spans_.clear();
+        }
+
+    private:
+        struct Span
+        {
+            int y;
+            int x0;
+            int x1;
+        };
+        std::vector<Span> spans_;
+    };
+
+    //! Rasterize a line defined by 2 points.
+    //! @param a First point.
+    //! @param b Second point.
+    //! @param plot Span receiver.
+    template <class Plot>
+    void raster_line(const Point &a, const Point &b, Plot &plot)
+    {
+        //  Bresenham Algorithm, emitting runs of pixels on the same row.
+        int x_from = a.x;
+        int y_from = a.y;
+        int x_to = b.x;
+        int y_to = b.y;
+        int dy = y_to - y_from;
+        int dx = x_to - x_from;
+        int step_x = 1, step_y = 1;
+        if (dy < 0)
+        {
+            dy = -dy;
+            step_y = -1;
+        }
+        if (dx < 0)
+        {
+            dx = -dx;
+            step_x = -1;
+        }
+        dy *= 2;
+        dx *= 2;
+        if (dx > dy)
+        {
+            int run_start = x_from;
+            int fraction = dy - (dx / 2);
+            while (x_from != x_to)
+            {
+                if (fraction >= 0)
+                {
+                    plot.span(y_from, std::min(run_start, x_from), std::max(run_start, x_from));
+                    if ((y_from & 1023) == 0)
+                    {
+                        check_cancel();
+                    }
+                    y_from += step_y;
+                    fraction -= dx;
+                    run_start = x_from + step_x;
+                }
+                x_from += step_x;
+                fraction += dy;
+            }
+            plot.span(y_from, std::min(run_start, x_from), std::max(run_start, x_from));
+        }
+        else
+        {
+            plot.span(y_from, x_from, x_from);
+            int fraction = dx - (dy >> 1);
+            while (y_from != y_to)
+            {
+                if (fraction >= 0)
+                {
+                    x_from += step_x;
+                    fraction -= dy;
+                }
+                y_from += step_y;
+                fraction += dx;
+                plot.span(y_from, x_from, x_from);
+                if ((y_from & 1023) == 0)
+                {
+                    check_cancel();
+                }
+            }
+        }
+    }
+
+    //! Call edge(a, b) for every edge of a closed polygon, in order,
+    //! reading the points once from first to last.
+    //! @param first Iterator to the first point.
+    //! @param count Number of points (at least 1).
+    //! @param edge Edge receiver.
+    template <class Iterator, class Edge>
+    void for_each_edge(Iterator first, size_t count, Edge &edge)
+    {
+        Iterator it = first;
+        Point start = *it;
+        Point a = start;
+        for (size_t i = 0; i < count; i++)
+        {
+            Point b = start;
+            if (i + 1 < count)
+            {
+                ++it;
+                b = *it;
+            }
+            edge(a, b);
+            a = b;
+        }
+    }
+
+    //! Paint the spans of one scanline between pairs of sorted edge
+    //! intersections, then empty the intersection list.
+    //! @param y Row.
+    //! @param seg Intersections of the edges with the row.
+    //! @param plot Span receiver.
+    template <class Plot>
+    void raster_scanline(int y, std::vector<double> &seg, Plot &plot)
+    {
+        std::sort(seg.begin(), seg.end());
+        size_t i_s = 0;
+        while ((i_s + 1) < seg.size())
+        {
+            int x0 = (int)round(seg[i_s]);
+            int x1 = (int)round(seg[i_s + 1]);
+            if (x0 == x1)
+            {
+                i_s++;
+            }
+            else
+            {
+                plot.span(y, x0, x1);
+                i_s += 2;
+            }
+        }
+        seg.clear();
+    }
+
+    //! Rasterize a polygon: scanline fill, then the outline.
+    //! The points are only read in order, so any forward iterator
+    //! (such as one decoding PackedPoints) can supply them.
+    //! @param first Iterator to the first point of the polygon.
+    //! @param count Number of points.
+    //! @param plot Span receiver.
+    template <class Iterator, class Plot>
+    void raster_polygon(Iterator first, size_t count, Plot &plot)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        int y_min = first->y, y_max = first->y;
+        Iterator it = first;
+        for (size_t i = 1; i < count; i++)
+        {
+            ++it;
+            y_min = std::min(y_min, it->y);
+            y_max = std::max(y_max, it->y);
+        }
+
+        std::vector<double> seg;
+        int y;
+        auto intersect = [&y, &seg](const Point &a, const Point &b)
+        {
+            if (y < std::min(a.y, b.y) || y > std::max(a.y, b.y))
+            {
+                return;
+            }
+            if (a.y != b.y)
+            {
+                double x_inters = (double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y) + a.x;
+                seg.push_back(x_inters);
+            }
+        };
+        for (y = y_min; y < y_max; y++)
+        {
+            check_cancel();
+            for_each_edge(first, count, intersect);
+            raster_scanline(y, seg, plot);
+        }
+        auto outline = [&plot](const Point &a, const Point &b)
+        {
+            raster_line(a, b, plot);
+        };
+        for_each_edge(first, count, outline);
+    }
+
+    //! Non-horizontal polygon edge, kept in its original direction so that
+    //! its intersections round exactly as in raster_polygon.
+    struct PolygonEdge
+    {
+        //! Start point.
+        Point a;
+        //! End point.
+        Point b;
+        //! First row crossed.
+        int y_lo;
+        //! Last row crossed.
+        int y_hi;
+    };
+
+    //! Sort an edge list by first row, making it an edge table.
+    //! @param edges Edge list.
+    inline void sort_edges(std::vector<PolygonEdge> &edges)
+    {
+        std::sort(edges.begin(), edges.end(),
+                  [](const PolygonEdge &l, const PolygonEdge &r) { return l.y_lo < r.y_lo; });
+    }
+
+    //! Build the edge table of a polygon, sorted by first row.
+    //! Horizontal edges are left out; they never produce intersections.
+    //! @param first Iterator to the first point of the polygon.
+    //! @param count Number of points (at least 1).
+    //! @param edges Receives the edges.
+    template <class Iterator>
+    void build_edge_table(Iterator first, size_t count, std::vector<PolygonEdge> &edges)
+    {
+        edges.clear();
+        auto add = [&edges](const Point &a, const Point &b)
+        {
+            if (a.y != b.y)
+            {
+                edges.push_back(PolygonEdge{a, b, std::min(a.y, b.y), std::max(a.y, b.y)});
+            }
+        };
+        for_each_edge(first, count, add);
+        sort_edges(edges);
+    }
+
+    //! Scanline-fill rows [y0, y1) of a polygon from its edge table.
+    //! Emits the same spans as the scanline pass of raster_polygon for
+    //! those rows, so disjoint row ranges can be filled independently.
+    //! @param edges Edge table, from build_edge_table.
+    //! @param y0 First row.
+    //! @param y1 End row.
+    //! @param plot Span receiver.
+    template <class Plot>
+    void raster_edge_rows(const std::vector<PolygonEdge> &edges, int y0, int y1, Plot &plot)
+    {
+        std::vector<const PolygonEdge *> active;
+        std::vector<double> seg;
+        size_t next = 0;
+        for (int y = y0; y < y1; y++)
+        {
+            check_cancel();
+            for (; next < edges.size() && edges[next].y_lo <= y; next++)
+            {
+                active.push_back(&edges[next]);
+            }
+            size_t kept = 0;
+            for (const PolygonEdge *e : active)
+            {
+                if (e->y_hi >= y)
+                {
+                    active[kept++] = e;
+                }
+            }
+            active.resize(kept);
+            for (const PolygonEdge *e : active)
+            {
+                const Point &a = e->a;
+                const Point &b = e->b;
+                double x_inters = (double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y) + a.x;
+                seg.push_back(x_inters);
+            }
+            raster_scanline(y, seg, plot);
+        }
+    }
+
+    //! Rasterize several closed contours as one shape: a single scanline
+    //! fill over the edges of all of them, inside by the fill rule, then
+    //! the outline of each contour. Each crossing of a row adds the
+    //! direction of its edge to the winding number, and a span runs from
+    //! a crossing entering the shape to the next one leaving it.
+    //! Unlike raster_polygon, each edge covers the rows from its first
+    //! point up to, but not including, its last one, so vertices shared by
+    //! two edges are counted once. Flattened curves put many vertices
+    //! right on scanlines, which would otherwise flip the winding.
+    //! @param points Points of all contours, one after the other.
+    //! @param ends End of each contour in points (one past its last point), increasing.
+    //! @param contours Number of contours.
+    //! @param rule Fill rule.
+    //! @param plot Span receiver.
+    template <class Plot>
+    void raster_contours(const Point *points, const size_t *ends, size_t contours, FillRule rule, Plot &plot)
+    {
+        std::vector<PolygonEdge> edges;
+        auto add = [&edges](const Point &a, const Point &b)
+        {
+            if (a.y != b.y)
+            {
+                edges.push_back(PolygonEdge{a, b, std::min(a.y, b.y), std::max(a.y, b.y) - 1});
+            }
+        };
+        size_t begin = 0;
+        for (size_t c = 0; c < contours; begin = ends[c++])
+        {
+            if (ends[c] > begin)
+            {
+                for_each_edge(points + begin, ends[c] - begin, add);
+            }
+        }
+        sort_edges(edges);
+
+        auto inside = [rule](int winding)
+        {
+            return rule == FillRule::NONZERO ? winding != 0 : (winding & 1) != 0;
+        };
+        std::vector<const PolygonEdge *> active;
+        // Crossings of the row, with the direction of their edge
+        std::vector<std::pair<double, int>> seg;
+        size_t next = 0;
+        for (int y = edges.empty() ? 0 : edges[0].y_lo; next < edges.size() || !active.empty(); y++)
+        {
+            check_cancel();
+            for (; next < edges.size() && edges[next].y_lo <= y; next++)
+            {
+                active.push_back(&edges[next]);
+            }
+            size_t kept = 0;
+            for (const PolygonEdge *e : active)
+            {
+                if (e->y_hi >= y)
+                {
+                    active[kept++] = e;
+                    // Through the pixel centers, as for polygons
+                    const Point &a = e->a;
+                    const Point &b = e->b;
+                    seg.push_back(std::make_pair((double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y) + a.x,
+                                                 b.y > a.y ? 1 : -1));
+                }
+            }
+            active.resize(kept);
+            std::sort(seg.begin(), seg.end());
+            int winding = 0;
+            size_t start = 0;
+            for (size_t i = 0; i < seg.size(); i++)
+            {
+                bool was_inside = inside(winding);
+                winding += seg[i].second;
+                if (!was_inside && inside(winding))
+                {
+                    start = i;
+                }
+                else if (was_inside && !inside(winding))
+                {
+                    plot.span(y, (int)round(seg[start].first), (int)round(seg[i].first));
+                }
+            }
+            seg.clear();
+        }
+
+        auto outline = [&plot](const Point &a, const Point &b)
+        {
+            raster_line(a, b, plot);
+        };
+        begin = 0;
+        for (size_t c = 0; c < contours; begin = ends[c++])
+        {
+            if (ends[c] > begin)
+            {
+                for_each_edge(points + begin, ends[c] - begin, outline);
+            }
+        }
+    }
+
+    //! Convex piece of the outline of a wide stroke: a polygon of up to
+    //! 4 corners, or a disc (for round joins and caps).
+    struct StrokePiece
+    {
+        //! Corner coordinates; for a disc, x[0], y[0] is the center.
+        double x[4];
+        double y[4];
+        //! Number of corners, 0 for a disc.
+        int corners;
+        //! Radius of a disc.
+        double radius;
+        //! First row covered.
+        int y_lo;
+        //! Last row covered.
+        int y_hi;
+    };
+
+    //! Get the columns of row y covered by a stroke piece, as a half-open
+    //! interval [x0, x1) of pixel centers.
+    //! @param piece Stroke piece.
+    //! @param y Row.
+    //! @param x0 Receives the left end.
+    //! @param x1 Receives the right end.
+    //! @return False if the row misses the piece.
+    inline bool stroke_piece_row(const StrokePiece &piece, int y, double &x0, double &x1)
+    {
+        if (piece.corners == 0)
+        {
+            double dy = y - piece.y[0];
+            double h2 = piece.radius * piece.radius - dy * dy;
+            if (h2 <= 0)
+            {
+                return false;
+            }
+            double h = std::sqrt(h2);
+            x0 = piece.x[0] - h;
+            x1 = piece.x[0] + h;
+            return true;
+        }
+        // A row crosses a convex polygon between its leftmost and rightmost edge crossing
+        x0 = HUGE_VAL;
+        x1 = -HUGE_VAL;
+        for (int i = 0; i < piece.corners; i++)
+        {
+            int j = (i + 1) % piece.corners;
+            double ya = piece.y[i], yb = piece.y[j];
+            if (ya == yb || y < std::min(ya, yb) || y > std::max(ya, yb))
+            {
+                continue;
+            }
+            double x = piece.x[i] + (y - ya) * (piece.x[j] - piece.x[i]) / (yb - ya);
+            x0 = std::min(x0, x);
+            x1 = std::max(x1, x);
+        }
+        return x0 < x1;
+    }
+
+    //! Rasterize a polyline as a wide stroke, with joins and caps.
+    //! The outline is split into convex pieces (one quadrilateral per
+    //! segment, plus joins and caps), and each row paints the union of
+    //! their intervals once, so overlapping pieces never paint twice.
+    //! Pixels are painted when their center lies inside the outline,
+    //! counting top and left edges only, so a stroke of width w
+    //! covers w rows or columns when aligned with the axes.
+    //! The points are only read in order, so any forward iterator
+    //! (such as one decoding PackedPoints) can supply them.
+    //! @param first Iterator to the first point.
+    //! @param count Number of points.
+    //! @param style Stroke geometry.
+    //! @param plot Span receiver.
+    template <class Iterator, class Plot>
+    void raster_stroke(Iterator first, size_t count, const StrokeStyle &style, Plot &plot)
+    {
+        double h = style.width / 2;
+        std::vector<StrokePiece> pieces;
+        auto add = [&pieces](StrokePiece piece)
+        {
+            double lo = piece.y[0], hi = piece.y[0];
+            if (piece.corners == 0)
+            {
+                lo -= piece.radius;
+                hi += piece.radius;
+            }
+            for (int i = 1; i < piece.corners; i++)
+            {
+                lo = std::min(lo, piece.y[i]);
+                hi = std::max(hi, piece.y[i]);
+            }
+            // Rows whose center is in [lo, hi)
+            piece.y_lo = (int)std::ceil(lo);
+            piece.y_hi = (int)std::ceil(hi) - 1;
+            if (piece.y_lo <= piece.y_hi)
+            {
+                pieces.push_back(piece);
+            }
+        };
+        auto disc = [&add, h](double x, double y)
+        {
+            StrokePiece piece = {{x}, {y}, 0, h, 0, 0};
+            add(piece);
+        };
+        // Square cap: the segment extended by h beyond p, backwards along (dx, dy)
+        auto square = [&add, h](double px, double py, double dx, double dy)
+        {
+            double nx = -dy * h, ny = dx * h;
+            StrokePiece piece = {{px + nx, px - nx, px - nx - dx * h, px + nx - dx * h},
+                                 {py + ny, py - ny, py - ny - dy * h, py + ny - dy * h},
+                                 4, 0, 0, 0};
+            add(piece);
+        };
+
+        Iterator it = first;
+        size_t left = count;
+        if (left == 0)
+        {
+            return;
+        }
+        Point p = *it;
+        const Point start = p;
+        double start_dx = 0, start_dy = 0;
+        // Direction of the previous segment, (0, 0) before the first one
+        double pdx = 0, pdy = 0;
+        for (++it, --left; left > 0; ++it, --left)
+        {
+            Point q = *it;
+            double len = std::hypot((double)(q.x - p.x), (double)(q.y - p.y));
+            if (len == 0)
+            {
+                continue;
+            }
+            double dx = (q.x - p.x) / len, dy = (q.y - p.y) / len;
+            double nx = -dy * h, ny = dx * h;
+            StrokePiece segment = {{p.x + nx, q.x + nx, q.x - nx, p.x - nx},
+                                   {p.y + ny, q.y + ny, q.y - ny, p.y - ny},
+                                   4, 0, 0, 0};
+            add(segment);
+            if (pdx == 0 && pdy == 0)
+            {
+                start_dx = dx;
+                start_dy = dy;
+            }
+            else if (style.join == LineJoin::ROUND)
+            {
+                disc(p.x, p.y);
+            }
+            else
+            {
+                // The corner lies on the outer side, away from the new segment
+                double pnx = -pdy * h, pny = pdx * h;
+                double side = (pnx * dx + pny * dy > 0) ? -1 : 1;
+                double cos_turn = pdx * dx + pdy * dy;
+                StrokePiece corner = {{(double)p.x, p.x + side * pnx, p.x + side * nx},
+                                      {(double)p.y, p.y + side * pny, p.y + side * ny},
+                                      3, 0, 0, 0};
+                // The miter is 1 / cos(a / 2) times the width, a being the turn
+                if (style.join == LineJoin::MITER &&
+                    (1 + cos_turn) * style.miter_limit * style.miter_limit >= 2)
+                {
+                    corner.x[3] = corner.x[2];
+                    corner.y[3] = corner.y[2];
+                    corner.x[2] = p.x + side * (pnx + nx) / (1 + cos_turn);
+                    corner.y[2] = p.y + side * (pny + ny) / (1 + cos_turn);
+                    corner.corners = 4;
+                }
+                if (cos_turn < 1)
+                {
+                    add(corner);
+                }
+            }
+            pdx = dx;
+            pdy = dy;
+            p = q;
+        }
+        if (pdx == 0 && pdy == 0)
+        {
+            // A single point, or all the same: nothing to draw
+            return;
+        }
+        if (style.cap == LineCap::ROUND)
+        {
+            disc(start.x, start.y);
+            disc(p.x, p.y);
+        }
+        else if (style.cap == LineCap::SQUARE)
+        {
+            square(start.x, start.y, start_dx, start_dy);
+            square(p.x, p.y, -pdx, -pdy);
+        }
+
+        std::sort(pieces.begin(), pieces.end(),
+                  [](const StrokePiece &l, const StrokePiece &r) { return l.y_lo < r.y_lo; });
+        std::vector<const StrokePiece *> active;
+        std::vector<std::pair<int, int>> runs;
+        size_t next = 0;
+        for (int y = pieces.empty() ? 0 : pieces[0].y_lo; next < pieces.size() || !active.empty(); y++)
+        {
+            check_cancel();
+            for (; next < pieces.size() && pieces[next].y_lo <= y; next++)
+            {
+                active.push_back(&pieces[next]);
+            }
+            size_t kept = 0;
+            for (const StrokePiece *piece : active)
+            {
+                if (piece->y_hi < y)
+                {
+                    continue;
+                }
+                active[kept++] = piece;
+                double x0, x1;
+                if (stroke_piece_row(*piece, y, x0, x1))
+                {
+                    // Pixels whose center is in [x0, x1)
+                    int a = (int)std::ceil(x0), b = (int)std::ceil(x1) - 1;
+                    if (a <= b)
+                    {
+                        runs.push_back(std::make_pair(a, b));
+                    }
+                }
+            }
+            active.resize(kept);
+            std::sort(runs.begin(), runs.end());
+            for (size_t i = 0; i < runs.size();)
+            {
+                int a = runs[i].first, b = runs[i].second;
+                for (i++; i < runs.size() && runs[i].first <= b + 1; i++)
+                {
+                    b = std::max(b, runs[i].second);
+                }
+                plot.span(y, a, b);
+            }
+            runs.clear();
+        }
+    }
+
+    //! Rasterize an axis-aligned ellipse.
+    //! @param center Coordinates for the ellipse center.
+    //! @param radius Radius in X and Y axis.
+    //! @param plot Span receiver.
+    template <class Plot>
+    void raster_ellipse(const Point &center, const Point &radius, Plot &plot)
+    {
+        plot.span(center.y, std::min(center.x - radius.x, center.x + radius.x),
+                  std::max(center.x - radius.x, center.x + radius.x));
+        int x0 = radius.x;
+        int dx = 0;
+        for (int y = 1; y <= radius.y; y++)
+        {
+            check_cancel();
+            double vy = (double)y / (double)radius.y;
+            vy *= vy;
+            int x1 = x0 - (dx - 1);
+            for (; x1 > 0; x1--)
+            {
+                double vx = (double)x1 / (double)radius.x;
+                vx *= vx;
+                if (vx + vy <= 1)
+                {
+                    break;
+                }
+            }
+            dx = x0 - x1;
+            x0 = x1;
+            int left = std::min(center.x - x0, center.x + x0);
+            int right = std::max(center.x - x0, center.x + x0);
+            plot.span(center.y - y, left, right);
+            plot.span(center.y + y, left, right);
+        }
+    }
+
+    //! Get how far a rotated ellipse reaches from its center.
+    //! @param radius Radius in X and Y axis, before rotation.
+    //! @param degrees Rotation.
+    //! @return Largest horizontal and vertical distance, rounded up.
+    inline Point ellipse_extent(const Point &radius, int degrees)
+    {
+        double s, c;
+        degree_sin_cos(degrees, s, c);
+        double a = std::abs(radius.x), b = std::abs(radius.y);
+        return Point{(int)std::ceil(std::sqrt(a * a * c * c + b * b * s * s) - 1e-9),
+                     (int)std::ceil(std::sqrt(a * a * s * s + b * b * c * c) - 1e-9)};
+    }
+
+    //! Rasterize an ellipse rotated about its center: the pixels whose
+    //! center is inside. Each row solves the quadratic of the rotated
+    //! ellipse for x; its discriminant is a quadratic in y, updated with
+    //! two additions per row. Rows are kept touching, so that thin
+    //! ellipses have no gaps. Multiples of 90 degrees are drawn by the
+    //! axis-aligned raster_ellipse.
+    //! @param center Coordinates for the ellipse center.
+    //! @param radius Radius in X and Y axis, before rotation.
+    //! @param degrees Rotation, as in Point::rotate.
+    //! @param plot Span receiver.
+    template <class Plot>
+    void raster_ellipse(const Point &center, const Point &radius, int degrees, Plot &plot)
+    {
+        degrees %= 180;
+        if (degrees < 0)
+        {
+            degrees += 180;
+        }
+        if (degrees == 0)
+        {
+            raster_ellipse(center, radius, plot);
+            return;
+        }
+        if (degrees == 90)
+        {
+            raster_ellipse(center, Point{radius.y, radius.x}, plot);
+            return;
+        }
+        double s, c;
+        degree_sin_cos(degrees, s, c);
+        double a = std::abs(radius.x), b = std::abs(radius.y);
+        if (a == 0 || b == 0)
+        {
+            // Flat: the rotated axis
+            Point end = a == 0 ? Point{(int)std::lround(-s * b), (int)std::lround(c * b)}
+                               : Point{(int)std::lround(c * a), (int)std::lround(s * a)};
+            raster_line(Point{center.x - end.x, center.y - end.y}, Point{center.x + end.x, center.y + end.y}, plot);
+            return;
+        }
+        // Inside: A x^2 + B x y + C y^2 <= 1, so per row A x^2 + (B y) x + (C y^2 - 1) <= 0,
+        // whose discriminant is D(y) = 4 A - 4 y^2 / (a^2 b^2)
+        double A = c * c / (a * a) + s * s / (b * b);
+        double B = 2 * c * s * (1 / (a * a) - 1 / (b * b));
+        double k = 4 / (a * a * b * b);
+        int y_max = (int)std::floor(std::sqrt(4 * A / k));
+        double d = 4 * A - k * y_max * y_max;
+        // D(y + 1) - D(y) = -k (2 y + 1), itself changing by -2 k per row
+        double step = -k * (1 - 2 * y_max);
+        int prev_left = 0, prev_right = 0;
+        for (int y = -y_max; y <= y_max; y++)
+        {
+            check_cancel();
+            double root = std::sqrt(std::max(d, 0.0));
+            double mid = -B * y;
+            int left = (int)std::ceil((mid - root) / (2 * A));
+            int right = (int)std::floor((mid + root) / (2 * A));
+            if (left > right)
+            {
+                // No pixel center on the row: the one nearest the chord
+                left = right = (int)std::lround(mid / (2 * A));
+            }
+            if (y > -y_max)
+            {
+                left = std::min(left, prev_right + 1);
+                right = std::max(right, prev_left - 1);
+            }
+            plot.span(center.y + y, center.x + left, center.x + right);
+            prev_left = left;
+            prev_right = right;
+            d += step;
+            step -= 2 * k;
+        }
+    }
+}
+#endif
@@ -0,0 +1,505 @@
+//! @file RenderCost.cpp
+#include "RenderCost.hpp"
+#include "Point.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+namespace svg
+{
+    namespace
+    {
+        // Cost model, in nanoseconds on one core, fitted on the test documents
+        // (optimized build): encoding every pixel of the canvas dominates,
+        // then painting the shapes
+        const double NS_PER_CANVAS_PIXEL = 110;
+        const double NS_PER_FILL_PIXEL = 5;
+        const double NS_PER_VERTEX = 40;
+        const double NS_PER_SHAPE = 400;
+        const double NS_PER_BYTE = 6;
+        // Memory model, in bytes, measured on the test documents: the text is
+        // held twice (read and parsed), each element costs a tinyxml2 node and
+        // its attributes, then an SVGElement and its points; the pixels are in
+        // the framebuffer and, at worst, as much again in the encoded image
+        const size_t BYTES_PER_TEXT_BYTE = 2;
+        const size_t BYTES_PER_XML_ELEMENT = 256;
+        const size_t BYTES_PER_SHAPE = 192;
+        const size_t BYTES_PER_VERTEX = 2 * sizeof(Point);
+        const size_t BYTES_PER_CANVAS_PIXEL = 2 * 3;
+        //! Vertices of a flattened curve segment, on average.
+        const size_t CURVE_VERTICES = 8;
+
+        //! Attribute of a tag, pointing into the document.
+        struct Attribute
+        {
+            const char *name;
+            size_t name_size;
+            const char *value;
+            size_t value_size;
+        };
+
+        //! Totals of a subtree, kept for the uses referring to it.
+        struct Totals
+        {
+            size_t shapes;
+            size_t vertices;
+            double area;
+        };
+
+        //! Open element.
+        struct Frame
+        {
+            std::string id;
+            //! Scale of the element and its ancestors.
+            double scale;
+            Totals totals;
+        };
+
+        bool is_name_char(char c)
+        {
+            return c != '\0' && std::strchr(" \t\r\n/>=", c) == nullptr;
+        }
+
+        bool is_number_start(char c)
+        {
+            return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+        }
+
+        //! Walks the numbers of an attribute, whatever separates them.
+        class Numbers
+        {
+        public:
+            Numbers(const Attribute *a) : p_(a ? a->value : nullptr), end_(a ? a->value + a->value_size : nullptr) {}
+            //! Get the next number.
+            //! @param letter Receives the last letter skipped before it (unchanged if none).
+            //! @return False at the end.
+            bool next(double &v, char &letter)
+            {
+                while (p_ < end_ && !is_number_start(*p_))
+                {
+                    if ((*p_ >= 'a' && *p_ <= 'z') || (*p_ >= 'A' && *p_ <= 'Z'))
+                    {
+                        letter = *p_;
+                    }
+                    p_++;
+                }
+                if (p_ >= end_)
+                {
+                    return false;
+                }
+                char *stop;
+                v = std::strtod(p_, &stop);
+                p_ = stop > p_ ? (const char *)stop : p_ + 1;
+                return true;
+            }
+            bool next(double &v)
+            {
+                char letter;
+                return next(v, letter);
+            }
+
+        private:
+            const char *p_;
+            const char *end_;
+        };
+
+        const Attribute *find(const std::vector<Attribute> &attributes, const char *name)
+        {
+            size_t n = std::strlen(name);
+            for (const Attribute &a : attributes)
+            {
+                if (a.name_size == n && std::memcmp(a.name, name, n) == 0)
+                {
+                    return &a;
+                }
+            }
+            return nullptr;
+        }
+
+        double number(const std::vector<Attribute> &attributes, const char *name, double fallback)
+        {
+            double v;
+            Numbers numbers(find(attributes, name));
+            return numbers.next(v) ? v : fallback;
+        }
+
+        //! Number of arguments of a path command, 0 if unknown.
+        int path_arguments(char command)
+        {
+            switch (command)
+            {
+            case 'H': case 'h': case 'V': case 'v':
+                return 1;
+            case 'M': case 'm': case 'L': case 'l': case 'T': case 't':
+                return 2;
+            case 'S': case 's': case 'Q': case 'q':
+                return 4;
+            case 'C': case 'c':
+                return 6;
+            case 'A': case 'a':
+                return 7;
+            default:
+                return 0;
+            }
+        }
+
+        bool is_curve(char command)
+        {
+            return std::strchr("SsQqCcAaTt", command) != nullptr;
+        }
+
+        //! Estimates element by element, as the tags are read.
+        class Estimator
+        {
+        public:
+            Estimator(RenderCost &cost) : cost_(cost) {}
+
+            void open(const std::string &name, const std::vector<Attribute> &attributes)
+            {
+                cost_.elements[name]++;
+                Frame frame = {std::string(), frames_.empty() ? 1.0 : frames_.back().scale, Totals{0, 0, 0}};
+                if (const Attribute *id = find(attributes, "id"))
+                {
+                    frame.id.assign(id->value, id->value_size);
+                }
+                if (const Attribute *transform = find(attributes, "transform"))
+                {
+                    std::string t(transform->value, transform->value_size);
+                    double factor;
+                    Numbers numbers(transform);
+                    if (t.find("scale") != std::string::npos && numbers.next(factor))
+                    {
+                        frame.scale *= std::fabs(factor);
+                    }
+                }
+                if (frames_.empty())
+                {
+                    cost_.canvas_pixels = (uint64_t)std::max(0.0, number(attributes, "width", 0)) *
+                                          (uint64_t)std::max(0.0, number(attributes, "height", 0));
+                }
+                else
+                {
+                    cost_.depth = std::max(cost_.depth, (int)frames_.size());
+                    shape(name, attributes, frame);
+                }
+                frames_.push_back(frame);
+            }
+
+            void close()
+            {
+                if (frames_.empty())
+                {
+                    return;
+                }
+                Frame frame = frames_.back();
+                frames_.pop_back();
+                if (!frame.id.empty())
+                {
+                    ids_[frame.id] = frame.totals;
+                }
+                if (!frames_.empty())
+                {
+                    Totals &parent = frames_.back().totals;
+                    parent.shapes += frame.totals.shapes;
+                    parent.vertices += frame.totals.vertices;
+                    parent.area += frame.totals.area;
+                }
+                else
+                {
+                    root_ = frame.totals;
+                }
+            }
+
+            void finish(size_t bytes)
+            {
+                while (!frames_.empty())
+                {
+                    close();
+                }
+                size_t written = 0, xml_elements = 0;
+                for (const auto &entry : cost_.elements)
+                {
+                    if (drawn_shape(entry.first))
+                    {
+                        written += entry.second;
+                    }
+                    xml_elements += entry.second;
+                }
+                cost_.shapes = root_.shapes;
+                cost_.vertices = root_.vertices;
+                cost_.fill_area = root_.area;
+                cost_.use_expansion = written == 0 ? 1.0 : (double)root_.shapes / written;
+                cost_.bytes = bytes;
+                cost_.cost = (NS_PER_CANVAS_PIXEL * cost_.canvas_pixels + NS_PER_FILL_PIXEL * cost_.fill_area +
+                              NS_PER_VERTEX * cost_.vertices + NS_PER_SHAPE * cost_.shapes + NS_PER_BYTE * bytes) /
+                             1e6;
+                cost_.document_memory = BYTES_PER_TEXT_BYTE * bytes + BYTES_PER_XML_ELEMENT * xml_elements;
+                cost_.element_memory = BYTES_PER_SHAPE * cost_.shapes + BYTES_PER_VERTEX * cost_.vertices;
+                cost_.image_memory = (size_t)(BYTES_PER_CANVAS_PIXEL * cost_.canvas_pixels);
+                cost_.memory = cost_.document_memory + cost_.element_memory + cost_.image_memory;
+            }
+
+        private:
+            static bool drawn_shape(const std::string &name)
+            {
+                return name == "ellipse" || name == "circle" || name == "polyline" || name == "line" ||
+                       name == "polygon" || name == "path" || name == "rect";
+            }
+
+            //! Add the work of a shape, or of the subtree a use refers to.
+            void shape(const std::string &name, const std::vector<Attribute> &attributes, Frame &frame)
+            {
+                Totals &t = frame.totals;
+                if (name == "use")
+                {
+                    const Attribute *href = find(attributes, "href");
+                    if (href != nullptr && href->value_size > 1)
+                    {
+                        auto it = ids_.find(std::string(href->value + 1, href->value_size - 1));
+                        if (it != ids_.end())
+                        {
+                            double scale = frame.scale / (frames_.empty() ? 1.0 : frames_.back().scale);
+                            t.shapes += it->second.shapes;
+                            t.vertices += it->second.vertices;
+                            t.area += std::min(it->second.area * scale * scale, (double)cost_.canvas_pixels);
+                        }
+                    }
+                    return;
+                }
+                if (!drawn_shape(name))
+                {
+                    return;
+                }
+                double area = 0;
+                size_t vertices = 0;
+                if (name == "rect")
+                {
+                    area = number(attributes, "width", 0) * number(attributes, "height", 0);
+                    vertices = 4;
+                }
+                else if (name == "circle")
+                {
+                    double r = number(attributes, "r", 0);
+                    area = M_PI * r * r;
+                }
+                else if (name == "ellipse")
+                {
+                    area = M_PI * number(attributes, "rx", 0) * number(attributes, "ry", 0);
+                }
+                else if (name == "line")
+                {
+                    double dx = number(attributes, "x2", 0) - number(attributes, "x1", 0);
+                    double dy = number(attributes, "y2", 0) - number(attributes, "y1", 0);
+                    area = std::hypot(dx, dy) * std::max(number(attributes, "stroke-width", 1), 1.0);
+                    vertices = 2;
+                }
+                else
+                {
+                    outline(name, attributes, area, vertices);
+                }
+                t.shapes++;
+                t.vertices += vertices;
+                t.area += std::min(std::fabs(area) * frame.scale * frame.scale, (double)cost_.canvas_pixels);
+            }
+
+            //! Vertices and area of a polyline, polygon or path: polylines
+            //! paint their length times the stroke width, others their bounding box.
+            void outline(const std::string &name, const std::vector<Attribute> &attributes, double &area, size_t &vertices)
+            {
+                bool path = name == "path";
+                Numbers numbers(find(attributes, path ? "d" : "points"));
+                double v, x = 0, min_x = 0, min_y = 0, max_x = 0, max_y = 0, length = 0, px = 0, py = 0;
+                char command = 'L', last = 0;
+                size_t count = 0, segment = 0;
+                while (numbers.next(v, command))
+                {
+                    if (path && command != last)
+                    {
+                        last = command;
+                        segment = 0;
+                    }
+                    if (path)
+                    {
+                        // One vertex per segment of the command, more for curves
+                        int arguments = std::max(path_arguments(command), 1);
+                        if (segment++ % arguments == 0)
+                        {
+                            vertices += is_curve(command) ? CURVE_VERTICES : 1;
+                        }
+                    }
+                    if (count++ % 2 == 0)
+                    {
+                        x = v;
+                        continue;
+                    }
+                    if (count == 2)
+                    {
+                        min_x = max_x = x;
+                        min_y = max_y = v;
+                    }
+                    else
+                    {
+                        length += std::hypot(x - px, v - py);
+                    }
+                    min_x = std::min(min_x, x);
+                    max_x = std::max(max_x, x);
+                    min_y = std::min(min_y, v);
+                    max_y = std::max(max_y, v);
+                    px = x;
+                    py = v;
+                }
+                if (!path)
+                {
+                    vertices = count / 2;
+                }
+                if (name == "polyline")
+                {
+                    area = length * std::max(number(attributes, "stroke-width", 1), 1.0);
+                }
+                else
+                {
+                    area = (max_x - min_x + 1) * (max_y - min_y + 1);
+                }
+            }
+
+            RenderCost &cost_;
+            std::vector<Frame> frames_;
+            std::map<std::string, Totals> ids_;
+            Totals root_ = {0, 0, 0};
+        };
+
+        //! Skip past the next occurrence of a string.
+        //! @return End of the document if not found.
+        const char *skip_past(const char *p, const char *end, const char *what)
+        {
+            size_t n = std::strlen(what);
+            for (; p + n <= end; p++)
+            {
+                if (std::memcmp(p, what, n) == 0)
+                {
+                    return p + n;
+                }
+            }
+            return end;
+        }
+    }
+
+    void estimate_cost(const char *svg_data, size_t size, RenderCost &cost)
+    {
+        cost = RenderCost{std::map<std::string, size_t>(), 0, 0, 0, 1.0, 0, 0, 0, 0, 0, 0, 0, 0};
+        Estimator estimator(cost);
+        std::vector<Attribute> attributes;
+        const char *p = svg_data, *end = svg_data + size;
+        while ((p = (const char *)std::memchr(p, '<', end - p)) != nullptr)
+        {
+            p++;
+            if (p < end && *p == '?')
+            {
+                p = skip_past(p, end, "?>");
+                continue;
+            }
+            if (end - p >= 3 && std::memcmp(p, "!--", 3) == 0)
+            {
+                p = skip_past(p, end, "-->");
+                continue;
+            }
+            if (p < end && (*p == '!' || *p == '/'))
+            {
+                if (*p == '/')
+                {
+                    estimator.close();
+                }
+                p = skip_past(p, end, ">");
+                continue;
+            }
+            const char *name = p;
+            while (p < end && is_name_char(*p))
+            {
+                p++;
+            }
+            std::string element(name, p - name);
+            // Attributes, up to the end of the tag
+            attributes.clear();
+            bool closed = false;
+            while (p < end)
+            {
+                while (p < end && std::strchr(" \t\r\n", *p) != nullptr)
+                {
+                    p++;
+                }
+                if (p >= end || *p == '>' || *p == '/')
+                {
+                    closed = p < end && *p == '/';
+                    p = skip_past(p, end, ">");
+                    break;
+                }
+                Attribute a = {p, 0, nullptr, 0};
+                while (p < end && is_name_char(*p))
+                {
+                    p++;
+                }
+                a.name_size = p - a.name;
+                p = std::find(p, end, '=');
+                while (p < end && *p != '"' && *p != '\'')
+                {
+                    p++;
+                }
+                if (p >= end)
+                {
+                    break;
+                }
+                char quote = *p++;
+                a.value = p;
+                p = std::find(p, end, quote);
+                a.value_size = p - a.value;
+                if (p < end)
+                {
+                    p++;
+                }
+                attributes.push_back(a);
+            }
+            estimator.open(element, attributes);
+            if (closed)
+            {
+                estimator.close();
+            }
+        }
+        estimator.finish(size);
+    }
+
+    void estimate_cost(const std::string &svg_file, RenderCost &cost)
+    {
+        std::ifstream in(svg_file, std::ios::binary);
+        if (!in)
+        {
+            throw std::runtime_error(svg_file + ": could not open!");
+        }
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        estimate_cost(data.data(), data.size(), cost);
+    }
+
+    void print_cost(std::ostream &out, const RenderCost &cost)
+    {
+        out << "elements:";
+        for (const auto &entry : cost.elements)
+        {
+            out << ' ' << entry.first << '=' << entry.second;
+        }
+        out << "\nshapes drawn: " << cost.shapes << " (use expansion " << cost.use_expansion << ")"
+            << "\nvertices: " << cost.vertices
+            << "\ndepth: " << cost.depth
+            << "\ncanvas pixels: " << cost.canvas_pixels
+            << "\nfill area: " << (uint64_t)cost.fill_area
+            << "\nbytes: " << cost.bytes
+            << "\nestimated cost: " << cost.cost << " ms"
+            << "\nestimated memory: " << cost.memory << " bytes (document " << cost.document_memory
+            << ", elements " << cost.element_memory << ", image " << cost.image_memory << ")" << std::endl;
+    }
+}
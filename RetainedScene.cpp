@@ -0,0 +1,155 @@
+//! @file RetainedScene.cpp
+#include "RetainedScene.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace svg
+{
+    namespace
+    {
+        //! Delete elements and empty their vector.
+        void delete_elements(std::vector<SVGElement *> &elements)
+        {
+            for (SVGElement *e : elements)
+            {
+                delete e;
+            }
+            elements.clear();
+        }
+
+        //! Read a document, as convert does; nothing is kept if it throws.
+        //! @return Document dimensions.
+        Point load(const std::string &svg_file, std::vector<SVGElement *> &elements, const RenderOptions &options)
+        {
+            Point dimensions;
+            try
+            {
+                load_elements(svg_file, dimensions, elements, options);
+            }
+            catch (...)
+            {
+                delete_elements(elements);
+                throw;
+            }
+            return dimensions;
+        }
+
+        //! Check if a bounding box is empty.
+        bool empty_box(const Point &top_left, const Point &bottom_right)
+        {
+            return top_left.x > bottom_right.x || top_left.y > bottom_right.y;
+        }
+
+        //! Check if two non-empty rectangles share a pixel.
+        bool overlap(const Point &a0, const Point &a1, const Point &b0, const Point &b1)
+        {
+            return a0.x <= b1.x && b0.x <= a1.x && a0.y <= b1.y && b0.y <= a1.y;
+        }
+    }
+
+    RetainedScene::RetainedScene(const std::string &svg_file, const RenderOptions &options)
+        : dimensions_(load(svg_file, elements_, options)),
+          image_(dimensions_.x, dimensions_.y), index_(elements_), redrawn_(0)
+    {
+        image_.set_parallel_fill(options.parallel_fill_vertices, options.parallel_fill_area);
+        image_.set_antialias(options.antialias);
+        try
+        {
+            render_elements(elements_, image_, options);
+        }
+        catch (...)
+        {
+            // The destructor does not run for a constructor that throws
+            delete_elements(elements_);
+            throw;
+        }
+    }
+
+    RetainedScene::~RetainedScene()
+    {
+        delete_elements(elements_);
+    }
+
+    size_t RetainedScene::size() const
+    {
+        return elements_.size();
+    }
+
+    const SVGElement &RetainedScene::element(size_t i) const
+    {
+        return *elements_.at(i);
+    }
+
+    const PNGImage &RetainedScene::image() const
+    {
+        return image_;
+    }
+
+    size_t RetainedScene::redrawn() const
+    {
+        return redrawn_;
+    }
+
+    void RetainedScene::save(const std::string &png_file) const
+    {
+        image_.save(png_file);
+    }
+
+    void RetainedScene::translate(size_t i, int x, int y)
+    {
+        edit(i, [x, y](SVGElement &e)
+             {
+                 e.translate(x, y);
+             });
+    }
+
+    void RetainedScene::edit(size_t i, const std::function<void(SVGElement &)> &change)
+    {
+        SVGElement &e = *elements_.at(i);
+        Point old_top_left, old_bottom_right, top_left, bottom_right;
+        index_.bounds(i, old_top_left, old_bottom_right);
+        change(e);
+        e.get_bounds(top_left, bottom_right);
+        index_.move(i, top_left, bottom_right);
+        if (empty_box(old_top_left, old_bottom_right))
+        {
+            redraw(top_left, bottom_right);
+        }
+        else if (empty_box(top_left, bottom_right))
+        {
+            redraw(old_top_left, old_bottom_right);
+        }
+        else if (overlap(old_top_left, old_bottom_right, top_left, bottom_right))
+        {
+            redraw(Point{std::min(old_top_left.x, top_left.x), std::min(old_top_left.y, top_left.y)},
+                   Point{std::max(old_bottom_right.x, bottom_right.x), std::max(old_bottom_right.y, bottom_right.y)});
+        }
+        else
+        {
+            // Far apart: two small rectangles instead of their union
+            redraw(old_top_left, old_bottom_right);
+            redraw(top_left, bottom_right);
+        }
+    }
+
+    void RetainedScene::redraw(const Point &top_left, const Point &bottom_right)
+    {
+        Point clip_min = {std::max(top_left.x, 0), std::max(top_left.y, 0)};
+        Point clip_max = {std::min(bottom_right.x, dimensions_.x - 1), std::min(bottom_right.y, dimensions_.y - 1)};
+        if (empty_box(clip_min, clip_max))
+        {
+            return;
+        }
+        image_.set_clip(clip_min, clip_max);
+        image_.fill_rect(clip_min, clip_max, Color{255, 255, 255});
+        // Ascending, so in document order
+        index_.query(clip_min, clip_max, found_);
+        for (size_t i : found_)
+        {
+            elements_[i]->draw(image_);
+        }
+        redrawn_ += found_.size();
+        image_.reset_clip();
+    }
+}
@@ -0,0 +1,81 @@
+//! @file RetainedScene.hpp
+#ifndef __svg_RetainedScene_hpp__
+#define __svg_RetainedScene_hpp__
+
+#include "PNGImage.hpp"
+#include "Point.hpp"
+#include "SVGElements.hpp"
+#include "SpatialIndex.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Document kept in memory with its drawing, for interactive editing.
+    //! The document is read and drawn once. Each edit then only redraws the
+    //! rectangles it changed: they are cleared to white and every element
+    //! overlapping them is drawn again, clipped to them, in document order.
+    //! The bounding boxes of the elements are kept in a spatial index, where
+    //! only the edited element is updated, so the cost of an edit depends on
+    //! the area it touches, not on the size of the document.
+    class RetainedScene
+    {
+    public:
+        //! Constructor, reads and draws a document.
+        //! @param svg_file SVG file.
+        //! @param options Render options; occlusion and spans only apply to the first drawing.
+        RetainedScene(const std::string &svg_file, const RenderOptions &options = RenderOptions());
+        //! Destructor, deletes the elements.
+        ~RetainedScene();
+        //! Get the number of top-level elements.
+        //! @return Number of elements.
+        size_t size() const;
+        //! Get a top-level element.
+        //! @param i Element number, in document order.
+        //! @return Element.
+        const SVGElement &element(size_t i) const;
+        //! Get the current drawing.
+        //! @return Image.
+        const PNGImage &image() const;
+        //! Save the current drawing.
+        //! @param png_file Output file.
+        void save(const std::string &png_file) const;
+        //! Translate an element and redraw what changed.
+        //! @param i Element number.
+        //! @param x X translation.
+        //! @param y Y translation.
+        void translate(size_t i, int x, int y);
+        //! Change an element and redraw what changed.
+        //! @param i Element number.
+        //! @param change Function changing the element in place.
+        void edit(size_t i, const std::function<void(SVGElement &)> &change);
+        //! Redraw a rectangle from the elements.
+        //! @param top_left Top-left corner.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        void redraw(const Point &top_left, const Point &bottom_right);
+        //! Get the number of elements drawn again by edits and redraws so far.
+        //! @return Number of element drawings.
+        size_t redrawn() const;
+
+    private:
+        RetainedScene(const RetainedScene &);
+        RetainedScene &operator=(const RetainedScene &);
+
+        //! Top-level elements, owned.
+        std::vector<SVGElement *> elements_;
+        //! Document dimensions.
+        Point dimensions_;
+        //! Drawing of the elements.
+        PNGImage image_;
+        //! Bounding boxes of the elements.
+        SpatialIndex index_;
+        //! Elements drawn again so far.
+        size_t redrawn_;
+        //! Elements found by the last redraw, kept for its storage.
+        std::vector<size_t> found_;
+    };
+}
+#endif
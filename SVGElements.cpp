@@ -1,13 +1,100 @@
 #include "SVGElements.hpp"
+#include "Cancel.hpp"
+#include "SceneCache.hpp"
+#include "Raster.hpp"
 #include <sstream>
 #include <iostream>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 
 namespace svg
 {
     // These must be defined!
-    SVGElement::SVGElement() {}
+    SVGElement::SVGElement() : alpha(OPAQUE_ALPHA) {}
     SVGElement::~SVGElement() {}
 
+    /// @brief Draws at the opacity of an element, back to opaque drawing on exit
+    class AlphaScope
+    {
+    public:
+        AlphaScope(Canvas &img, rgb_value alpha) : img(img), alpha(alpha)
+        {
+            if (alpha != OPAQUE_ALPHA)
+            {
+                img.set_alpha(alpha);
+            }
+        }
+        ~AlphaScope()
+        {
+            if (alpha != OPAQUE_ALPHA)
+            {
+                img.set_alpha(OPAQUE_ALPHA);
+            }
+        }
+
+    private:
+        Canvas &img;
+        rgb_value alpha;
+    };
+
+    /// @brief Bounding box of a point array
+    /// @param points First point
+    /// @param count Number of points
+    /// @param top_left Top-left corner
+    /// @param bottom_right Bottom-right corner
+    static void points_bounds(const Point *points, size_t count, Point &top_left, Point &bottom_right)
+    {
+        top_left = Point{INT_MAX, INT_MAX};
+        bottom_right = Point{INT_MIN, INT_MIN};
+        for (size_t i = 0; i < count; i++)
+        {
+            top_left.x = std::min(top_left.x, points[i].x);
+            top_left.y = std::min(top_left.y, points[i].y);
+            bottom_right.x = std::max(bottom_right.x, points[i].x);
+            bottom_right.y = std::max(bottom_right.y, points[i].y);
+        }
+    }
+
+    /// @brief Bounding box of a point list, packed or not
+    /// @param points Points
+    /// @param top_left Top-left corner
+    /// @param bottom_right Bottom-right corner, inclusive
+    static void list_bounds(const PointList &points, Point &top_left, Point &bottom_right)
+    {
+        if (!points.packed())
+        {
+            points_bounds(points.data(), points.size(), top_left, bottom_right);
+            return;
+        }
+        points_bounds(nullptr, 0, top_left, bottom_right);
+        for (const Point &p : points.packed_points())
+        {
+            top_left.x = std::min(top_left.x, p.x);
+            top_left.y = std::min(top_left.y, p.y);
+            bottom_right.x = std::max(bottom_right.x, p.x);
+            bottom_right.y = std::max(bottom_right.y, p.y);
+        }
+    }
+
+    /// @brief Writes a point list to a scene, unpacking packed points
+    /// @param out Scene writer
+    /// @param points Points
+    static void put_points(SceneWriter &out, const PointList &points)
+    {
+        if (!points.packed())
+        {
+            out.put(points.data(), points.size());
+            return;
+        }
+        std::vector<Point> unpacked;
+        points.packed_points().unpack(unpacked);
+        out.put(unpacked.data(), unpacked.size());
+    }
+
     std::vector<Point> parse_points(std::string& point_string){
         std::vector<Point> ret;
         remove_commas(point_string);
@@ -20,6 +107,44 @@ namespace svg
         return ret;
     }
 
+    /// @brief Reads the next int of a point string, skipping blanks and commas
+    /// @param p Read position, advanced past the int
+    /// @param v Receives the int
+    /// @return False if there is no valid int at the position
+    static bool next_coordinate(const char *&p, int &v){
+        while (*p == ',' || std::isspace((unsigned char)*p)){
+            p++;
+        }
+        char *end;
+        errno = 0;
+        long l = std::strtol(p, &end, 10);
+        if (end == p || errno == ERANGE || l < INT_MIN || l > INT_MAX){
+            return false;
+        }
+        p = end;
+        v = (int)l;
+        return true;
+    }
+
+    PointList parse_point_list(const char *point_string){
+        if (point_string == nullptr){
+            return PointList();
+        }
+        // Count first, so that the list is allocated at most once
+        size_t count = 0;
+        int v;
+        for (const char *p = point_string; next_coordinate(p, v); ){
+            count++;
+        }
+        PointList ret(count / 2);
+        const char *p = point_string;
+        for (Point &point : ret){
+            next_coordinate(p, point.x);
+            next_coordinate(p, point.y);
+        }
+        return ret;
+    }
+
     void remove_commas(std::string& str){
         for (char &c : str)
         {
@@ -34,13 +159,18 @@ namespace svg
                      const Point &center,
                      const int radius_x, 
                      const int radius_y)
-        : fill(fill), center(center), radius_x(radius_x), radius_y(radius_y)
+        : fill(fill), center(center), radius_x(radius_x), radius_y(radius_y), degrees(0)
     {
     }
 
-    void Ellipse::draw(PNGImage &img) const
+    void Ellipse::draw(Canvas &img) const
     {
-        img.draw_ellipse(center, Point{radius_x, radius_y}, fill);
+        if (alpha == 0)
+        {
+            return;
+        }
+        AlphaScope scope(img, alpha);
+        img.draw_ellipse(center, Point{radius_x, radius_y}, degrees, fill);
     }
 
     void Ellipse::translate(int x, int y) 
@@ -51,8 +181,10 @@ namespace svg
 
     void Ellipse::rotate(int origin_x, int origin_y, int angle) 
     {
-        Point rotate_origin = Point{origin_x, origin_x};
+        Point rotate_origin = Point{origin_x, origin_y};
         center = center.rotate(rotate_origin, angle);
+        // Kept in [0, 360), whatever the sign of angle
+        degrees = ((degrees + angle) % 360 + 360) % 360;
     }
 
     void Ellipse::scale(int origin_x, int origin_y, int value) {
@@ -67,52 +199,137 @@ namespace svg
         return new_ellipse;
     }
 
+    void Ellipse::serialize(SceneWriter &out) const
+    {
+        out.put(SCENE_ELLIPSE);
+        out.put(fill, alpha);
+        out.put(center.x);
+        out.put(center.y);
+        out.put(radius_x);
+        out.put(radius_y);
+        out.put(degrees);
+    }
+
     Circle::Circle(const Color &fill,
                    const Point &center, 
                    const int radius) 
         : Ellipse(fill, center, radius, radius) {} 
     
-    void Circle::draw(PNGImage &img) const
+    void Circle::draw(Canvas &img) const
     {
-        img.draw_ellipse(center, Point{radius_x, radius_x}, fill);
+        if (alpha == 0)
+        {
+            return;
+        }
+        AlphaScope scope(img, alpha);
+        img.draw_ellipse(center, Point{radius_x, radius_x}, 0, fill);
         // Comentar sobre isto depois (Point{radius_x, radius_x})
     }
 
+    void Ellipse::get_bounds(Point &top_left, Point &bottom_right) const
+    {
+        Point extent = ellipse_extent(Point{radius_x, radius_y}, degrees);
+        top_left = Point{center.x - extent.x, center.y - extent.y};
+        bottom_right = Point{center.x + extent.x, center.y + extent.y};
+    }
+
+    size_t Ellipse::get_memory() const
+    {
+        return sizeof(*this);
+    }
+
+    void Circle::get_bounds(Point &top_left, Point &bottom_right) const
+    {
+        top_left = Point{center.x - std::abs(radius_x), center.y - std::abs(radius_x)};
+        bottom_right = Point{center.x + std::abs(radius_x), center.y + std::abs(radius_x)};
+    }
+
+    void Circle::serialize(SceneWriter &out) const
+    {
+        // Stored as the ellipse Circle::draw produces
+        out.put(SCENE_ELLIPSE);
+        out.put(fill, alpha);
+        out.put(center.x);
+        out.put(center.y);
+        out.put(radius_x);
+        out.put(radius_x);
+        out.put(0);
+    }
+
     Polyline::Polyline(const Color &stroke, 
-                       const std::vector<Point>& points) 
-        : stroke(stroke), points(points){}
+                       PointList points,
+                       const StrokeStyle &style) 
+        : stroke(stroke), points(std::move(points)), style(style){}
     
-    void Polyline::draw(PNGImage &img) const 
+    void Polyline::draw(Canvas &img) const 
     {
-        for (size_t i = 1; i < points.size(); i++)
+        if (alpha == 0)
+        {
+            return;
+        }
+        if (style.wide())
+        {
+            AlphaScope scope(img, alpha);
+            if (points.packed())
+            {
+                img.draw_stroke(points.packed_points(), style, stroke);
+            }
+            else
+            {
+                img.draw_stroke(points.data(), points.size(), style, stroke);
+            }
+            return;
+        }
+        // Segments share their end points, so translucent polylines are
+        // drawn opaque in a layer, composited once
+        bool layer = alpha != OPAQUE_ALPHA;
+        if (layer)
+        {
+            Point top_left, bottom_right;
+            get_bounds(top_left, bottom_right);
+            img.begin_layer(top_left, bottom_right);
+        }
+        if (points.packed())
+        {
+            // Decoded on the fly, one segment at a time
+            PackedPoints::const_iterator it = points.packed_points().begin();
+            Point previous = *it;
+            for (++it; it != points.packed_points().end(); ++it)
+            {
+                img.draw_line(previous, *it, stroke);
+                previous = *it;
+            }
+        }
+        else
+        {
+            for (size_t i = 1; i < points.size(); i++)
+            {
+                img.draw_line(points[i-1], points[i], stroke);
+            }
+        }
+        if (layer)
         {
-            img.draw_line(points[i-1], points[i], stroke);
+            img.end_layer(alpha);
         }
     }
 
     void Polyline::translate(int x, int y) 
     {
-        for(Point& point : points){
-            point.x += x;
-            point.y += y;
-        }
+        points.translate(Point{x, y});
     }
 
     void Polyline::rotate(int origin_x, int origin_y, int angle)  
     {
-        Point origin = Point{origin_x, origin_y};
-        std::vector<Point> nPoints;
-        for(Point& point : points) 
-        {
-            point = point.rotate(origin, angle);
-        }
+        points.rotate(Point{origin_x, origin_y}, angle);
     }
 
     void Polyline::scale(int origin_x, int origin_y, int value) 
     {
-        Point origin = Point{origin_x, origin_y};
-        for(Point& point : points){
-            point = point.scale(origin, value);
+        points.scale(Point{origin_x, origin_y}, value);
+        // One-pixel lines stay one pixel wide, as they always have
+        if (style.wide())
+        {
+            style.width *= std::abs(value);
         }
     }
 
@@ -121,42 +338,82 @@ namespace svg
         return new_polyline;
     }
 
-    Line::Line(const Color &stroke, const int x1, const int y1, const int x2, const int y2) : Polyline(stroke, {Point{x1,y1},Point{x2,y2}}){}
+    void Polyline::get_bounds(Point &top_left, Point &bottom_right) const
+    {
+        // A single point draws nothing
+        if (points.size() < 2)
+        {
+            points_bounds(nullptr, 0, top_left, bottom_right);
+            return;
+        }
+        list_bounds(points, top_left, bottom_right);
+        if (style.wide())
+        {
+            int reach = (int)std::ceil(style.reach());
+            top_left = Point{top_left.x - reach, top_left.y - reach};
+            bottom_right = Point{bottom_right.x + reach, bottom_right.y + reach};
+        }
+    }
+
+    size_t Polyline::get_memory() const
+    {
+        return sizeof(*this) + points.heap_bytes();
+    }
+
+    void Polyline::serialize(SceneWriter &out) const
+    {
+        out.put(SCENE_POLYLINE);
+        out.put(stroke, alpha);
+        out.put((int32_t)std::lround(style.width * SCENE_FIXED_ONE));
+        out.put((int32_t)style.join);
+        out.put((int32_t)style.cap);
+        out.put((int32_t)std::lround(style.miter_limit * SCENE_FIXED_ONE));
+        put_points(out, points);
+    }
+
+    Line::Line(const Color &stroke, const int x1, const int y1, const int x2, const int y2, const StrokeStyle &style)
+        : Polyline(stroke, {Point{x1,y1},Point{x2,y2}}, style){}
     
-    void Line::draw(PNGImage &img) const {
+    void Line::draw(Canvas &img) const {
+        if (style.wide() || alpha == 0)
+        {
+            Polyline::draw(img);
+            return;
+        }
+        AlphaScope scope(img, alpha);
         img.draw_line(points[0], points[1] , stroke);
     }
 
     Polygon::Polygon(const Color &fill, 
-                     const std::vector<Point>& points)
-        : fill(fill), points(points){
+                     PointList points)
+        : fill(fill), points(std::move(points)){
     }
 
-    void Polygon::draw(PNGImage &img) const {
-        img.draw_polygon(points, fill);
+    void Polygon::draw(Canvas &img) const {
+        if (alpha == 0)
+        {
+            return;
+        }
+        AlphaScope scope(img, alpha);
+        if (points.packed())
+        {
+            img.draw_polygon(points.packed_points(), fill);
+            return;
+        }
+        img.draw_polygon(points.data(), points.size(), fill);
     }
 
     void Polygon::translate(int x, int y)  
     {
-        for(Point& point : points){
-            point.x+=x;
-            point.y+=y;
-        }
+        points.translate(Point{x, y});
     }
     void Polygon::rotate(int origin_x, int origin_y, int angle)  
     {
-        Point origin = Point{origin_x, origin_y};
-        for(Point& point : points) 
-        {
-            point = point.rotate(origin, angle);
-        }
+        points.rotate(Point{origin_x, origin_y}, angle);
     }
     void Polygon::scale(int origin_x, int origin_y, int value)  
     {
-        Point origin = Point{origin_x, origin_y};
-        for(Point& point : points){
-            point = point.scale(origin, value);
-        }
+        points.scale(Point{origin_x, origin_y}, value);
     }
 
     SVGElement *Polygon::duplicate(std::string id, SVGElement *elem){
@@ -164,6 +421,23 @@ namespace svg
         return new_polygon;
     }
 
+    void Polygon::get_bounds(Point &top_left, Point &bottom_right) const
+    {
+        list_bounds(points, top_left, bottom_right);
+    }
+
+    size_t Polygon::get_memory() const
+    {
+        return sizeof(*this) + points.heap_bytes();
+    }
+
+    void Polygon::serialize(SceneWriter &out) const
+    {
+        out.put(SCENE_POLYGON);
+        out.put(fill, alpha);
+        put_points(out, points);
+    }
+
     Rect::Rect(const Color &fill,
                int x,
                int y,
@@ -171,16 +445,171 @@ namespace svg
                int height) 
         : Polygon(fill, {Point{x,y}, Point{x+width-1, y}, Point{x+width-1, y+height-1}, Point{x, y+height-1}}) {}
     
-    void Rect::draw(PNGImage &img) const {
-        img.draw_polygon(points, fill);
+    void Rect::draw(Canvas &img) const {
+        if (alpha == 0)
+        {
+            return;
+        }
+        AlphaScope scope(img, alpha);
+        img.draw_polygon(points.data(), points.size(), fill);
     } 
 
-    Group::Group(std::vector<SVGElement *> elements) : elements(elements) {};
+    bool Polygon::get_box(Point &top_left, Point &bottom_right) const
+    {
+        if (points.size() != 4)
+        {
+            return false;
+        }
+        const Point *p = points.data();
+        // Scanlines then fill between the two vertical edges, and the
+        // outline covers the remaining border row and degenerate cases.
+        bool h_first = p[0].y == p[1].y && p[1].x == p[2].x && p[2].y == p[3].y && p[3].x == p[0].x;
+        bool v_first = p[0].x == p[1].x && p[1].y == p[2].y && p[2].x == p[3].x && p[3].y == p[0].y;
+        if (!h_first && !v_first)
+        {
+            return false;
+        }
+        top_left = Point{std::min(p[0].x, p[2].x), std::min(p[0].y, p[2].y)};
+        bottom_right = Point{std::max(p[0].x, p[2].x), std::max(p[0].y, p[2].y)};
+        return true;
+    }
+
+    Box::Box(const Color &fill, const Point &top_left, const Point &bottom_right)
+        : Polygon(fill, {top_left, Point{bottom_right.x, top_left.y}, bottom_right, Point{top_left.x, bottom_right.y}}) {}
+
+    void Box::draw(Canvas &img) const {
+        Point top_left, bottom_right;
+        if (get_box(top_left, bottom_right))
+        {
+            if (alpha == 0)
+            {
+                return;
+            }
+            AlphaScope scope(img, alpha);
+            img.fill_rect(top_left, bottom_right, fill);
+        }
+        else
+        {
+            Polygon::draw(img);
+        }
+    }
+
+    SVGElement *Box::duplicate(std::string id, SVGElement *elem){
+        return new Box(*dynamic_cast<Box*>(elem));
+    }
+
+    Path::Path(const Color &fill, FillRule rule, PointList points, std::vector<size_t> ends)
+        : fill(fill), rule(rule), points(std::move(points)), ends(std::move(ends)) {
+        if (this->ends.size() == 1){
+            this->ends.clear();
+        }
+    }
+
+    void Path::draw(Canvas &img) const {
+        if (alpha == 0)
+        {
+            return;
+        }
+        AlphaScope scope(img, alpha);
+        if (ends.empty())
+        {
+            size_t end = points.size();
+            if (end != 0)
+            {
+                img.draw_path(points.data(), &end, 1, rule, fill);
+            }
+            return;
+        }
+        img.draw_path(points.data(), ends.data(), ends.size(), rule, fill);
+    }
+
+    void Path::translate(int x, int y)
+    {
+        points.translate(Point{x, y});
+    }
+    void Path::rotate(int origin_x, int origin_y, int angle)
+    {
+        points.rotate(Point{origin_x, origin_y}, angle);
+    }
+    void Path::scale(int origin_x, int origin_y, int value)
+    {
+        points.scale(Point{origin_x, origin_y}, value);
+    }
+
+    SVGElement *Path::duplicate(std::string id, SVGElement *elem){
+        return new Path(*dynamic_cast<Path*>(elem));
+    }
 
-    void Group::draw(PNGImage &img) const{
+    void Path::get_bounds(Point &top_left, Point &bottom_right) const
+    {
+        list_bounds(points, top_left, bottom_right);
+    }
+
+    size_t Path::get_memory() const
+    {
+        return sizeof(*this) + points.heap_bytes() + ends.capacity() * sizeof(size_t);
+    }
+
+    void Path::serialize(SceneWriter &out) const
+    {
+        out.put(SCENE_PATH);
+        out.put(fill, alpha);
+        out.put((int32_t)rule);
+        if (ends.empty())
+        {
+            out.put(points.empty() ? 0 : 1);
+            if (!points.empty())
+            {
+                out.put((int32_t)points.size());
+            }
+        }
+        else
+        {
+            out.put((int32_t)ends.size());
+            for (size_t end : ends)
+            {
+                out.put((int32_t)end);
+            }
+        }
+        put_points(out, points);
+    }
+
+    Group::Group(std::vector<SVGElement *> elements) : elements(std::move(elements)) {};
+
+    Group::~Group(){
         for(SVGElement *elem : elements){
+            delete elem;
+        }
+    }
+
+    std::vector<SVGElement *> Group::release_elements(){
+        std::vector<SVGElement *> members;
+        members.swap(elements);
+        return members;
+    }
+
+    void Group::draw(Canvas &img) const{
+        if (alpha == 0)
+        {
+            return;
+        }
+        if (alpha == OPAQUE_ALPHA)
+        {
+            for(SVGElement *elem : elements){
+                check_cancel();
+                elem->draw(img);
+            }
+            return;
+        }
+        // Members are composited together, as one translucent image
+        Point top_left, bottom_right;
+        get_bounds(top_left, bottom_right);
+        img.begin_layer(top_left, bottom_right);
+        for(SVGElement *elem : elements){
+            check_cancel();
             elem->draw(img);
         }
+        img.end_layer(alpha);
     }
 
     void Group::translate(int x, int y){
@@ -203,12 +632,67 @@ namespace svg
 
     SVGElement *Group::duplicate(std::string id, SVGElement *elem){
         Group *group = dynamic_cast<Group*>(elem);
-        std::vector<SVGElement *> members = group->get_elements();
         std::vector<SVGElement *> new_elements;
-        for(SVGElement *e : elements){
-            new_elements.push_back(e->duplicate(id, e));
+        new_elements.reserve(group->elements.size());
+        try {
+            // Nested uses multiply: a deep copy may be huge
+            for(SVGElement *e : group->elements){
+                check_cancel();
+                new_elements.push_back(e->duplicate(id, e));
+            }
+        }
+        catch (...) {
+            for (SVGElement *e : new_elements){
+                delete e;
+            }
+            throw;
         }
-        Group *new_group = new Group(new_elements);
+        Group *new_group = new Group(std::move(new_elements));
+        new_group->set_alpha(group->alpha);
         return new_group;
     }
+
+    void Group::get_bounds(Point &top_left, Point &bottom_right) const
+    {
+        points_bounds(nullptr, 0, top_left, bottom_right);
+        for (SVGElement *elem : elements)
+        {
+            Point tl, br;
+            elem->get_bounds(tl, br);
+            if (tl.x <= br.x && tl.y <= br.y)
+            {
+                top_left.x = std::min(top_left.x, tl.x);
+                top_left.y = std::min(top_left.y, tl.y);
+                bottom_right.x = std::max(bottom_right.x, br.x);
+                bottom_right.y = std::max(bottom_right.y, br.y);
+            }
+        }
+    }
+
+    size_t Group::get_memory() const
+    {
+        size_t bytes = sizeof(*this) + elements.capacity() * sizeof(SVGElement *);
+        for (SVGElement *elem : elements)
+        {
+            bytes += elem->get_memory();
+        }
+        return bytes;
+    }
+
+    void Group::serialize(SceneWriter &out) const
+    {
+        Point top_left, bottom_right;
+        get_bounds(top_left, bottom_right);
+        out.put(SCENE_GROUP);
+        out.put((int32_t)elements.size());
+        out.put((int32_t)alpha);
+        out.put(top_left.x);
+        out.put(top_left.y);
+        out.put(bottom_right.x);
+        out.put(bottom_right.y);
+        for (SVGElement *elem : elements)
+        {
+            elem->serialize(out);
+        }
+    }
 }
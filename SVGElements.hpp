@@ -2,12 +2,26 @@
 #ifndef __svg_SVGElements_hpp__
 #define __svg_SVGElements_hpp__
 
+#include "BlendKernels.hpp"
 #include "Color.hpp"
+#include "FillRule.hpp"
 #include "Point.hpp"
 #include "PNGImage.hpp"
+#include "PixelFormat.hpp"
+#include "PointList.hpp"
+#include "Stroke.hpp"
+
+namespace tinyxml2
+{
+    class XMLDocument;
+}
 
 namespace svg
 {
+    class SceneWriter;
+    class PickBuffer;
+    struct OptimizeStats;
+
     class SVGElement
     {
 
@@ -17,7 +31,7 @@ namespace svg
 
         /// @brief Draws an element in a PNG file
         /// @param img PNG image
-        virtual void draw(PNGImage &img) const = 0;
+        virtual void draw(Canvas &img) const = 0;
 
         /// @brief Translates an element, already drawn
         /// @param x X-Coordinate to be moved
@@ -41,6 +55,31 @@ namespace svg
         /// @param elem Element 
         /// @return Returns an SVGElement duplicated
         virtual SVGElement *duplicate(std::string id, SVGElement *elem) = 0;
+
+        /// @brief Writes the element as a binary scene record
+        /// @param out Scene writer
+        virtual void serialize(SceneWriter &out) const = 0;
+
+        /// @brief Gets the bounding box of every pixel the element draws
+        /// @param top_left Top-left corner
+        /// @param bottom_right Bottom-right corner, inclusive (left of / above top_left if nothing is drawn)
+        virtual void get_bounds(Point &top_left, Point &bottom_right) const = 0;
+
+        /// @brief Gets the memory held by the element: the object, its points and its members
+        /// @return Size in bytes
+        virtual size_t get_memory() const = 0;
+
+        /// @brief Sets the opacity of the element; a group is composited as a whole
+        /// @param alpha Opacity, from 0 (invisible) to 255 (opaque, the default)
+        void set_alpha(rgb_value alpha) {this->alpha = alpha;};
+
+        /// @brief Getter
+        /// @return Opacity
+        rgb_value get_alpha() const {return alpha;};
+
+    protected:
+        /// @brief Opacity
+        rgb_value alpha;
     };
 
     /// @brief Function to parse a string of int values separated by a blank space, and put it in a vector of Point{x, y}
@@ -48,6 +87,11 @@ namespace svg
     /// @return returns a vector of Point values
     std::vector<Point> parse_points(std::string& point_string);
 
+    /// @brief Same as parse_points, without copying the string; commas count as blanks
+    /// @param point_string String of different points, of the type "x y x y x y" (nullptr for none)
+    /// @return returns the points, allocating only when there are more than PointList::INLINE_POINTS
+    PointList parse_point_list(const char *point_string);
+
 
     /// @brief Removes commas of a given string. Used in point parsing.
     /// @param str Given string
@@ -56,8 +100,145 @@ namespace svg
     void readSVG(const std::string &svg_file,
                  Point &dimensions,
                  std::vector<SVGElement *> &svg_elements);
+    /// @brief Reads an SVG file
+    /// @param svg_file SVG file
+    /// @param dimensions Dimensions of the document
+    /// @param svg_elements Vector of SVGElements
+    /// @param parallel Convert shapes on the global thread pool, then resolve groups, use and id serially
+    void readSVG(const std::string &svg_file,
+                 Point &dimensions,
+                 std::vector<SVGElement *> &svg_elements,
+                 bool parallel);
+    void readSVG(tinyxml2::XMLDocument &doc,
+                 const std::string &svg_file,
+                 Point &dimensions,
+                 std::vector<SVGElement *> &svg_elements);
+    /// @brief Parses an SVG document held in memory
+    /// @param svg_data SVG document bytes
+    /// @param size Number of bytes
+    /// @param dimensions Dimensions of the document
+    /// @param svg_elements Vector of SVGElements
+    void parseSVG(const char *svg_data,
+                  size_t size,
+                  Point &dimensions,
+                  std::vector<SVGElement *> &svg_elements);
+    void parseSVG(tinyxml2::XMLDocument &doc,
+                  const char *svg_data,
+                  size_t size,
+                  Point &dimensions,
+                  std::vector<SVGElement *> &svg_elements);
+    /// @brief Options controlling how elements are drawn
+    struct RenderOptions
+    {
+        /// @brief Draw front-to-back, painting each pixel once and skipping hidden elements (PNGImage only, opaque documents only)
+        bool occlusion;
+        /// @brief Render into a SpanImage, storing rows as runs, instead of a dense PNGImage
+        bool spans;
+        /// @brief Parse the document on the global thread pool
+        bool parallel_parse;
+        /// @brief Run optimize_elements between parsing and drawing
+        bool optimize;
+        /// @brief If not null, receives the counts of the optimization pass
+        OptimizeStats *optimize_stats;
+        /// @brief Store long point lists delta-compressed after parsing (see pack_elements)
+        bool pack_points;
+        /// @brief Polygons with at least this many vertices are filled in parallel (PNGImage only)
+        size_t parallel_fill_vertices;
+        /// @brief So are polygons whose bounding box covers at least this many pixels (PNGImage only)
+        size_t parallel_fill_area;
+        /// @brief Output file format (by default, that of the file extension)
+        ImageFormat format;
+        /// @brief Anti-alias filled shapes by their exact pixel coverage (PNGImage only, see PNGImage::set_antialias)
+        bool antialias;
+        /// @brief Pixel format of the output; other than RGB, rendered into a FormatImage (aliased, painter's order)
+        PixelFormat pixels;
+
+        RenderOptions() : occlusion(false), spans(false), parallel_parse(false), optimize(false), optimize_stats(nullptr), pack_points(false),
+                          parallel_fill_vertices(PNGImage::PARALLEL_FILL_VERTICES), parallel_fill_area(PNGImage::PARALLEL_FILL_AREA),
+                          format(ImageFormat::AUTO), antialias(false), pixels(PixelFormat::RGB) {}
+    };
+
+    /// @brief Stores the points of every polyline and polygon delta-compressed, about 4 times smaller
+    /// Meant for documents with very long point lists; drawing decodes the points on the fly.
+    /// @param svg_elements Vector of SVGElements, group members included
+    void pack_elements(const std::vector<SVGElement *> &svg_elements);
+
+    /// @brief Reads an SVG file and prepares its elements for drawing, as set by the options
+    /// @param svg_file SVG file
+    /// @param dimensions Receives the document dimensions
+    /// @param svg_elements Receives the elements
+    /// @param options Render options (parallel_parse, optimize and pack_points)
+    void load_elements(const std::string &svg_file,
+                       Point &dimensions,
+                       std::vector<SVGElement *> &svg_elements,
+                       const RenderOptions &options);
+
+    /// @brief Draws elements in document order
+    /// @param svg_elements Vector of SVGElements
+    /// @param img Canvas
+    /// @param options Render options
+    void render_elements(const std::vector<SVGElement *> &svg_elements,
+                         Canvas &img,
+                         const RenderOptions &options);
+
+    /// @brief Draws the ID of each element into a pick buffer, in document order
+    /// Group members get their own IDs; invisible ones (opacity 0, or in an
+    /// invisible group) are listed but never hit.
+    /// @param svg_elements Vector of SVGElements
+    /// @param buffer Pick buffer
+    /// @param picked Receives the non-group elements: ID i is picked[i - 1]
+    void render_pick(const std::vector<SVGElement *> &svg_elements,
+                     PickBuffer &buffer,
+                     std::vector<SVGElement *> &picked);
+
     void convert(const std::string &svg_file,
                  const std::string &png_file);
+    void convert(const std::string &svg_file,
+                 const std::string &png_file,
+                 const RenderOptions &options);
+
+    /// @brief One output of a multi-target conversion
+    struct RenderTarget
+    {
+        /// @brief Top-left corner of the viewport, in document pixels
+        Point top_left;
+        /// @brief Viewport size in document pixels; {0, 0} for the whole document
+        Point size;
+        /// @brief Reduction factor: each output pixel averages a reduce x reduce block of the viewport
+        int reduce;
+        /// @brief Output PNG file
+        std::string png_file;
+    };
+
+    /// @brief Converts an SVG file to several PNG files: crops, thumbnails or both
+    /// The document is read and drawn once, at full size; the targets are then cut and
+    /// box-filtered from that framebuffer in parallel on the global thread pool.
+    /// The spans option is ignored, the shared framebuffer is always dense.
+    /// @param svg_file SVG file
+    /// @param targets Outputs
+    /// @param options Render options
+    void convert(const std::string &svg_file,
+                 const std::vector<RenderTarget> &targets,
+                 const RenderOptions &options);
+
+    /// @brief Converts an SVG document held in memory to PNG bytes
+    /// @param svg_data SVG document bytes
+    /// @param size Number of bytes
+    /// @param png_data Receives the encoded PNG
+    void convert(const char *svg_data,
+                 size_t size,
+                 std::vector<unsigned char> &png_data);
+
+    /// @brief Renders an SVG document held in memory into a caller-provided RGB buffer
+    /// @param svg_data SVG document bytes
+    /// @param size Number of bytes
+    /// @param pixels Row-major RGB buffer, with no padding between rows
+    /// @param capacity Number of pixels the buffer can hold; a std::runtime_error is thrown if the document does not fit
+    /// @return Dimensions of the rendered image
+    Point render(const char *svg_data,
+                 size_t size,
+                 Color *pixels,
+                 size_t capacity);
 
     class Ellipse : public SVGElement
     {
@@ -71,18 +252,23 @@ namespace svg
 
         /// @brief Copy constructor
         /// @param copy Ellipse to be copied
-        Ellipse(const Ellipse& copy) : SVGElement(copy), fill(copy.fill), center(copy.center), radius_x(copy.radius_x), radius_y(copy.radius_y){}
+        Ellipse(const Ellipse& copy) : SVGElement(copy), fill(copy.fill), center(copy.center), radius_x(copy.radius_x), radius_y(copy.radius_y), degrees(copy.degrees){}
 
-        void draw(PNGImage &img) const override;
+        void draw(Canvas &img) const override;
         void translate(int x, int y) override;
         void rotate(int origin_x, int origin_y, int angle) override;
         void scale(int origin_x, int origin_y, int value) override;
         SVGElement *duplicate(std::string id, SVGElement *elem) override;
+        void serialize(SceneWriter &out) const override;
+        void get_bounds(Point &top_left, Point &bottom_right) const override;
+        size_t get_memory() const override;
     protected:
         Color fill;
         Point center;
         int radius_x;
         int radius_y;
+        /// @brief Rotation about the center, in degrees [0, 360)
+        int degrees;
     };
 
     //cirlce class, derived of Ellipse
@@ -94,28 +280,38 @@ namespace svg
             /// @param center Center
             /// @param radius_x Radius
             Circle(const Color &fill, const Point &center, const int radius_x); 
-            void draw(PNGImage &img) const override;
+            void draw(Canvas &img) const override;
+            void serialize(SceneWriter &out) const override;
+            void get_bounds(Point &top_left, Point &bottom_right) const override;
     };
 
     class Polyline : public SVGElement {
         public:
             /// @brief Constructor
             /// @param stroke Stroke Color
-            /// @param points Vector of Points
-            Polyline(const Color &stroke, const std::vector<Point>& points);
+            /// @param points Points; a moved-in vector is taken over without copying
+            /// @param style Stroke width, joins and caps
+            Polyline(const Color &stroke, PointList points, const StrokeStyle &style = DEFAULT_STROKE);
 
             /// @brief Copy constructor
             /// @param copy Polyline to be copied
-            Polyline(const Polyline& copy) : SVGElement(copy), stroke(copy.stroke), points(copy.points) {}
+            Polyline(const Polyline& copy) : SVGElement(copy), stroke(copy.stroke), points(copy.points), style(copy.style) {}
 
-            void draw(PNGImage &img) const override;
+            /// @brief Stores the points delta-compressed (see PackedPoints), if there are more than a few
+            void pack() {points.pack();};
+
+            void draw(Canvas &img) const override;
             void translate(int x, int y) override;
             void rotate(int origin_x, int origin_y, int angle) override;
             void scale(int origin_x, int origin_y, int value) override;
             SVGElement *duplicate(std::string id, SVGElement *elem) override;
+            void serialize(SceneWriter &out) const override;
+            void get_bounds(Point &top_left, Point &bottom_right) const override;
+            size_t get_memory() const override;
         protected:
             Color stroke;
-            std::vector<Point> points;
+            PointList points;
+            StrokeStyle style;
     };
 
     class Line : public Polyline {
@@ -126,29 +322,47 @@ namespace svg
             /// @param y1 Point 1, Y-Axis
             /// @param x2 Point 2, X-Axis
             /// @param y2 Point 2, Y-Axis
-            Line(const Color &stroke, const int x1, const int y1, const int x2, const int y2);
-            void draw(PNGImage &img) const override;
+            /// @param style Stroke width and caps
+            Line(const Color &stroke, const int x1, const int y1, const int x2, const int y2,
+                 const StrokeStyle &style = DEFAULT_STROKE);
+            void draw(Canvas &img) const override;
     };
 
     class Polygon : public SVGElement{
         public:
             /// @brief Constructor
             /// @param fill Fill Color
-            /// @param points Vector of points
-            Polygon(const Color &fill, const std::vector<Point>& points);
+            /// @param points Points; a moved-in vector is taken over without copying
+            Polygon(const Color &fill, PointList points);
 
             /// @brief Copy constructor
             /// @param copy Polygon to be copied
             Polygon(const Polygon& copy) : SVGElement(copy), fill(copy.fill), points(copy.points) {}
 
-            void draw(PNGImage &img) const override;
+            /// @brief Stores the points delta-compressed (see PackedPoints), if there are more than a few
+            void pack() {points.pack();};
+
+            void draw(Canvas &img) const override;
             void translate(int x, int y) override;
             void rotate(int origin_x, int origin_y, int angle) override;
             void scale(int origin_x, int origin_y, int value) override;
             SVGElement *duplicate(std::string id, SVGElement *elem) override;
+            void serialize(SceneWriter &out) const override;
+            void get_bounds(Point &top_left, Point &bottom_right) const override;
+            size_t get_memory() const override;
+
+            /// @brief Getter
+            /// @return Fill Color
+            Color get_fill() const {return fill;};
+
+            /// @brief Checks if the polygon paints exactly the pixels of an axis-aligned rectangle
+            /// @param top_left Receives the top-left corner
+            /// @param bottom_right Receives the bottom-right corner, inclusive
+            /// @return True for 4 points joined by alternating horizontal and vertical edges
+            bool get_box(Point &top_left, Point &bottom_right) const;
         protected:
             Color fill;
-            std::vector<Point> points;
+            PointList points;
     };
 
     class Rect : public Polygon{
@@ -160,7 +374,51 @@ namespace svg
             /// @param width Rectangle Width
             /// @param height Rectangle Height
             Rect(const Color &fill, int x, int y, int width, int height);
-            void draw(PNGImage &img) const override;
+            void draw(Canvas &img) const override;
+    };
+
+    /// @brief Axis-aligned rectangle drawn with Canvas::fill_rect, made by optimize_elements
+    /// Transforms that leave it unaligned fall back to drawing it as a polygon.
+    class Box : public Polygon{
+        public:
+            /// @brief Constructor
+            /// @param fill Fill Color
+            /// @param top_left Top-left corner
+            /// @param bottom_right Bottom-right corner, inclusive
+            Box(const Color &fill, const Point &top_left, const Point &bottom_right);
+            void draw(Canvas &img) const override;
+            SVGElement *duplicate(std::string id, SVGElement *elem) override;
+    };
+
+    /// @brief Shape of the path element: curves and arcs flattened into closed contours
+    class Path : public SVGElement {
+        public:
+            /// @brief Constructor
+            /// @param fill Fill Color
+            /// @param rule Fill rule, where the contours overlap
+            /// @param points Points of all the contours, one after the other
+            /// @param ends End of each contour in points (one past its last point); may be left empty for a single contour
+            Path(const Color &fill, FillRule rule, PointList points, std::vector<size_t> ends);
+
+            /// @brief Copy constructor
+            /// @param copy Path to be copied
+            Path(const Path& copy)
+                : SVGElement(copy), fill(copy.fill), rule(copy.rule), points(copy.points), ends(copy.ends) {}
+
+            void draw(Canvas &img) const override;
+            void translate(int x, int y) override;
+            void rotate(int origin_x, int origin_y, int angle) override;
+            void scale(int origin_x, int origin_y, int value) override;
+            SVGElement *duplicate(std::string id, SVGElement *elem) override;
+            void serialize(SceneWriter &out) const override;
+            void get_bounds(Point &top_left, Point &bottom_right) const override;
+            size_t get_memory() const override;
+        protected:
+            Color fill;
+            FillRule rule;
+            PointList points;
+            /// @brief Contour ends, empty for a single contour
+            std::vector<size_t> ends;
     };
 
     class Group : public SVGElement {
@@ -169,20 +427,29 @@ namespace svg
             /// @param elements Vector of SVGElement
             Group(std::vector<SVGElement *> elements);
 
-            /// @brief Copy constructor
-            /// @param copy Group to be copied
-            Group(const Group& copy) : SVGElement(copy), elements(copy.elements) {}
-            void draw(PNGImage &img) const override;
+            /// @brief Destructor, deletes the members
+            ~Group();
+            void draw(Canvas &img) const override;
             void translate(int x, int y) override;
             void rotate(int origin_x, int origin_y, int angle) override;
             void scale(int origin_x, int origin_y, int value) override;
 
             /// @brief Getter
-            /// @return Vector of SVGElement
-            std::vector<SVGElement *> get_elements() {return elements;};
+            /// @return Vector of SVGElement, still owned by the group
+            const std::vector<SVGElement *> &get_elements() const {return elements;};
+
+            /// @brief Takes the members out of the group, leaving it empty
+            /// @return Vector of SVGElement, now owned by the caller
+            std::vector<SVGElement *> release_elements();
             
             SVGElement *duplicate(std::string id, SVGElement *elem) override;
+            void serialize(SceneWriter &out) const override;
+            void get_bounds(Point &top_left, Point &bottom_right) const override;
+            size_t get_memory() const override;
         private:
+            Group(const Group&);
+            Group& operator=(const Group&);
+
             std::vector<SVGElement *> elements;
 
     };
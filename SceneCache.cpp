@@ -0,0 +1,330 @@
+//! @file SceneCache.cpp
+#include "SceneCache.hpp"
+#include "SVGElements.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+// POSIX headers
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace svg
+{
+    namespace
+    {
+        //! magic, version, width, height, count, words
+        const size_t HEADER_WORDS = 6;
+        //! Largest canvas of a scene, as for images (see ImageFormat).
+        const size_t MAX_PIXELS = (size_t)1 << 28;
+        //! Deepest nesting of group records: each level recurses.
+        const int MAX_GROUP_DEPTH = 256;
+
+        //! Draws a record at its opacity, back to opaque drawing on exit.
+        class AlphaScope
+        {
+        public:
+            AlphaScope(Canvas &img, rgb_value alpha) : img_(img)
+            {
+                img_.set_alpha(alpha);
+            }
+            ~AlphaScope()
+            {
+                img_.set_alpha(OPAQUE_ALPHA);
+            }
+
+        private:
+            Canvas &img_;
+        };
+    }
+
+    void SceneWriter::put(int32_t v)
+    {
+        words_.push_back(v);
+    }
+
+    void SceneWriter::put(const Color &c, rgb_value alpha)
+    {
+        words_.push_back((int32_t)(((uint32_t)alpha << 24) | (c.red << 16) | (c.green << 8) | c.blue));
+    }
+
+    void SceneWriter::put(const Point *points, size_t count)
+    {
+        words_.push_back((int32_t)count);
+        for (size_t i = 0; i < count; i++)
+        {
+            words_.push_back(points[i].x);
+            words_.push_back(points[i].y);
+        }
+    }
+
+    void SceneWriter::save(const std::string &scene_file, const Point &dimensions, size_t count) const
+    {
+        int32_t header[HEADER_WORDS] = {(int32_t)SCENE_MAGIC,
+                                        (int32_t)SCENE_VERSION,
+                                        dimensions.x,
+                                        dimensions.y,
+                                        (int32_t)count,
+                                        (int32_t)words_.size()};
+        FILE *f = ::fopen(scene_file.c_str(), "wb");
+        if (f == nullptr)
+        {
+            throw std::runtime_error(scene_file + ": could not open for writing!");
+        }
+        bool ok = ::fwrite(header, sizeof(header), 1, f) == 1 &&
+                  (words_.empty() ||
+                   ::fwrite(words_.data(), sizeof(int32_t), words_.size(), f) == words_.size());
+        ok = (::fclose(f) == 0) && ok;
+        if (!ok)
+        {
+            throw std::runtime_error(scene_file + ": write failed!");
+        }
+    }
+
+    SceneFile::SceneFile(const std::string &scene_file)
+        : file_(scene_file), map_(MAP_FAILED), size_(0)
+    {
+        int fd = ::open(scene_file.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error(scene_file + ": could not open scene!");
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size >= (off_t)(HEADER_WORDS * sizeof(int32_t)))
+        {
+            size_ = st.st_size;
+            map_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (map_ == MAP_FAILED)
+        {
+            throw std::runtime_error(scene_file + ": not a scene file!");
+        }
+        const int32_t *header = (const int32_t *)map_;
+        if ((uint32_t)header[0] != SCENE_MAGIC)
+        {
+            ::munmap(map_, size_);
+            throw std::runtime_error(scene_file + ": not a scene file!");
+        }
+        if ((uint32_t)header[1] != SCENE_VERSION)
+        {
+            ::munmap(map_, size_);
+            throw std::runtime_error(scene_file + ": stale scene (version " +
+                                     std::to_string(header[1]) + ", expected " +
+                                     std::to_string(SCENE_VERSION) + ")!");
+        }
+        dimensions_ = Point{header[2], header[3]};
+        count_ = header[4];
+        records_ = header + HEADER_WORDS;
+        end_ = records_ + header[5];
+        if (header[5] < 0 || (size_t)header[5] > size_ / sizeof(int32_t) - HEADER_WORDS)
+        {
+            ::munmap(map_, size_);
+            throw std::runtime_error(scene_file + ": truncated scene!");
+        }
+        if (dimensions_.x <= 0 || dimensions_.y <= 0 ||
+            (size_t)dimensions_.x * dimensions_.y > MAX_PIXELS || count_ < 0)
+        {
+            ::munmap(map_, size_);
+            throw std::runtime_error(scene_file + ": corrupt scene!");
+        }
+    }
+
+    SceneFile::~SceneFile()
+    {
+        ::munmap(map_, size_);
+    }
+
+    Point SceneFile::dimensions() const
+    {
+        return dimensions_;
+    }
+
+    void SceneFile::render(Canvas &img) const
+    {
+        const int32_t *rec = records_;
+        for (int32_t i = 0; i < count_; i++)
+        {
+            rec = render(rec, img, 0);
+        }
+    }
+
+    void SceneFile::require(const int32_t *rec, size_t n) const
+    {
+        if ((size_t)(end_ - rec) < n)
+        {
+            throw std::runtime_error(file_ + ": truncated scene!");
+        }
+    }
+
+    const int32_t *SceneFile::render(const int32_t *rec, Canvas &img, int depth) const
+    {
+        require(rec, 2);
+        int32_t type = rec[0];
+        Color c = {(rgb_value)(rec[1] >> 16), (rgb_value)(rec[1] >> 8), (rgb_value)rec[1]};
+        rgb_value alpha = type == SCENE_GROUP ? OPAQUE_ALPHA : (rgb_value)((uint32_t)rec[1] >> 24);
+        AlphaScope scope(img, alpha);
+        switch (type)
+        {
+        case SCENE_ELLIPSE:
+            require(rec, 7);
+            img.draw_ellipse(Point{rec[2], rec[3]}, Point{rec[4], rec[5]}, rec[6], c);
+            return rec + 7;
+        case SCENE_POLYGON:
+        {
+            require(rec, 3);
+            int32_t n = rec[2];
+            if (n < 0)
+            {
+                throw std::runtime_error(file_ + ": corrupt scene!");
+            }
+            require(rec, 3 + 2 * (size_t)n);
+            // Points are used in place, straight from the mapping.
+            const Point *points = reinterpret_cast<const Point *>(rec + 3);
+            img.draw_polygon(points, n, c);
+            return rec + 3 + 2 * n;
+        }
+        case SCENE_POLYLINE:
+        {
+            require(rec, 7);
+            int32_t n = rec[6];
+            if (n < 0 || rec[3] < (int32_t)LineJoin::MITER || rec[3] > (int32_t)LineJoin::BEVEL ||
+                rec[4] < (int32_t)LineCap::BUTT || rec[4] > (int32_t)LineCap::SQUARE)
+            {
+                throw std::runtime_error(file_ + ": corrupt scene!");
+            }
+            require(rec, 7 + 2 * (size_t)n);
+            StrokeStyle style = {(double)rec[2] / SCENE_FIXED_ONE, (LineJoin)rec[3], (LineCap)rec[4],
+                                 (double)rec[5] / SCENE_FIXED_ONE};
+            const Point *points = reinterpret_cast<const Point *>(rec + 7);
+            if (style.wide())
+            {
+                img.draw_stroke(points, n, style, c);
+            }
+            else if (alpha != OPAQUE_ALPHA && n > 0)
+            {
+                // Shared end points are blended once, as in Polyline::draw
+                Point top_left = points[0], bottom_right = points[0];
+                for (int32_t i = 1; i < n; i++)
+                {
+                    top_left = Point{std::min(top_left.x, points[i].x), std::min(top_left.y, points[i].y)};
+                    bottom_right = Point{std::max(bottom_right.x, points[i].x), std::max(bottom_right.y, points[i].y)};
+                }
+                img.set_alpha(OPAQUE_ALPHA);
+                img.begin_layer(top_left, bottom_right);
+                for (int32_t i = 1; i < n; i++)
+                {
+                    img.draw_line(points[i - 1], points[i], c);
+                }
+                img.end_layer(alpha);
+            }
+            else
+            {
+                for (int32_t i = 1; i < n; i++)
+                {
+                    img.draw_line(points[i - 1], points[i], c);
+                }
+            }
+            return rec + 7 + 2 * n;
+        }
+        case SCENE_PATH:
+        {
+            require(rec, 4);
+            int32_t m = rec[3];
+            if (m < 0 || rec[2] < (int32_t)FillRule::NONZERO || rec[2] > (int32_t)FillRule::EVEN_ODD)
+            {
+                throw std::runtime_error(file_ + ": corrupt scene!");
+            }
+            require(rec, 5 + (size_t)m);
+            int32_t n = rec[4 + m];
+            if (n < 0)
+            {
+                throw std::runtime_error(file_ + ": corrupt scene!");
+            }
+            require(rec, 5 + (size_t)m + 2 * (size_t)n);
+            std::vector<size_t> ends(m);
+            for (int32_t i = 0; i < m; i++)
+            {
+                ends[i] = (size_t)rec[4 + i];
+                if (rec[4 + i] < (i > 0 ? rec[3 + i] : 0) || rec[4 + i] > n)
+                {
+                    throw std::runtime_error(file_ + ": corrupt scene!");
+                }
+            }
+            const Point *points = reinterpret_cast<const Point *>(rec + 5 + m);
+            if (m > 0)
+            {
+                img.draw_path(points, ends.data(), m, (FillRule)rec[2], c);
+            }
+            return rec + 5 + m + 2 * n;
+        }
+        case SCENE_GROUP:
+        {
+            require(rec, 7);
+            int32_t n = rec[1];
+            if (n < 0 || rec[2] < 0 || rec[2] > OPAQUE_ALPHA || depth >= MAX_GROUP_DEPTH)
+            {
+                throw std::runtime_error(file_ + ": corrupt scene!");
+            }
+            rgb_value group_alpha = (rgb_value)rec[2];
+            bool layer = group_alpha != OPAQUE_ALPHA;
+            if (layer)
+            {
+                img.begin_layer(Point{rec[3], rec[4]}, Point{rec[5], rec[6]});
+            }
+            rec += 7;
+            for (int32_t i = 0; i < n; i++)
+            {
+                rec = render(rec, img, depth + 1);
+            }
+            if (layer)
+            {
+                img.end_layer(group_alpha);
+            }
+            return rec;
+        }
+        default:
+            throw std::runtime_error(file_ + ": corrupt scene!");
+        }
+    }
+
+    void compile_scene(const std::string &svg_file, const std::string &scene_file)
+    {
+        Point dimensions;
+        std::vector<SVGElement *> svg_elements;
+        try
+        {
+            readSVG(svg_file, dimensions, svg_elements);
+            SceneWriter out;
+            for (SVGElement *e : svg_elements)
+            {
+                e->serialize(out);
+            }
+            out.save(scene_file, dimensions, svg_elements.size());
+        }
+        catch (...)
+        {
+            for (SVGElement *e : svg_elements)
+            {
+                delete e;
+            }
+            throw;
+        }
+        for (SVGElement *e : svg_elements)
+        {
+            delete e;
+        }
+    }
+
+    void convert_scene(const std::string &scene_file, const std::string &png_file)
+    {
+        SceneFile scene(scene_file);
+        Point dimensions = scene.dimensions();
+        PNGImage img(dimensions.x, dimensions.y);
+        scene.render(img);
+        img.save(png_file);
+    }
+}
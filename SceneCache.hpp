@@ -0,0 +1,127 @@
+//! @file SceneCache.hpp
+#ifndef __svg_SceneCache_hpp__
+#define __svg_SceneCache_hpp__
+
+#include "BlendKernels.hpp"
+#include "Color.hpp"
+#include "Point.hpp"
+#include "PNGImage.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    class SVGElement;
+
+    //! Magic number at the start of every binary scene file ("SVGB").
+    const uint32_t SCENE_MAGIC = 0x42475653;
+    //! Version of the binary scene format.
+    //! Must be bumped whenever the record layout changes, so that
+    //! caches written by older builds are rejected.
+    const uint32_t SCENE_VERSION = 6;
+    //! Fractional values are stored in fixed point, with this many steps per unit.
+    const int32_t SCENE_FIXED_ONE = 256;
+
+    //! Record types of the binary scene format.
+    //! Colors carry the opacity of their shape in their top byte.
+    enum SceneRecord
+    {
+        //! type, color, cx, cy, rx, ry, degrees
+        SCENE_ELLIPSE = 1,
+        //! type, color, width, join, cap, miter limit, n, n x (x, y)
+        //! (width and miter limit in fixed point)
+        SCENE_POLYLINE = 2,
+        //! type, color, n, n x (x, y)
+        SCENE_POLYGON = 3,
+        //! type, n, alpha, x0, y0, x1, y1, followed by n child records
+        //! (the group is composited over x0, y0 - x1, y1 when translucent)
+        SCENE_GROUP = 4,
+        //! type, color, fill rule, m, m x contour end, n, n x (x, y)
+        SCENE_PATH = 5
+    };
+
+    //! Builds the record stream of a binary scene.
+    //! All values are stored as host-endian 32-bit words, so that
+    //! point arrays can be used in place once the file is mapped.
+    class SceneWriter
+    {
+    public:
+        //! Append a word.
+        //! @param v Value.
+        void put(int32_t v);
+        //! Append a color, packed in a single word.
+        //! @param c Color.
+        //! @param alpha Opacity of the shape, stored in the top byte.
+        void put(const Color &c, rgb_value alpha = OPAQUE_ALPHA);
+        //! Append a point count followed by the points.
+        //! @param points First point.
+        //! @param count Number of points.
+        void put(const Point *points, size_t count);
+        //! Write header and records to a file.
+        //! @param scene_file Output file name.
+        //! @param dimensions Canvas dimensions.
+        //! @param count Number of top-level records.
+        void save(const std::string &scene_file, const Point &dimensions, size_t count) const;
+
+    private:
+        //! Record words.
+        std::vector<int32_t> words_;
+    };
+
+    //! Read-only binary scene, mapped in memory.
+    class SceneFile
+    {
+    public:
+        //! Map a scene file.
+        //! Throws std::runtime_error if the file cannot be mapped,
+        //! is not a scene file, was written by another format version
+        //! or has an invalid header.
+        //! @param scene_file File name.
+        SceneFile(const std::string &scene_file);
+        //! Destructor, unmaps the file.
+        ~SceneFile();
+        //! Get canvas dimensions.
+        //! @return Canvas dimensions.
+        Point dimensions() const;
+        //! Draw all records, in document order.
+        //! @param img Target image.
+        void render(Canvas &img) const;
+
+    private:
+        SceneFile(const SceneFile &);
+        SceneFile &operator=(const SceneFile &);
+        //! Draw one record and return the position after it.
+        //! @param depth Groups the record is nested in.
+        const int32_t *render(const int32_t *rec, Canvas &img, int depth) const;
+        //! Throw if fewer than n words are left after rec.
+        void require(const int32_t *rec, size_t n) const;
+
+        //! File name, for error messages.
+        std::string file_;
+        //! Mapped region.
+        void *map_;
+        //! Mapped size in bytes.
+        size_t size_;
+        //! First record.
+        const int32_t *records_;
+        //! One past the last record.
+        const int32_t *end_;
+        //! Canvas dimensions.
+        Point dimensions_;
+        //! Number of top-level records.
+        int32_t count_;
+    };
+
+    //! Parse an SVG file and write it as a binary scene.
+    //! @param svg_file Input SVG file.
+    //! @param scene_file Output scene file.
+    void compile_scene(const std::string &svg_file, const std::string &scene_file);
+    //! Render a binary scene to a PNG file.
+    //! @param scene_file Input scene file.
+    //! @param png_file Output PNG file.
+    void convert_scene(const std::string &scene_file, const std::string &png_file);
+}
+#endif
@@ -0,0 +1,626 @@
+//! @file SpanImage.cpp
+#include "SpanImage.hpp"
+#include "BlendKernels.hpp"
+#include "Raster.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+namespace svg
+{
+    namespace
+    {
+        bool same_color(const Color &a, const Color &b)
+        {
+            return a.red == b.red && a.green == b.green && a.blue == b.blue;
+        }
+
+        //! Paints the spans of one shape in a solid color, blending the
+        //! union of translucent ones in finish (as PNGImage does).
+        class SpanPlot
+        {
+        public:
+            SpanPlot(SpanImage &img, const Color &color, rgb_value alpha)
+                : img(img), color(color), alpha(alpha) {}
+            void span(int y, int x0, int x1)
+            {
+                if (alpha == OPAQUE_ALPHA)
+                {
+                    img.fill_span(y, x0, x1, color);
+                }
+                else
+                {
+                    spans.span(y, x0, x1);
+                }
+            }
+            void finish()
+            {
+                struct BlendPlot
+                {
+                    SpanImage &img;
+                    const Color &color;
+                    rgb_value alpha;
+                    void span(int y, int x0, int x1)
+                    {
+                        img.blend_span(y, x0, x1, color, alpha);
+                    }
+                };
+                BlendPlot blend_plot = {img, color, alpha};
+                spans.flush(blend_plot);
+            }
+
+        private:
+            SpanImage &img;
+            const Color &color;
+            rgb_value alpha;
+            SpanList spans;
+        };
+
+        //! Writes a zlib stream made of a single fixed-Huffman deflate block.
+        //! Only literals and back-references are needed: runs become copies
+        //! of the previous pixel, repeated rows copies of the previous row.
+        class DeflateWriter
+        {
+        public:
+            DeflateWriter(std::vector<unsigned char> &out)
+                : out_(out), bits_(0), count_(0), s1_(1), s2_(0)
+            {
+                // zlib header: deflate, 32K window, no dictionary
+                out_.push_back(0x78);
+                out_.push_back(0x01);
+                // BFINAL = 1, BTYPE = 01 (fixed Huffman codes)
+                put(1, 1);
+                put(1, 2);
+            }
+            //! Emit a byte as a literal.
+            void literal(unsigned char v)
+            {
+                symbol(v);
+                s1_ = (s1_ + v) % ADLER_MOD;
+                s2_ = (s2_ + s1_) % ADLER_MOD;
+            }
+            //! Emit a pixel, then copy it so that it appears n times in total.
+            void pixel_run(const Color &c, uint64_t n)
+            {
+                literal(c.red);
+                literal(c.green);
+                literal(c.blue);
+                if (n > 1)
+                {
+                    copy((n - 1) * 3, 3);
+                    add_checksum(c, n - 1);
+                }
+            }
+            //! Copy the previous row, of the given size, already checksummed by the caller.
+            void repeat_row(uint64_t stride)
+            {
+                copy(stride, stride);
+            }
+            //! Add n repetitions of a pixel to the checksum.
+            void add_checksum(const Color &c, uint64_t n)
+            {
+                // Adler-32 of a 3-byte block repeated n times, in closed form.
+                uint64_t sum = c.red + c.green + c.blue;
+                uint64_t weighted = 3 * c.red + 2 * c.green + c.blue;
+                uint64_t pairs = (n * (n - 1) / 2) % ADLER_MOD;
+                uint64_t nm = n % ADLER_MOD;
+                s2_ = (s2_ + nm * 3 % ADLER_MOD * s1_ + nm * weighted + 3 * sum % ADLER_MOD * pairs) % ADLER_MOD;
+                s1_ = (s1_ + nm * sum) % ADLER_MOD;
+            }
+            //! Add a zero byte to the checksum.
+            void add_checksum_zero()
+            {
+                s2_ = (s2_ + s1_) % ADLER_MOD;
+            }
+            //! Finish the block and the zlib stream.
+            void finish()
+            {
+                symbol(256);
+                if (count_ > 0)
+                {
+                    out_.push_back((unsigned char)bits_);
+                }
+                uint32_t adler = (uint32_t)((s2_ << 16) | s1_);
+                for (int shift = 24; shift >= 0; shift -= 8)
+                {
+                    out_.push_back((unsigned char)(adler >> shift));
+                }
+            }
+
+        private:
+            static const uint64_t ADLER_MOD = 65521;
+
+            //! Append bits, least significant first.
+            void put(uint32_t v, int n)
+            {
+                bits_ |= (uint64_t)v << count_;
+                count_ += n;
+                while (count_ >= 8)
+                {
+                    out_.push_back((unsigned char)bits_);
+                    bits_ >>= 8;
+                    count_ -= 8;
+                }
+            }
+            //! Append a Huffman code, most significant bit first.
+            void code(uint32_t v, int n)
+            {
+                uint32_t r = 0;
+                for (int i = 0; i < n; i++)
+                {
+                    r = (r << 1) | ((v >> i) & 1);
+                }
+                put(r, n);
+            }
+            //! Emit a literal/length symbol with the fixed code.
+            void symbol(int v)
+            {
+                if (v < 144)
+                {
+                    code(0x30 + v, 8);
+                }
+                else if (v < 256)
+                {
+                    code(0x190 + v - 144, 9);
+                }
+                else if (v < 280)
+                {
+                    code(v - 256, 7);
+                }
+                else
+                {
+                    code(0xC0 + v - 280, 8);
+                }
+            }
+            //! Emit one back-reference.
+            void match(int length, int distance)
+            {
+                static const int LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+                static const int LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+                static const int DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                                  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                                  8193, 12289, 16385, 24577};
+                static const int DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+                int l = 28;
+                while (LENGTH_BASE[l] > length)
+                {
+                    l--;
+                }
+                symbol(257 + l);
+                put(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+                int d = 29;
+                while (DIST_BASE[d] > distance)
+                {
+                    d--;
+                }
+                code(d, 5);
+                put(distance - DIST_BASE[d], DIST_EXTRA[d]);
+            }
+            //! Copy total bytes from distance bytes back, in matches of 3 to 258 bytes.
+            void copy(uint64_t total, int distance)
+            {
+                while (total > 0)
+                {
+                    uint64_t n = std::min<uint64_t>(total, 258);
+                    if (total - n > 0 && total - n < 3)
+                    {
+                        n = total - 3;
+                    }
+                    match((int)n, distance);
+                    total -= n;
+                }
+            }
+
+            std::vector<unsigned char> &out_;
+            uint64_t bits_;
+            int count_;
+            uint64_t s1_;
+            uint64_t s2_;
+        };
+
+        uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc)
+        {
+            static uint32_t table[256];
+            static bool ready = false;
+            if (!ready)
+            {
+                for (uint32_t n = 0; n < 256; n++)
+                {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; k++)
+                    {
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    table[n] = c;
+                }
+                ready = true;
+            }
+            crc = ~crc;
+            for (size_t i = 0; i < size; i++)
+            {
+                crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        void put_be32(std::vector<unsigned char> &out, uint32_t v)
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+            {
+                out.push_back((unsigned char)(v >> shift));
+            }
+        }
+
+        void put_chunk(std::vector<unsigned char> &out, const char *type,
+                       const std::vector<unsigned char> &data)
+        {
+            put_be32(out, (uint32_t)data.size());
+            size_t start = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data.begin(), data.end());
+            put_be32(out, crc32(&out[start], out.size() - start, 0));
+        }
+
+        bool same_runs(const std::vector<SpanImage::Run> &a, const std::vector<SpanImage::Run> &b)
+        {
+            if (a.size() != b.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < a.size(); i++)
+            {
+                if (a[i].x0 != b[i].x0 || a[i].x1 != b[i].x1 || !same_color(a[i].color, b[i].color))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    SpanImage::SpanImage(int w, int h)
+        : width_(w), height_(h), rows_(h, std::vector<Run>(1, Run{0, w - 1, Color{255, 255, 255}})),
+          alpha_(OPAQUE_ALPHA)
+    {
+        assert(w > 0 && h > 0);
+    }
+
+    int SpanImage::width() const
+    {
+        return width_;
+    }
+
+    int SpanImage::height() const
+    {
+        return height_;
+    }
+
+    Color SpanImage::at(int x, int y) const
+    {
+        assert(x >= 0 && x < width_);
+        assert(y >= 0 && y < height_);
+        const std::vector<Run> &r = rows_[y];
+        std::vector<Run>::const_iterator it =
+            std::lower_bound(r.begin(), r.end(), x,
+                             [](const Run &run, int v) { return run.x1 < v; });
+        return it->color;
+    }
+
+    const std::vector<SpanImage::Run> &SpanImage::row(int y) const
+    {
+        return rows_[y];
+    }
+
+    size_t SpanImage::run_count() const
+    {
+        size_t n = 0;
+        for (const std::vector<Run> &r : rows_)
+        {
+            n += r.size();
+        }
+        return n;
+    }
+
+    void SpanImage::fill_span(int y, int x0, int x1, const Color &c)
+    {
+        if (y < 0 || y >= height_)
+        {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, width_ - 1);
+        if (x0 > x1)
+        {
+            return;
+        }
+        std::vector<Run> &r = rows_[y];
+        // Runs [first, last) overlap x0..x1.
+        std::vector<Run>::iterator first =
+            std::lower_bound(r.begin(), r.end(), x0,
+                             [](const Run &run, int v) { return run.x1 < v; });
+        std::vector<Run>::iterator last = first;
+        while (last != r.end() && last->x0 <= x1)
+        {
+            ++last;
+        }
+        if (last - first == 1 && same_color(first->color, c))
+        {
+            return;
+        }
+        Run repl[3];
+        int n = 0;
+        if (first->x0 < x0)
+        {
+            repl[n++] = Run{first->x0, x0 - 1, first->color};
+        }
+        repl[n++] = Run{x0, x1, c};
+        Run right = *(last - 1);
+        if (right.x1 > x1)
+        {
+            repl[n++] = Run{x1 + 1, right.x1, right.color};
+        }
+        // Merge with equal-colored neighbours, inside and outside the range.
+        int k = 0;
+        for (int i = 1; i < n; i++)
+        {
+            if (same_color(repl[k].color, repl[i].color))
+            {
+                repl[k].x1 = repl[i].x1;
+            }
+            else
+            {
+                repl[++k] = repl[i];
+            }
+        }
+        n = k + 1;
+        if (first != r.begin() && same_color((first - 1)->color, repl[0].color))
+        {
+            --first;
+            repl[0].x0 = first->x0;
+        }
+        if (last != r.end() && same_color(last->color, repl[n - 1].color))
+        {
+            repl[n - 1].x1 = last->x1;
+            ++last;
+        }
+        // Replace in place where possible, then shrink or grow the row.
+        ptrdiff_t old_n = last - first;
+        ptrdiff_t common = std::min<ptrdiff_t>(old_n, n);
+        std::copy(repl, repl + common, first);
+        if (old_n > n)
+        {
+            r.erase(first + common, last);
+        }
+        else if (old_n < n)
+        {
+            r.insert(first + common, repl + common, repl + n);
+        }
+    }
+
+    void SpanImage::encode(std::vector<unsigned char> &png_data) const
+    {
+        static const unsigned char SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        png_data.assign(SIGNATURE, SIGNATURE + 8);
+
+        std::vector<unsigned char> header;
+        put_be32(header, width_);
+        put_be32(header, height_);
+        header.push_back(8); // bit depth
+        header.push_back(2); // RGB
+        header.push_back(0); // deflate
+        header.push_back(0); // adaptive filtering
+        header.push_back(0); // no interlace
+        put_chunk(png_data, "IHDR", header);
+
+        // Scanlines use filter 0: each run is its first pixel plus a copy
+        // of it, and a row equal to the previous one is a single copy.
+        uint64_t stride = (uint64_t)width_ * 3 + 1;
+        std::vector<unsigned char> z;
+        DeflateWriter deflate(z);
+        for (int y = 0; y < height_; y++)
+        {
+            const std::vector<Run> &r = rows_[y];
+            if (y > 0 && stride <= 32768 && same_runs(r, rows_[y - 1]))
+            {
+                deflate.repeat_row(stride);
+                deflate.add_checksum_zero();
+                for (const Run &run : r)
+                {
+                    deflate.add_checksum(run.color, run.x1 - run.x0 + 1);
+                }
+                continue;
+            }
+            deflate.literal(0);
+            for (const Run &run : r)
+            {
+                deflate.pixel_run(run.color, run.x1 - run.x0 + 1);
+            }
+        }
+        deflate.finish();
+        put_chunk(png_data, "IDAT", z);
+        put_chunk(png_data, "IEND", std::vector<unsigned char>());
+    }
+
+    void SpanImage::save(const std::string &png_file_name, ImageFormat format) const
+    {
+        if (resolve_format(format, png_file_name) != ImageFormat::PNG)
+        {
+            std::vector<Color> pixels((size_t)width_ * height_);
+            for (int y = 0; y < height_; y++)
+            {
+                Color *row = &pixels[(size_t)y * width_];
+                for (const Run &run : rows_[y])
+                {
+                    std::fill(row + run.x0, row + run.x1 + 1, run.color);
+                }
+            }
+            write_image(png_file_name, format, pixels.data(), width_, height_);
+            return;
+        }
+        std::vector<unsigned char> png_data;
+        encode(png_data);
+        FILE *f = ::fopen(png_file_name.c_str(), "wb");
+        if (f == nullptr)
+        {
+            throw std::runtime_error(png_file_name + ": could not open for writing!");
+        }
+        bool ok = ::fwrite(png_data.data(), 1, png_data.size(), f) == png_data.size();
+        ok = (::fclose(f) == 0) && ok;
+        if (!ok)
+        {
+            throw std::runtime_error(png_file_name + ": write failed!");
+        }
+    }
+
+    void SpanImage::blend_span(int y, int x0, int x1, const Color &c, rgb_value alpha)
+    {
+        if (y < 0 || y >= height_)
+        {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, width_ - 1);
+        if (x0 > x1)
+        {
+            return;
+        }
+        // The result depends on the color underneath: one piece per run crossed
+        const std::vector<Run> &r = rows_[y];
+        std::vector<Run>::const_iterator it =
+            std::lower_bound(r.begin(), r.end(), x0,
+                             [](const Run &run, int v) { return run.x1 < v; });
+        pieces_.clear();
+        for (; it != r.end() && it->x0 <= x1; ++it)
+        {
+            pieces_.push_back(Run{std::max(it->x0, x0), std::min(it->x1, x1), blend(it->color, c, alpha)});
+        }
+        for (const Run &piece : pieces_)
+        {
+            fill_span(y, piece.x0, piece.x1, piece.color);
+        }
+    }
+
+    void SpanImage::set_alpha(rgb_value alpha)
+    {
+        alpha_ = alpha;
+    }
+
+    void SpanImage::begin_layer(const Point &top_left, const Point &bottom_right)
+    {
+        Layer layer = {Point{std::max(top_left.x, 0), std::max(top_left.y, 0)},
+                       Point{std::min(bottom_right.x, width_ - 1), std::min(bottom_right.y, height_ - 1)},
+                       std::vector<std::vector<Run>>()};
+        if (layer.top_left.x <= layer.bottom_right.x && layer.top_left.y <= layer.bottom_right.y)
+        {
+            layer.below.assign(rows_.begin() + layer.top_left.y, rows_.begin() + layer.bottom_right.y + 1);
+        }
+        layers_.push_back(std::move(layer));
+    }
+
+    void SpanImage::end_layer(rgb_value alpha)
+    {
+        assert(!layers_.empty());
+        const Layer &layer = layers_.back();
+        for (size_t i = 0; i < layer.below.size(); i++)
+        {
+            int y = layer.top_left.y + (int)i;
+            // Walk the saved runs and the current ones together; both cover the row
+            const std::vector<Run> &below = layer.below[i];
+            const std::vector<Run> &above = rows_[y];
+            size_t b = 0, a = 0;
+            pieces_.clear();
+            for (int x = layer.top_left.x; x <= layer.bottom_right.x;)
+            {
+                while (below[b].x1 < x)
+                {
+                    b++;
+                }
+                while (above[a].x1 < x)
+                {
+                    a++;
+                }
+                int end = std::min(std::min(below[b].x1, above[a].x1), layer.bottom_right.x);
+                pieces_.push_back(Run{x, end, blend(below[b].color, above[a].color, alpha)});
+                x = end + 1;
+            }
+            for (const Run &piece : pieces_)
+            {
+                fill_span(y, piece.x0, piece.x1, piece.color);
+            }
+        }
+        layers_.pop_back();
+    }
+
+    void SpanImage::draw_line(const Point &a, const Point &b, const Color &c)
+    {
+        SpanPlot plot(*this, c, alpha_);
+        raster_line(a, b, plot);
+        plot.finish();
+    }
+
+    void SpanImage::draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c)
+    {
+        SpanPlot plot(*this, c, alpha_);
+        raster_stroke(points, count, style, plot);
+        plot.finish();
+    }
+
+    void SpanImage::draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c)
+    {
+        SpanPlot plot(*this, c, alpha_);
+        raster_stroke(points.begin(), points.size(), style, plot);
+        plot.finish();
+    }
+
+    void SpanImage::draw_polygon(const Point *points, size_t count, const Color &fill)
+    {
+        SpanPlot plot(*this, fill, alpha_);
+        raster_polygon(points, count, plot);
+        plot.finish();
+    }
+
+    void SpanImage::draw_polygon(const PackedPoints &points, const Color &fill)
+    {
+        SpanPlot plot(*this, fill, alpha_);
+        raster_polygon(points.begin(), points.size(), plot);
+        plot.finish();
+    }
+
+    void SpanImage::draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                              const Color &fill)
+    {
+        SpanPlot plot(*this, fill, alpha_);
+        raster_contours(points, ends, contours, rule, plot);
+        plot.finish();
+    }
+
+    void SpanImage::draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill)
+    {
+        SpanPlot plot(*this, fill, alpha_);
+        raster_ellipse(center, radius, degrees, plot);
+        plot.finish();
+    }
+
+    void SpanImage::fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill)
+    {
+        int y0 = std::max(top_left.y, 0);
+        int y1 = std::min(bottom_right.y, height_ - 1);
+        for (int y = y0; y <= y1; y++)
+        {
+            if (alpha_ == OPAQUE_ALPHA)
+            {
+                fill_span(y, top_left.x, bottom_right.x, fill);
+            }
+            else
+            {
+                blend_span(y, top_left.x, bottom_right.x, fill, alpha_);
+            }
+        }
+    }
+}
@@ -0,0 +1,113 @@
+//! @file SpanImage.hpp
+#ifndef __svg_SpanImage_hpp__
+#define __svg_SpanImage_hpp__
+
+#include "Canvas.hpp"
+#include "Color.hpp"
+#include "Point.hpp"
+
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Canvas storing each row as runs of equal color.
+    //! Memory grows with the number of color changes instead of the
+    //! number of pixels, and PNG encoding works from the runs directly.
+    class SpanImage : public Canvas
+    {
+    public:
+        //! Run of pixels of the same color.
+        struct Run
+        {
+            //! First column.
+            int x0;
+            //! Last column (inclusive).
+            int x1;
+            //! Color.
+            Color color;
+        };
+
+        //! Constructor of blank image.
+        //! Initally, all pixels will be white.
+        //! @param w Image width.
+        //! @param h Image height.
+        SpanImage(int w, int h);
+        int width() const override;
+        int height() const override;
+        //! Get pixel color.
+        //! @param x X position
+        //! @param y Y position.
+        //! @return Pixel color.
+        Color at(int x, int y) const;
+        //! Get the runs of a row, sorted and covering the whole row.
+        //! @param y Row.
+        //! @return Runs.
+        const std::vector<Run> &row(int y) const;
+        //! Get the total number of runs.
+        //! @return Number of runs.
+        size_t run_count() const;
+        //! Paint a horizontal run of pixels, clipped to the image.
+        //! @param y Row.
+        //! @param x0 First column.
+        //! @param x1 Last column (inclusive).
+        //! @param c Color.
+        void fill_span(int y, int x0, int x1, const Color &c);
+        //! Composite a constant color over a horizontal run of pixels, clipped to the image.
+        //! @param y Row.
+        //! @param x0 First column.
+        //! @param x1 Last column (inclusive).
+        //! @param c Color.
+        //! @param alpha Opacity of c.
+        void blend_span(int y, int x0, int x1, const Color &c, rgb_value alpha);
+        void set_alpha(rgb_value alpha) override;
+        //! Start a layer, saving the runs of its rows until end_layer.
+        //! @param top_left Top-left corner of the area drawn in the layer.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        void begin_layer(const Point &top_left, const Point &bottom_right) override;
+        void end_layer(rgb_value alpha) override;
+        using Canvas::save;
+        //! Save to output file; PNG is encoded straight from the runs.
+        //! @param png_file_name Output file name.
+        //! @param format File format.
+        void save(const std::string &png_file_name, ImageFormat format) const override;
+        //! Encode as PNG into memory, straight from the runs.
+        //! @param png_data Receives the PNG bytes.
+        void encode(std::vector<unsigned char> &png_data) const;
+        void draw_line(const Point &a, const Point &b, const Color &c) override;
+        void draw_stroke(const Point *points, size_t count, const StrokeStyle &style, const Color &c) override;
+        void draw_stroke(const PackedPoints &points, const StrokeStyle &style, const Color &c) override;
+        using Canvas::draw_polygon;
+        void draw_polygon(const Point *points, size_t count, const Color &fill) override;
+        void draw_polygon(const PackedPoints &points, const Color &fill) override;
+        void draw_path(const Point *points, const size_t *ends, size_t contours, FillRule rule,
+                       const Color &fill) override;
+        void draw_ellipse(const Point &center, const Point &radius, int degrees, const Color &fill) override;
+        void fill_rect(const Point &top_left, const Point &bottom_right, const Color &fill) override;
+
+    private:
+        //! Width.
+        int width_;
+        //! Height.
+        int height_;
+        //! Runs of each row.
+        std::vector<std::vector<Run>> rows_;
+        //! Opacity of the shapes drawn next.
+        rgb_value alpha_;
+        //! Layer started by begin_layer.
+        struct Layer
+        {
+            //! Top-left corner of the saved area.
+            Point top_left;
+            //! Bottom-right corner of the saved area (inclusive).
+            Point bottom_right;
+            //! Saved runs of the rows of the area (empty if the area is).
+            std::vector<std::vector<Run>> below;
+        };
+        //! Layers started and not ended yet, innermost last.
+        std::vector<Layer> layers_;
+        //! Scratch runs of blend_span and end_layer.
+        std::vector<Run> pieces_;
+    };
+}
+#endif
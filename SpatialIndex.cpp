@@ -0,0 +1,227 @@
+//! @file SpatialIndex.cpp
+#include "SpatialIndex.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace svg
+{
+    namespace
+    {
+        //! Check if a bounding box is empty.
+        bool empty_box(const Point &top_left, const Point &bottom_right)
+        {
+            return top_left.x > bottom_right.x || top_left.y > bottom_right.y;
+        }
+    }
+
+    const int SpatialIndex::MAX_ELEMENT_CELLS;
+
+    SpatialIndex::SpatialIndex(const std::vector<SVGElement *> &elements)
+        : boxes_(elements.size()), origin_(Point{0, 0}), cell_size_(1), columns_(0), rows_(0)
+    {
+        Point min = {INT_MAX, INT_MAX}, max = {INT_MIN, INT_MIN};
+        size_t boxes = 0;
+        for (size_t i = 0; i < elements.size(); i++)
+        {
+            Box &b = boxes_[i];
+            elements[i]->get_bounds(b.top_left, b.bottom_right);
+            if (!empty_box(b.top_left, b.bottom_right))
+            {
+                min = Point{std::min(min.x, b.top_left.x), std::min(min.y, b.top_left.y)};
+                max = Point{std::max(max.x, b.bottom_right.x), std::max(max.y, b.bottom_right.y)};
+                boxes++;
+            }
+        }
+        if (boxes == 0)
+        {
+            return;
+        }
+        // Square cells, about one per element
+        double w = (double)max.x - min.x + 1, h = (double)max.y - min.y + 1;
+        cell_size_ = (int)std::min(std::ceil(std::sqrt(w * h / boxes)), (double)INT_MAX / 2);
+        cell_size_ = std::max(cell_size_, 1);
+        origin_ = min;
+        columns_ = (int)std::ceil(w / cell_size_);
+        rows_ = (int)std::ceil(h / cell_size_);
+        cells_.resize((size_t)columns_ * rows_);
+        // In element order, so every cell is ascending
+        for (size_t i = 0; i < boxes_.size(); i++)
+        {
+            file((uint32_t)i);
+        }
+    }
+
+    size_t SpatialIndex::size() const
+    {
+        return boxes_.size();
+    }
+
+    bool SpatialIndex::cells(const Point &top_left, const Point &bottom_right, Point &first, Point &last) const
+    {
+        if (columns_ == 0 || empty_box(top_left, bottom_right))
+        {
+            return false;
+        }
+        // Offsets from the origin in 64 bits: boxes may be anywhere
+        long long x0 = ((long long)top_left.x - origin_.x) / cell_size_;
+        long long y0 = ((long long)top_left.y - origin_.y) / cell_size_;
+        long long x1 = ((long long)bottom_right.x - origin_.x) / cell_size_;
+        long long y1 = ((long long)bottom_right.y - origin_.y) / cell_size_;
+        if (bottom_right.x < origin_.x || bottom_right.y < origin_.y || x0 >= columns_ || y0 >= rows_)
+        {
+            return false;
+        }
+        first = Point{(int)std::max(x0, 0LL), (int)std::max(y0, 0LL)};
+        last = Point{(int)std::min(x1, (long long)columns_ - 1), (int)std::min(y1, (long long)rows_ - 1)};
+        return true;
+    }
+
+    bool SpatialIndex::in_grid(const Box &b, Point &first, Point &last) const
+    {
+        if (!cells(b.top_left, b.bottom_right, first, last))
+        {
+            return false;
+        }
+        // Partly off the grid, it could be missed by queries off the grid
+        return b.top_left.x >= origin_.x && b.top_left.y >= origin_.y &&
+               (long long)b.bottom_right.x - origin_.x < (long long)columns_ * cell_size_ &&
+               (long long)b.bottom_right.y - origin_.y < (long long)rows_ * cell_size_ &&
+               (double)(last.x - first.x + 1) * (last.y - first.y + 1) <= MAX_ELEMENT_CELLS;
+    }
+
+    void SpatialIndex::file(uint32_t i)
+    {
+        const Box &b = boxes_[i];
+        Point first, last;
+        if (empty_box(b.top_left, b.bottom_right))
+        {
+            return;
+        }
+        if (!in_grid(b, first, last))
+        {
+            large_.insert(std::lower_bound(large_.begin(), large_.end(), i), i);
+            return;
+        }
+        for (int y = first.y; y <= last.y; y++)
+        {
+            for (int x = first.x; x <= last.x; x++)
+            {
+                std::vector<uint32_t> &cell = cells_[(size_t)y * columns_ + x];
+                cell.insert(std::lower_bound(cell.begin(), cell.end(), i), i);
+            }
+        }
+    }
+
+    void SpatialIndex::unfile(uint32_t i)
+    {
+        const Box &b = boxes_[i];
+        Point first, last;
+        if (empty_box(b.top_left, b.bottom_right))
+        {
+            return;
+        }
+        if (!in_grid(b, first, last))
+        {
+            large_.erase(std::lower_bound(large_.begin(), large_.end(), i));
+            return;
+        }
+        for (int y = first.y; y <= last.y; y++)
+        {
+            for (int x = first.x; x <= last.x; x++)
+            {
+                std::vector<uint32_t> &cell = cells_[(size_t)y * columns_ + x];
+                cell.erase(std::lower_bound(cell.begin(), cell.end(), i));
+            }
+        }
+    }
+
+    void SpatialIndex::bounds(size_t i, Point &top_left, Point &bottom_right) const
+    {
+        const Box &b = boxes_.at(i);
+        top_left = b.top_left;
+        bottom_right = b.bottom_right;
+    }
+
+    void SpatialIndex::move(size_t i, const Point &top_left, const Point &bottom_right)
+    {
+        unfile((uint32_t)i);
+        boxes_.at(i) = Box{top_left, bottom_right};
+        file((uint32_t)i);
+    }
+
+    void SpatialIndex::query(const Point &p, std::vector<size_t> &found) const
+    {
+        found.clear();
+        auto contains = [&](uint32_t i)
+        {
+            const Box &b = boxes_[i];
+            return b.top_left.x <= p.x && p.x <= b.bottom_right.x && b.top_left.y <= p.y && p.y <= b.bottom_right.y;
+        };
+        // The cell and the large elements are both ascending: merge them
+        const uint32_t *cell = nullptr, *cell_end = nullptr;
+        Point first, last;
+        if (cells(p, p, first, last))
+        {
+            const std::vector<uint32_t> &items = cells_[(size_t)first.y * columns_ + first.x];
+            cell = items.data();
+            cell_end = items.data() + items.size();
+        }
+        std::vector<uint32_t>::const_iterator large = large_.begin();
+        while (cell != cell_end || large != large_.end())
+        {
+            uint32_t i;
+            if (large == large_.end() || (cell != cell_end && *cell < *large))
+            {
+                i = *cell++;
+            }
+            else
+            {
+                i = *large++;
+            }
+            if (contains(i))
+            {
+                found.push_back(i);
+            }
+        }
+    }
+
+    void SpatialIndex::query(const Point &top_left, const Point &bottom_right, std::vector<size_t> &found) const
+    {
+        found.clear();
+        auto overlaps = [&](uint32_t i)
+        {
+            const Box &b = boxes_[i];
+            return b.top_left.x <= bottom_right.x && top_left.x <= b.bottom_right.x &&
+                   b.top_left.y <= bottom_right.y && top_left.y <= b.bottom_right.y;
+        };
+        Point first, last;
+        if (cells(top_left, bottom_right, first, last))
+        {
+            for (int y = first.y; y <= last.y; y++)
+            {
+                for (int x = first.x; x <= last.x; x++)
+                {
+                    for (uint32_t i : cells_[(size_t)y * columns_ + x])
+                    {
+                        if (overlaps(i))
+                        {
+                            found.push_back(i);
+                        }
+                    }
+                }
+            }
+        }
+        for (uint32_t i : large_)
+        {
+            if (overlaps(i))
+            {
+                found.push_back(i);
+            }
+        }
+        // Elements of several cells are found once per cell
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+    }
+}
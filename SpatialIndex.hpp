@@ -0,0 +1,88 @@
+//! @file SpatialIndex.hpp
+#ifndef __svg_SpatialIndex_hpp__
+#define __svg_SpatialIndex_hpp__
+
+#include "Point.hpp"
+#include "SVGElements.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace svg
+{
+    //! Uniform grid over the bounding boxes of elements, to find the
+    //! elements near a point or a rectangle without visiting all of them.
+    //! Cells are about as many as the elements, so a query visits a few
+    //! elements whatever the size of the document. Elements spanning more
+    //! than MAX_ELEMENT_CELLS cells, or lying off the grid, are kept aside
+    //! and tested by every query. An element that moves is filed again with
+    //! move(), which only visits the cells of its old and new boxes; the grid
+    //! itself keeps the extent and cell size it was built with.
+    class SpatialIndex
+    {
+    public:
+        //! Most cells an element is stored in.
+        static const int MAX_ELEMENT_CELLS = 64;
+
+        //! Constructor, indexes the bounding boxes of elements.
+        //! @param elements Elements (groups are one box); element i has index i.
+        SpatialIndex(const std::vector<SVGElement *> &elements);
+        //! Get the number of indexed elements.
+        //! @return Number of elements.
+        size_t size() const;
+        //! Find the elements whose bounding box contains a point.
+        //! @param p Point.
+        //! @param found Receives their indices, ascending: in drawing order, the topmost last.
+        void query(const Point &p, std::vector<size_t> &found) const;
+        //! Find the elements whose bounding box overlaps a rectangle.
+        //! @param top_left Top-left corner.
+        //! @param bottom_right Bottom-right corner (inclusive).
+        //! @param found Receives their indices, ascending.
+        void query(const Point &top_left, const Point &bottom_right, std::vector<size_t> &found) const;
+        //! Get the bounding box of an element, as indexed.
+        //! @param i Element index.
+        //! @param top_left Receives the top-left corner.
+        //! @param bottom_right Receives the bottom-right corner (inclusive).
+        void bounds(size_t i, Point &top_left, Point &bottom_right) const;
+        //! Change the bounding box of an element, after it moved or changed.
+        //! @param i Element index.
+        //! @param top_left New top-left corner.
+        //! @param bottom_right New bottom-right corner (inclusive).
+        void move(size_t i, const Point &top_left, const Point &bottom_right);
+
+    private:
+        //! Bounding box.
+        struct Box
+        {
+            Point top_left;
+            Point bottom_right;
+        };
+
+        //! Get the cell range of a rectangle, clamped to the grid.
+        //! @return False if it is outside the grid.
+        bool cells(const Point &top_left, const Point &bottom_right, Point &first, Point &last) const;
+        //! Get the cell range of a box, if it lies on the grid within MAX_ELEMENT_CELLS cells.
+        bool in_grid(const Box &b, Point &first, Point &last) const;
+        //! Add an element to the cells of its box, or to large_, keeping them ascending.
+        void file(uint32_t i);
+        //! Remove an element from where file put it.
+        void unfile(uint32_t i);
+
+        //! Bounding box of each element; empty ones are never found.
+        std::vector<Box> boxes_;
+        //! Top-left corner of the grid.
+        Point origin_;
+        //! Side of a cell, in pixels.
+        int cell_size_;
+        //! Cells per row.
+        int columns_;
+        //! Rows of cells.
+        int rows_;
+        //! Elements of each cell, ascending, row after row.
+        std::vector<std::vector<uint32_t>> cells_;
+        //! Elements too large for the grid or off it, ascending.
+        std::vector<uint32_t> large_;
+    };
+}
+#endif
@@ -0,0 +1,59 @@
+//! @file Stroke.hpp
+#ifndef __svg_Stroke_hpp__
+#define __svg_Stroke_hpp__
+
+#include <algorithm>
+#include <cmath>
+
+namespace svg
+{
+    //! Shape of the corners of a wide stroke (stroke-linejoin).
+    enum class LineJoin
+    {
+        MITER,
+        ROUND,
+        BEVEL
+    };
+
+    //! Shape of the ends of a wide stroke (stroke-linecap).
+    enum class LineCap
+    {
+        BUTT,
+        ROUND,
+        SQUARE
+    };
+
+    //! Geometry of a stroke.
+    struct StrokeStyle
+    {
+        //! Width in pixels. Strokes up to 1 pixel wide are drawn as
+        //! the classic one-pixel lines.
+        double width;
+        //! Corners.
+        LineJoin join;
+        //! Ends.
+        LineCap cap;
+        //! Longest miter, as a multiple of the width, before a corner is beveled.
+        double miter_limit;
+
+        //! Check if the stroke is drawn as an outline rather than one-pixel lines.
+        //! @return True if wider than 1 pixel.
+        bool wide() const
+        {
+            return width > 1;
+        }
+        //! Get how far the outline of a wide stroke can reach from its points
+        //! (at a miter tip or the corner of a square cap).
+        //! @return Distance in pixels.
+        double reach() const
+        {
+            double corner = std::max(join == LineJoin::MITER ? miter_limit : 1.0,
+                                     cap == LineCap::SQUARE ? std::sqrt(2.0) : 1.0);
+            return width / 2 * corner;
+        }
+    };
+
+    //! Stroke of elements without stroke attributes (the SVG defaults).
+    const StrokeStyle DEFAULT_STROKE = {1, LineJoin::MITER, LineCap::BUTT, 4};
+}
+#endif
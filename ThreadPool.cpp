@@ -0,0 +1,144 @@
+//! @file ThreadPool.cpp
+#include "ThreadPool.hpp"
+#include "Cancel.hpp"
+
+namespace svg
+{
+    ThreadPool::ThreadPool(unsigned threads) : stop_(false)
+    {
+        if (threads == 0)
+        {
+            threads = std::thread::hardware_concurrency();
+        }
+        // The caller of run is one of the threads
+        for (unsigned i = 1; i < threads; i++)
+        {
+            threads_.push_back(std::thread(&ThreadPool::work, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_ready_.notify_all();
+        for (std::thread &t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    ThreadPool &ThreadPool::global()
+    {
+        static ThreadPool pool(0);
+        return pool;
+    }
+
+    unsigned ThreadPool::size() const
+    {
+        return (unsigned)threads_.size() + 1;
+    }
+
+    bool ThreadPool::claim(Batch &batch, size_t &index)
+    {
+        if (batch.next == batch.count)
+        {
+            return false;
+        }
+        index = batch.next++;
+        if (batch.next == batch.count)
+        {
+            for (auto it = queue_.begin(); it != queue_.end(); ++it)
+            {
+                if (it->get() == &batch)
+                {
+                    queue_.erase(it);
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    void ThreadPool::execute(Batch &batch, size_t index)
+    {
+        std::exception_ptr error;
+        try
+        {
+            CancelScope scope(batch.token);
+            (*batch.task)(index);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error && !batch.error)
+        {
+            batch.error = error;
+        }
+        if (++batch.done == batch.count)
+        {
+            batch_done_.notify_all();
+        }
+    }
+
+    void ThreadPool::run(size_t count, const std::function<void(size_t)> &task)
+    {
+        if (count <= 1 || threads_.empty())
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                task(i);
+            }
+            return;
+        }
+        std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+        batch->task = &task;
+        batch->count = count;
+        batch->next = 0;
+        batch->done = 0;
+        batch->token = current_cancel_token();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(batch);
+        }
+        work_ready_.notify_all();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        size_t index;
+        while (claim(*batch, index))
+        {
+            lock.unlock();
+            execute(*batch, index);
+            lock.lock();
+        }
+        batch_done_.wait(lock, [&batch] { return batch->done == batch->count; });
+        if (batch->error)
+        {
+            std::rethrow_exception(batch->error);
+        }
+    }
+
+    void ThreadPool::work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            work_ready_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (stop_)
+            {
+                return;
+            }
+            // Keep the batch alive while its task runs
+            std::shared_ptr<Batch> batch = queue_.front();
+            size_t index;
+            claim(*batch, index);
+            lock.unlock();
+            execute(*batch, index);
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,83 @@
+//! @file ThreadPool.hpp
+#ifndef __svg_ThreadPool_hpp__
+#define __svg_ThreadPool_hpp__
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace svg
+{
+    class CancelToken;
+
+    //! Fixed set of threads running indexed batches of tasks.
+    //! The calling thread works on its own batch too, so batches may be
+    //! started from inside tasks and from several threads at once.
+    class ThreadPool
+    {
+    public:
+        //! Constructor, starts the threads.
+        //! @param threads Number of threads, including the caller (0 = one per core).
+        ThreadPool(unsigned threads);
+        //! Destructor, stops the threads.
+        ~ThreadPool();
+        //! Get the process-wide pool, with one thread per core.
+        //! @return Global pool.
+        static ThreadPool &global();
+        //! Get the number of threads, including the caller.
+        //! @return Number of threads.
+        unsigned size() const;
+        //! Run task(0), ..., task(count - 1) and wait for all of them.
+        //! If tasks throw, the first exception is rethrown here once
+        //! the whole batch has finished. Tasks see the cancellation token
+        //! of the caller (see CancelScope).
+        //! @param count Number of tasks.
+        //! @param task Task body, receiving the task index.
+        void run(size_t count, const std::function<void(size_t)> &task);
+
+    private:
+        ThreadPool(const ThreadPool &);
+        ThreadPool &operator=(const ThreadPool &);
+
+        //! Tasks of one run call.
+        struct Batch
+        {
+            const std::function<void(size_t)> *task;
+            size_t count;
+            //! Next task to hand out.
+            size_t next;
+            //! Finished tasks.
+            size_t done;
+            //! First exception thrown by a task.
+            std::exception_ptr error;
+            //! Cancellation token of the caller.
+            const CancelToken *token;
+        };
+        //! Take the next task of a batch. Requires mutex_.
+        bool claim(Batch &batch, size_t &index);
+        //! Run one task and record its completion.
+        void execute(Batch &batch, size_t index);
+        //! Worker thread loop.
+        void work();
+
+        //! Batches with tasks left to hand out.
+        std::deque<std::shared_ptr<Batch>> queue_;
+        //! Worker threads.
+        std::vector<std::thread> threads_;
+        //! Set to stop the workers.
+        bool stop_;
+        //! Protects everything above and batch counters.
+        std::mutex mutex_;
+        //! Signalled when a batch is queued.
+        std::condition_variable work_ready_;
+        //! Signalled when a batch finishes.
+        std::condition_variable batch_done_;
+    };
+}
+#endif
@@ -1,23 +1,325 @@
+#include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "SVGElements.hpp"
+#include "Cancel.hpp"
+#include "FormatImage.hpp"
+#include "Optimize.hpp"
+#include "PickBuffer.hpp"
+#include "SpanImage.hpp"
+#include "ThreadPool.hpp"
 
 namespace svg
 {
+    /// @brief Collects the non-group elements, in drawing order
+    /// @param svg_elements Vector of SVGElements
+    /// @param leaves Receives the elements
+    static void flatten(const std::vector<SVGElement *> &svg_elements, std::vector<SVGElement *> &leaves)
+    {
+        for (SVGElement *e : svg_elements)
+        {
+            Group *group = dynamic_cast<Group *>(e);
+            if (group != nullptr)
+            {
+                flatten(group->get_elements(), leaves);
+            }
+            else
+            {
+                leaves.push_back(e);
+            }
+        }
+    }
+
+    /// @brief Checks if every element, and every group, is drawn opaque
+    /// @param svg_elements Vector of SVGElements
+    /// @return True if nothing is translucent
+    static bool opaque(const std::vector<SVGElement *> &svg_elements)
+    {
+        for (SVGElement *e : svg_elements)
+        {
+            if (e->get_alpha() != OPAQUE_ALPHA)
+            {
+                return false;
+            }
+            Group *group = dynamic_cast<Group *>(e);
+            if (group != nullptr && !opaque(group->get_elements()))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void pack_elements(const std::vector<SVGElement *> &svg_elements)
+    {
+        for (SVGElement *e : svg_elements)
+        {
+            if (Group *group = dynamic_cast<Group *>(e))
+            {
+                pack_elements(group->get_elements());
+            }
+            else if (Polyline *polyline = dynamic_cast<Polyline *>(e))
+            {
+                polyline->pack();
+            }
+            else if (Polygon *polygon = dynamic_cast<Polygon *>(e))
+            {
+                polygon->pack();
+            }
+        }
+    }
+
+    void render_elements(const std::vector<SVGElement *> &svg_elements, Canvas &canvas, const RenderOptions &options)
+    {
+        PNGImage *dense = dynamic_cast<PNGImage *>(&canvas);
+        // Translucent shapes, and anti-aliased edges, show what is under
+        // them: painter's order only
+        if (!options.occlusion || dense == nullptr || options.antialias || !opaque(svg_elements))
+        {
+            for (SVGElement* e : svg_elements)
+            {
+                check_cancel();
+                e->draw(canvas);
+            }
+            return;
+        }
+        PNGImage &img = *dense;
+        // Every shape is opaque, so drawing front-to-back and painting only
+        // uncovered pixels gives the painter's order result with no overdraw.
+        std::vector<SVGElement *> leaves;
+        flatten(svg_elements, leaves);
+        img.set_occlusion(true);
+        for (size_t i = leaves.size(); i-- > 0;)
+        {
+            check_cancel();
+            Point top_left, bottom_right;
+            leaves[i]->get_bounds(top_left, bottom_right);
+            if (!img.covered(top_left, bottom_right))
+            {
+                leaves[i]->draw(img);
+            }
+        }
+        img.set_occlusion(false);
+    }
+
+    /// @brief Draws the IDs of the non-group elements, skipping invisible groups
+    /// @param svg_elements Vector of SVGElements
+    /// @param buffer Pick buffer
+    /// @param picked Receives the elements
+    /// @param visible Whether the enclosing groups are visible
+    static void pick_elements(const std::vector<SVGElement *> &svg_elements, PickBuffer &buffer,
+                              std::vector<SVGElement *> &picked, bool visible)
+    {
+        for (SVGElement *e : svg_elements)
+        {
+            Group *group = dynamic_cast<Group *>(e);
+            if (group != nullptr)
+            {
+                pick_elements(group->get_elements(), buffer, picked, visible && group->get_alpha() != 0);
+                continue;
+            }
+            picked.push_back(e);
+            if (visible)
+            {
+                buffer.set_id((uint32_t)picked.size());
+                e->draw(buffer);
+            }
+        }
+    }
+
+    void render_pick(const std::vector<SVGElement *> &svg_elements, PickBuffer &buffer, std::vector<SVGElement *> &picked)
+    {
+        picked.clear();
+        pick_elements(svg_elements, buffer, picked, true);
+    }
+
+    /// @brief Draws elements into a FormatImage and saves it
+    /// @param svg_elements Vector of SVGElements
+    /// @param dimensions Document dimensions
+    /// @param png_file Output file
+    /// @param options Render options
+    template <class Image>
+    static void render_format(const std::vector<SVGElement *> &svg_elements, const Point &dimensions,
+                              const std::string &png_file, const RenderOptions &options)
+    {
+        Image img(dimensions.x, dimensions.y);
+        render_elements(svg_elements, img, options);
+        img.save(png_file, options.format);
+    }
+
     void convert(const std::string &svg_file, const std::string &png_file)
+    {
+        convert(svg_file, png_file, RenderOptions());
+    }
+
+    void load_elements(const std::string &svg_file, Point &dimensions,
+                       std::vector<SVGElement *> &svg_elements, const RenderOptions &options)
+    {
+        readSVG(svg_file, dimensions, svg_elements, options.parallel_parse);
+        if (options.optimize)
+        {
+            OptimizeStats stats = optimize_elements(svg_elements, dimensions);
+            if (options.optimize_stats != nullptr)
+            {
+                *options.optimize_stats = stats;
+            }
+        }
+        if (options.pack_points)
+        {
+            pack_elements(svg_elements);
+        }
+    }
+
+    void convert(const std::string &svg_file, const std::string &png_file, const RenderOptions &options)
     {
         Point dimensions;
         std::vector<SVGElement *> svg_elements;
-        readSVG(svg_file, dimensions, svg_elements);
-        PNGImage img(dimensions.x, dimensions.y);
-        for (SVGElement* e : svg_elements)
+        try
+        {
+            // Cancelled jobs (see CancelScope) throw from any stage
+            load_elements(svg_file, dimensions, svg_elements, options);
+            if (options.pixels == PixelFormat::RGBA)
+            {
+                render_format<RGBAImage>(svg_elements, dimensions, png_file, options);
+            }
+            else if (options.pixels == PixelFormat::GRAY)
+            {
+                render_format<GrayImage>(svg_elements, dimensions, png_file, options);
+            }
+            else if (options.pixels == PixelFormat::MASK)
+            {
+                render_format<MaskImage>(svg_elements, dimensions, png_file, options);
+            }
+            else if (options.spans)
+            {
+                SpanImage img(dimensions.x, dimensions.y);
+                render_elements(svg_elements, img, options);
+                img.save(png_file, options.format);
+            }
+            else
+            {
+                PNGImage img(dimensions.x, dimensions.y);
+                img.set_parallel_fill(options.parallel_fill_vertices, options.parallel_fill_area);
+                img.set_antialias(options.antialias);
+                render_elements(svg_elements, img, options);
+                img.save(png_file, options.format);
+            }
+        }
+        catch (...)
+        {
+            for (SVGElement* e  : svg_elements)
+            {
+                delete e;
+            }
+            throw;
+        }
+        for (SVGElement* e  : svg_elements)
+        {
+            delete e;
+        }
+    }
+
+    void convert(const std::string &svg_file, const std::vector<RenderTarget> &targets, const RenderOptions &options)
+    {
+        for (const RenderTarget &t : targets)
+        {
+            if (t.reduce < 1 || t.size.x < 0 || t.size.y < 0)
+            {
+                throw std::runtime_error(t.png_file + ": invalid render target!");
+            }
+        }
+        Point dimensions;
+        std::vector<SVGElement *> svg_elements;
+        try
+        {
+            load_elements(svg_file, dimensions, svg_elements, options);
+            // Scaling the integer geometry down would not match the box filter,
+            // so every target is cut from one full-size drawing
+            PNGImage full(dimensions.x, dimensions.y);
+            full.set_parallel_fill(options.parallel_fill_vertices, options.parallel_fill_area);
+            full.set_antialias(options.antialias);
+            render_elements(svg_elements, full, options);
+            ThreadPool::global().run(targets.size(), [&](size_t i)
+                                     {
+                                         const RenderTarget &t = targets[i];
+                                         Point size = (t.size.x == 0 && t.size.y == 0) ? dimensions : t.size;
+                                         PNGImage img(std::max((size.x + t.reduce - 1) / t.reduce, 1),
+                                                      std::max((size.y + t.reduce - 1) / t.reduce, 1));
+                                         img.downsample(full, t.top_left, t.reduce);
+                                         img.save(t.png_file, options.format);
+                                     });
+        }
+        catch (...)
+        {
+            for (SVGElement* e  : svg_elements)
+            {
+                delete e;
+            }
+            throw;
+        }
+        for (SVGElement* e  : svg_elements)
+        {
+            delete e;
+        }
+    }
+
+    void convert(const char *svg_data, size_t size, std::vector<unsigned char> &png_data)
+    {
+        Point dimensions;
+        std::vector<SVGElement *> svg_elements;
+        try
+        {
+            parseSVG(svg_data, size, dimensions, svg_elements);
+            PNGImage img(dimensions.x, dimensions.y);
+            render_elements(svg_elements, img, RenderOptions());
+            img.encode(png_data);
+        }
+        catch (...)
+        {
+            for (SVGElement* e  : svg_elements)
+            {
+                delete e;
+            }
+            throw;
+        }
+        for (SVGElement* e  : svg_elements)
+        {
+            delete e;
+        }
+    }
+
+    Point render(const char *svg_data, size_t size, Color *pixels, size_t capacity)
+    {
+        Point dimensions;
+        std::vector<SVGElement *> svg_elements;
+        try
+        {
+            parseSVG(svg_data, size, dimensions, svg_elements);
+            if (dimensions.x <= 0 || dimensions.y <= 0 ||
+                (size_t)dimensions.x * dimensions.y > capacity)
+            {
+                throw std::runtime_error("render: buffer too small for " +
+                                         std::to_string(dimensions.x) + "x" +
+                                         std::to_string(dimensions.y) + " image");
+            }
+            // Draws straight into the caller's buffer
+            PNGImage img(dimensions.x, dimensions.y, pixels);
+            img.clear();
+            render_elements(svg_elements, img, RenderOptions());
+        }
+        catch (...)
         {
-            e->draw(img);
+            for (SVGElement* e  : svg_elements)
+            {
+                delete e;
+            }
+            throw;
         }
-        img.save(png_file);
         for (SVGElement* e  : svg_elements)
         {
             delete e;
         }
+        return dimensions;
     }
-}
\ No newline at end of file
+}